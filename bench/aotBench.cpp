@@ -0,0 +1,77 @@
+// The roms chip8_aot compiled into this benchmark at build time, run on the interpreter, which goes
+// through HandleOpcode for every instruction, on the block cache, the JIT and the AOT engine:
+//   alu     register-only loop touching every ALU group, skips, ANNN and FX1E
+//   draw    two 15-row sprites per iteration, and CLS
+//   call    recursion 15 calls deep, then all the way back
+//   memory  FX33, FX55 and FX65 traffic, each ending a block
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "aotEngine.h"
+#include "jit.h"
+
+using namespace std;
+
+struct Run
+{
+	double Seconds = 0;
+	double NativeShare = 0; // of the instructions, under Engine::Aot.
+	MachineState State;
+};
+
+static Run RunEngine(const AotProgram &program, Engine engine, uint64_t instructions)
+{
+	Machine machine;
+	machine.SetQuirks(program.Quirks);
+	machine.SetEngine(engine);
+	machine.SeedRandom(1);
+	machine.LoadProgram(program.Rom, program.RomSize);
+
+	Run run;
+	const auto start = chrono::steady_clock::now();
+	machine.Step(instructions);
+	run.Seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	run.State = machine.GetState();
+
+	if (const AotStats *stats = machine.GetAotStats())
+	{
+		if (stats->Program != &program)
+			throw runtime_error("The compiled program was not matched to the rom.");
+		run.NativeShare = (double)stats->NativeInstructions / instructions;
+	}
+	return run;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint64_t instructions = argc > 1 ? stoull(argv[1]) : 50000000;
+	const bool jit = JitCompiler::IsSupported();
+
+	cout << "rom         interpreter ins/sec   cached ins/sec      jit ins/sec      aot ins/sec   aot speedup   aot native\n";
+	for (const AotProgram *program : GetAotPrograms())
+	{
+		const Run interpreted = RunEngine(*program, Engine::Interpreter, instructions);
+		const Run cached = RunEngine(*program, Engine::Cached, instructions);
+		const Run native = jit ? RunEngine(*program, Engine::Jit, instructions) : Run();
+		const Run compiled = RunEngine(*program, Engine::Aot, instructions);
+
+		if (memcmp(&interpreted.State, &cached.State, sizeof(MachineState)) != 0 ||
+			memcmp(&interpreted.State, &compiled.State, sizeof(MachineState)) != 0 ||
+			(jit && memcmp(&interpreted.State, &native.State, sizeof(MachineState)) != 0))
+		{
+			cerr << program->Name << ": engines diverged!" << endl;
+			return 1;
+		}
+
+		char line[160];
+		snprintf(line, sizeof(line), "%-8s %21llu %16llu %16llu %16llu %12.2fx %11.1f%%\n", program->Name,
+				 (unsigned long long)(instructions / interpreted.Seconds), (unsigned long long)(instructions / cached.Seconds),
+				 (unsigned long long)(jit ? instructions / native.Seconds : 0), (unsigned long long)(instructions / compiled.Seconds),
+				 interpreted.Seconds / compiled.Seconds, 100 * compiled.NativeShare);
+		cout << line;
+	}
+	cout.flush();
+	return 0;
+}
\ No newline at end of file
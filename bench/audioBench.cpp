@@ -0,0 +1,127 @@
+// Underruns and latency of the audio path across emulation speed changes. One thread runs a
+// beeping program and pushes every frame's sound, another plays the part of the audio device,
+// rendering a buffer each time the last one would have finished playing.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "audioStream.h"
+#include "machine.h"
+
+using namespace std;
+
+#define DEVICE_SAMPLES 512 // per callback, as the SDL frontend asks for.
+
+typedef chrono::steady_clock Clock;
+
+// Sounds for 8 frames, waits them out on the delay timer, and again.
+static const uint8_t BeepLoop[] = {
+	0x60, 0x08, // 200: LD V0, 8
+	0xF0, 0x18, // 202: LD ST, V0
+	0xF0, 0x15, // 204: LD DT, V0
+	0xF1, 0x07, // 206: LD V1, DT
+	0x31, 0x00, // 208: SE V1, 0
+	0x12, 0x06, // 20A: JMP 206
+	0x12, 0x00, // 20C: JMP 200
+};
+
+struct Phase
+{
+	const char *Name;
+	double Seconds;
+	double Speed; // emulated frames per real one, 0 for unthrottled.
+};
+
+static const Phase Phases[] = {
+	{"1x", 2, 1},
+	{"turbo", 1, 0},
+	{"1x", 1, 1},
+	{"0.6x", 2, 0.6},
+	{"1.5x", 2, 1.5},
+	{"1x", 12, 1},
+};
+static const size_t PhaseCount = sizeof(Phases) / sizeof(Phases[0]);
+
+int main(int argc, char *argv[])
+{
+	Machine machine;
+	if (argc > 1)
+		machine.LoadRom(argv[1]);
+	else
+		machine.LoadProgram(BeepLoop, sizeof(BeepLoop));
+
+	// Rendering cost alone, a tone that never stops.
+	{
+		ToneGenerator tone;
+		SoundFrame frame = MakeSoundFrame(machine);
+		frame.On = true;
+		vector<int16_t> samples(AUDIO_SAMPLE_RATE);
+		const auto start = Clock::now();
+		for (int second = 0; second < 20; second++)
+			tone.Render(frame, samples.data(), samples.size());
+		const double seconds = chrono::duration<double>(Clock::now() - start).count();
+		cout << "render ns/sample:    " << seconds * 1e9 / (20.0 * AUDIO_SAMPLE_RATE) << "\n";
+	}
+
+	AudioStream stream;
+	const Clock::time_point start = Clock::now() + chrono::milliseconds(10);
+	vector<Clock::time_point> phaseEnds;
+	Clock::time_point end = start;
+	for (const Phase &phase : Phases)
+		phaseEnds.push_back(end += chrono::duration_cast<Clock::duration>(chrono::duration<double>(phase.Seconds)));
+
+	// The device: one callback per DEVICE_SAMPLES, the stats taken at each phase end.
+	vector<AudioStats> atPhaseEnd;
+	thread device([&]
+				  {
+					  int16_t samples[DEVICE_SAMPLES];
+					  for (uint64_t callback = 1; atPhaseEnd.size() < PhaseCount; callback++)
+					  {
+						  this_thread::sleep_until(start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(callback * (double)DEVICE_SAMPLES / AUDIO_SAMPLE_RATE)));
+						  stream.Render(samples, DEVICE_SAMPLES);
+						  if (Clock::now() >= phaseEnds[atPhaseEnd.size()])
+							  atPhaseEnd.push_back(stream.GetStats());
+					  } });
+
+	vector<uint64_t> pushedAtPhaseEnd, droppedAtPhaseEnd;
+	uint64_t pushed = 0;
+	for (size_t index = 0; index < PhaseCount; index++)
+	{
+		const Phase &phase = Phases[index];
+		const Clock::time_point phaseStart = Clock::now();
+		for (uint64_t frame = 1; Clock::now() < phaseEnds[index]; frame++)
+		{
+			machine.RunFrames(1);
+			stream.Push(machine);
+			pushed++;
+			if (phase.Speed > 0)
+				this_thread::sleep_until(phaseStart + chrono::duration_cast<Clock::duration>(chrono::duration<double>(frame / (phase.Speed * FRAME_RATE))));
+		}
+		pushedAtPhaseEnd.push_back(pushed);
+		droppedAtPhaseEnd.push_back(stream.GetFramesDropped());
+	}
+	device.join();
+
+	cout << "phase      pushed  played  underruns  skipped  dropped  latency avg/max ms  callback avg/max us  target\n";
+	AudioStats before;
+	for (size_t index = 0; index < PhaseCount; index++)
+	{
+		const AudioStats &after = atPhaseEnd[index];
+		const uint64_t played = after.FramesPlayed - before.FramesPlayed;
+		const uint64_t callbacks = after.Callbacks - before.Callbacks;
+		char line[160];
+		snprintf(line, sizeof(line), "%-8s %8llu %7llu %10llu %8llu %8llu %9.2f / %-7.2f %11.2f / %-7.2f %6u\n", Phases[index].Name,
+				 (unsigned long long)(pushedAtPhaseEnd[index] - (index ? pushedAtPhaseEnd[index - 1] : 0)), (unsigned long long)played,
+				 (unsigned long long)(after.Underruns - before.Underruns), (unsigned long long)(after.FramesSkipped - before.FramesSkipped),
+				 (unsigned long long)(droppedAtPhaseEnd[index] - (index ? droppedAtPhaseEnd[index - 1] : 0)),
+				 played ? (after.LatencySumMs - before.LatencySumMs) / played : 0.0, after.LatencyMaxMs,
+				 callbacks ? (after.CallbackSumUs - before.CallbackSumUs) / callbacks : 0.0, after.CallbackMaxUs, after.QueueTarget);
+		cout << line;
+		before = after;
+	}
+	cout << "(latency and callback maxima are running maxima; latency excludes the " << DEVICE_SAMPLES * 1000.0 / AUDIO_SAMPLE_RATE
+		 << " ms device buffer)" << endl;
+	return 0;
+}
\ No newline at end of file
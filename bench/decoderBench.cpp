@@ -0,0 +1,324 @@
+// Micro-benchmark of the decode table, the block cache and the JIT against the nested switch they replaced.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "machine.h"
+#include "jit.h"
+
+using namespace std;
+
+class DecoderBench
+{
+public:
+	typedef void (*Step)(Machine &, uint16_t);
+
+	static void LegacyHandleOpcode(Machine &machine, uint16_t opcode);
+	static void TableHandleOpcode(Machine &machine, uint16_t opcode);
+	static void LoadProgram(Machine &machine, const uint8_t *program, uint size);
+	static double Run(Machine &machine, Step step, uint64_t instructions);
+	static double RunEngine(Machine &machine, Engine engine, uint64_t instructions);
+	static bool SameState(const Machine &a, const Machine &b);
+};
+
+// Register-only loop touching every ALU group, a skip, ANNN and FX1E.
+static const uint8_t AluLoop[] = {
+	0x60, 0x05, // 200: LD V0, 5
+	0x61, 0x03, // 202: LD V1, 3
+	0x70, 0x01, // 204: ADD V0, 1
+	0x80, 0x14, // 206: ADD V0, V1
+	0x82, 0x12, // 208: AND V2, V1
+	0x83, 0x03, // 20A: XOR V3, V0
+	0x84, 0x06, // 20C: SHR V4
+	0x30, 0x00, // 20E: SE V0, 0
+	0xA3, 0x00, // 210: LD I, 300
+	0xF1, 0x1E, // 212: ADD I, V1
+	0x45, 0x00, // 214: SNE V5, 0
+	0x12, 0x04, // 216: JMP 204
+};
+
+int main(int argc, char *argv[])
+{
+	const uint64_t instructions = argc > 1 ? stoull(argv[1]) : 50000000;
+
+	Machine legacy, table, cached;
+	DecoderBench::LoadProgram(legacy, AluLoop, sizeof(AluLoop));
+	DecoderBench::LoadProgram(table, AluLoop, sizeof(AluLoop));
+	DecoderBench::LoadProgram(cached, AluLoop, sizeof(AluLoop));
+
+	const double legacySeconds = DecoderBench::Run(legacy, DecoderBench::LegacyHandleOpcode, instructions);
+	const double tableSeconds = DecoderBench::Run(table, DecoderBench::TableHandleOpcode, instructions);
+	const double cachedSeconds = DecoderBench::RunEngine(cached, Engine::Cached, instructions);
+
+	Machine native;
+	DecoderBench::LoadProgram(native, AluLoop, sizeof(AluLoop));
+	const double jitSeconds = JitCompiler::IsSupported() ? DecoderBench::RunEngine(native, Engine::Jit, instructions) : 0;
+
+	if (!DecoderBench::SameState(legacy, table) || !DecoderBench::SameState(legacy, cached) ||
+		(JitCompiler::IsSupported() && !DecoderBench::SameState(legacy, native)))
+	{
+		cerr << "Decoders diverged!" << endl;
+		return 1;
+	}
+
+	cout << "instructions:   " << instructions << "\n";
+	cout << "switch ins/sec: " << (uint64_t)(instructions / legacySeconds) << "\n";
+	cout << "table ins/sec:  " << (uint64_t)(instructions / tableSeconds) << "\n";
+	cout << "cached ins/sec: " << (uint64_t)(instructions / cachedSeconds) << "\n";
+	cout << "table speedup:  " << legacySeconds / tableSeconds << "x\n";
+	cout << "cached speedup: " << legacySeconds / cachedSeconds << "x" << endl;
+	if (JitCompiler::IsSupported())
+	{
+		cout << "jit ins/sec:    " << (uint64_t)(instructions / jitSeconds) << "\n";
+		cout << "jit speedup:    " << legacySeconds / jitSeconds << "x" << endl;
+	}
+	return 0;
+}
+
+void DecoderBench::TableHandleOpcode(Machine &machine, uint16_t opcode)
+{
+	machine.HandleOpcode(opcode);
+}
+
+void DecoderBench::LoadProgram(Machine &machine, const uint8_t *program, uint size)
+{
+	machine.ResetMachine();
+	memcpy(machine.Memory + 0x200, program, size);
+}
+
+double DecoderBench::Run(Machine &machine, Step step, uint64_t instructions)
+{
+	const auto start = chrono::steady_clock::now();
+	for (uint64_t i = 0; i < instructions; i++)
+	{
+		machine.currentOpcode = Machine::MergeBytes(machine.Memory[machine.ProgramCounter], machine.Memory[machine.ProgramCounter + 1]);
+		step(machine, machine.currentOpcode);
+	}
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double DecoderBench::RunEngine(Machine &machine, Engine engine, uint64_t instructions)
+{
+	machine.SetEngine(engine);
+	const auto start = chrono::steady_clock::now();
+	machine.Step(instructions);
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+bool DecoderBench::SameState(const Machine &a, const Machine &b)
+{
+	return a.ProgramCounter == b.ProgramCounter && a.IndexRegister == b.IndexRegister &&
+		   memcmp(a.Registers, b.Registers, sizeof(a.Registers)) == 0;
+}
+
+// The nested switch HandleOpcode used before the decode table, kept as the baseline.
+void DecoderBench::LegacyHandleOpcode(Machine &machine, uint16_t opcode)
+{
+	const int group = Machine::GetValueFromBits(opcode, 0, 4);
+	switch (group)
+	{
+
+	case 0:
+	{
+		const int rest = Machine::GetValueFromBits(opcode, 4, 12);
+		if (rest == 0x0E0)
+			machine.CLS<DefaultQuirks>();
+		else if (rest == 0x0EE)
+			machine.RET();
+		else Machine::NoSuchOpcode(opcode);
+	}
+	break;
+
+	case 1:
+	{
+		const int address = Machine::GetValueFromBits(opcode, 4, 12);
+		machine.JMP(address);
+	}
+	break;
+
+	case 2:
+	{
+		const int address = Machine::GetValueFromBits(opcode, 4, 12);
+		machine.CALL_NNN(address);
+	}
+	break;
+
+	case 3:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int value = Machine::GetValueFromBits(opcode, 8, 8);
+		machine.SE_XNN<DefaultQuirks>(X, value);
+	}
+	break;
+
+	case 4:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int value = Machine::GetValueFromBits(opcode, 8, 8);
+		machine.SNE_XNN<DefaultQuirks>(X, value);
+	}
+	break;
+
+	case 5:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int Y = Machine::GetValueFromBits(opcode, 8, 4);
+		machine.SE_XY<DefaultQuirks>(X, Y);
+	}
+	break;
+
+	case 6:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int value = Machine::GetValueFromBits(opcode, 8, 8);
+		machine.LD_XNN(X, value);
+	}
+	break;
+
+	case 7:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int value = Machine::GetValueFromBits(opcode, 8, 8);
+		machine.ADD_XNN(X, value);
+	}
+	break;
+
+	case 8:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int Y = Machine::GetValueFromBits(opcode, 8, 4);
+		const int instructionType = Machine::GetValueFromBits(opcode, 12, 4);
+
+		switch (instructionType)
+		{
+		case 0:
+			machine.LD_XY(X, Y);
+			break;
+		case 1:
+			machine.OR_XY<DefaultQuirks>(X, Y);
+			break;
+		case 2:
+			machine.AND_XY<DefaultQuirks>(X, Y);
+			break;
+		case 3:
+			machine.XOR_XY<DefaultQuirks>(X, Y);
+			break;
+		case 4:
+			machine.ADD_XY(X, Y);
+			break;
+		case 5:
+			machine.SUB_XY(X, Y);
+			break;
+		case 6:
+			machine.SHR_XY<DefaultQuirks>(X, Y);
+			break;
+		case 7:
+			machine.SUBN_XY(X, Y);
+			break;
+		case 0xE:
+			machine.SHL_XY<DefaultQuirks>(X, Y);
+			break;
+		default:
+			Machine::NoSuchOpcode(opcode);
+			break;
+		}
+	}
+	break;
+
+	case 9:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int Y = Machine::GetValueFromBits(opcode, 8, 4);
+		machine.SNE_XY<DefaultQuirks>(X, Y);
+	}
+	break;
+
+	case 0xA:
+	{
+		const int address = Machine::GetValueFromBits(opcode, 4, 12);
+		machine.LD_INNN(address);
+	}
+	break;
+
+	case 0xB:
+	{
+		const int address = Machine::GetValueFromBits(opcode, 4, 12);
+		machine.JMP_0NNN<DefaultQuirks>(address);
+	}
+	break;
+
+	case 0xC:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int value = Machine::GetValueFromBits(opcode, 8, 8);
+		machine.RND_XNN(X, value);
+	}
+	break;
+
+	case 0xD:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int Y = Machine::GetValueFromBits(opcode, 8, 4);
+		const int value = Machine::GetValueFromBits(opcode, 12, 4);
+		machine.DRW_XYN<DefaultQuirks>(X, Y, value);
+	}
+	break;
+
+	case 0xE:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int instructionType = Machine::GetValueFromBits(opcode, 8, 8);
+		if (instructionType == 0x9E)
+			machine.SKP_X<DefaultQuirks>(X);
+		else if (instructionType == 0xA1)
+			machine.SKNP_X<DefaultQuirks>(X);
+		else Machine::NoSuchOpcode(opcode);
+	}
+	break;
+
+	case 0xF:
+	{
+		const int X = Machine::GetValueFromBits(opcode, 4, 4);
+		const int instructionType = Machine::GetValueFromBits(opcode, 8, 8);
+		switch (instructionType)
+		{
+		case 0x07:
+			machine.LD_XDT(X);
+			break;
+		case 0x0A:
+			machine.LD_XK(X);
+			break;
+		case 0x15:
+			machine.LD_DTX(X);
+			break;
+		case 0x18:
+			machine.LD_STX(X);
+			break;
+		case 0x1E:
+			machine.ADD_IX<DefaultQuirks>(X);
+			break;
+		case 0x29:
+			machine.LD_FX(X);
+			break;
+		case 0x33:
+			machine.LD_BX<DefaultQuirks>(X);
+			break;
+		case 0x55:
+			machine.LD_IX<DefaultQuirks>(X);
+			break;
+		case 0x65:
+			machine.LD_XI<DefaultQuirks>(X);
+			break;
+		default:
+			Machine::NoSuchOpcode(opcode);
+			break;
+		}
+	}
+	break;
+
+	default:
+
+		break;
+	}
+}
\ No newline at end of file
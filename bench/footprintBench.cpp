@@ -0,0 +1,61 @@
+// Resident bytes and creation time per idle Machine, allocated one by one and from a MachinePool.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "machine.h"
+#include "machinePool.h"
+
+using namespace std;
+
+static long ResidentBytes()
+{
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * 4096;
+}
+
+struct Footprint
+{
+	double BytesPerInstance;
+	double NanosecondsPerInstance;
+};
+
+template <typename Create>
+static Footprint Measure(size_t count, Create create)
+{
+	const long before = ResidentBytes();
+	const auto start = chrono::steady_clock::now();
+	create();
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return {(double)(ResidentBytes() - before) / count, seconds * 1e9 / count};
+}
+
+int main(int argc, char *argv[])
+{
+	const size_t count = argc > 1 ? stoull(argv[1]) : 100000;
+
+	MachinePool pool;
+	const Footprint pooled = Measure(count, [&]
+									 {
+										 for (size_t i = 0; i < count; i++)
+											 pool.Create(); });
+
+	vector<unique_ptr<Machine>> separate;
+	separate.reserve(count);
+	const Footprint heap = Measure(count, [&]
+								   {
+									   for (size_t i = 0; i < count; i++)
+										   separate.emplace_back(new Machine()); });
+
+	cout << "instances:             " << count << "\n";
+	cout << "sizeof(MachineState):  " << sizeof(MachineState) << "\n";
+	cout << "sizeof(Machine):       " << sizeof(Machine) << "\n";
+	cout << "new bytes/instance:    " << (uint64_t)heap.BytesPerInstance << ", " << (uint64_t)heap.NanosecondsPerInstance << " ns each\n";
+	cout << "pool bytes/instance:   " << (uint64_t)pooled.BytesPerInstance << ", " << (uint64_t)pooled.NanosecondsPerInstance << " ns each\n";
+	cout << "pool resident total:   " << (uint64_t)(pooled.BytesPerInstance * count / (1 << 20)) << " MB" << endl;
+	return 0;
+}
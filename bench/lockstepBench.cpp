@@ -0,0 +1,128 @@
+// Aggregate throughput of N instances stepped in lockstep against N separate interpreters.
+// Target: at least 4x the separate interpreters' ins/sec on the synchronized ALU loop with AVX2.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "machine.h"
+#include "lockstep.h"
+
+using namespace std;
+
+// Same register-only loop as the decoder benchmark: every lane follows the same path.
+static const uint8_t AluLoop[] = {
+	0x60, 0x05, // 200: LD V0, 5
+	0x61, 0x03, // 202: LD V1, 3
+	0x70, 0x01, // 204: ADD V0, 1
+	0x80, 0x14, // 206: ADD V0, V1
+	0x82, 0x12, // 208: AND V2, V1
+	0x83, 0x03, // 20A: XOR V3, V0
+	0x84, 0x06, // 20C: SHR V4
+	0x30, 0x00, // 20E: SE V0, 0
+	0xA3, 0x00, // 210: LD I, 300
+	0xF1, 0x1E, // 212: ADD I, V1
+	0x45, 0x00, // 214: SNE V5, 0
+	0x12, 0x04, // 216: JMP 204
+};
+
+// Lanes branch on their keypad, so they split into a few groups that stay apart.
+static const uint8_t KeyedLoop[] = {
+	0x60, 0x00, // 200: LD V0, 0
+	0x61, 0x01, // 202: LD V1, 1
+	0x62, 0x02, // 204: LD V2, 2
+	0x70, 0x01, // 206: ADD V0, 1
+	0xE1, 0x9E, // 208: SKP V1
+	0x12, 0x10, // 20A: JMP 210
+	0x80, 0x24, // 20C: ADD V0, V2
+	0x80, 0x06, // 20E: SHR V0
+	0xE2, 0xA1, // 210: SKNP V2
+	0x83, 0x04, // 212: ADD V3, V0
+	0x12, 0x06, // 214: JMP 206
+};
+
+struct Workload
+{
+	const char *Name;
+	const uint8_t *Program;
+	uint Size;
+};
+
+static double Seconds(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static uint16_t KeysFor(uint lane)
+{
+	return (lane & 3) << 1; // keys 1 and 2 in four combinations.
+}
+
+int main(int argc, char *argv[])
+{
+	const uint lanes = argc > 1 ? stoul(argv[1]) : 1024;
+	const uint64_t cycles = argc > 2 ? stoull(argv[2]) : 20000;
+	const Workload workloads[] = {
+		{"alu", AluLoop, sizeof(AluLoop)},
+		{"keyed", KeyedLoop, sizeof(KeyedLoop)},
+	};
+
+	cout << "lanes: " << lanes << ", cycles: " << cycles << "\n";
+	for (const Workload &workload : workloads)
+	{
+		vector<Machine> machines(lanes);
+		auto start = chrono::steady_clock::now();
+		for (uint lane = 0; lane < lanes; lane++)
+		{
+			machines[lane].LoadProgram(workload.Program, workload.Size);
+			machines[lane].SetKeys(KeysFor(lane));
+			machines[lane].Step(cycles);
+		}
+		const double separateSeconds = Seconds(start);
+
+		LockstepMachines scalar(lanes, workload.Program, workload.Size);
+		LockstepMachines vector(lanes, workload.Program, workload.Size);
+		scalar.SetVectorized(false);
+		for (uint lane = 0; lane < lanes; lane++)
+		{
+			scalar.SetKeys(lane, KeysFor(lane));
+			vector.SetKeys(lane, KeysFor(lane));
+		}
+
+		start = chrono::steady_clock::now();
+		scalar.Step(cycles);
+		const double scalarSeconds = Seconds(start);
+		start = chrono::steady_clock::now();
+		vector.Step(cycles);
+		const double vectorSeconds = Seconds(start);
+
+		for (uint lane = 0; lane < lanes; lane++)
+		{
+			const LockstepMachines *engines[] = {&scalar, &vector};
+			for (const LockstepMachines *engine : engines)
+			{
+				bool same = engine->GetProgramCounter(lane) == machines[lane].GetProgramCounter() &&
+							engine->GetIndexRegister(lane) == machines[lane].GetIndexRegister();
+				for (uint index = 0; index < 16; index++)
+					same = same && engine->GetRegister(lane, index) == machines[lane].GetRegisters()[index];
+				if (!same)
+				{
+					cerr << workload.Name << ": lane " << lane << " diverged from its Machine!" << endl;
+					return 1;
+				}
+			}
+		}
+
+		const double total = (double)lanes * cycles;
+		const LockstepStats &stats = vector.GetStats();
+		cout << "\n"
+			 << workload.Name << "\n";
+		cout << "  separate ins/sec: " << (uint64_t)(total / separateSeconds) << "\n";
+		cout << "  soa ins/sec:      " << (uint64_t)(total / scalarSeconds) << "\n";
+		cout << "  simd ins/sec:     " << (uint64_t)(total / vectorSeconds) << (vector.IsVectorized() ? "" : " (no AVX2)") << "\n";
+		cout << "  simd speedup:     " << separateSeconds / vectorSeconds << "x\n";
+		cout << "  groups/cycle:     " << (double)stats.Groups / stats.Cycles << "\n";
+		cout << "  vector share:     " << (double)stats.VectorInstructions / total << endl;
+	}
+	return 0;
+}
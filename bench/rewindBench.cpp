@@ -0,0 +1,80 @@
+// Cost of taking a rewind snapshot every frame, and how much history a byte budget holds.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "machine.h"
+#include "rewindBuffer.h"
+
+using namespace std;
+
+// Writes a BCD and two registers into page 3 and draws every few instructions, like a game's score.
+static const uint8_t ScoreLoop[] = {
+	0xA3, 0x00, // 200: LD I, 300
+	0x70, 0x01, // 202: ADD V0, 1
+	0xF0, 0x33, // 204: LD B, V0
+	0xD1, 0x25, // 206: DRW V1, V2, 5
+	0x71, 0x03, // 208: ADD V1, 3
+	0xF1, 0x55, // 20A: LD [I], V1
+	0x12, 0x00, // 20C: JMP 200
+};
+
+int main(int argc, char *argv[])
+{
+	const uint64_t frames = argc > 1 ? stoull(argv[1]) : 20000;
+	const size_t megabytes = argc > 2 ? stoull(argv[2]) : 16;
+
+	Machine machine;
+	if (argc > 3)
+		machine.LoadRom(argv[3]);
+	else
+		machine.LoadProgram(ScoreLoop, sizeof(ScoreLoop));
+
+	RewindBuffer rewind(megabytes << 20);
+	vector<MachineState> expected;
+	expected.reserve(frames);
+	double pushSeconds = 0;
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		machine.RunFrames(1);
+		expected.push_back(machine.GetState());
+		const auto start = chrono::steady_clock::now();
+		rewind.Push(machine);
+		pushSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	auto start = chrono::steady_clock::now();
+	MachineState copy;
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		copy = machine.GetState();
+		asm volatile("" : : "r"(&copy) : "memory");
+	}
+	const double copySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	const size_t held = rewind.GetCount();
+	const double bytesPerSnapshot = (double)rewind.GetBytesUsed() / held;
+	start = chrono::steady_clock::now();
+	for (size_t back = 0; back < held; back++)
+	{
+		if (!rewind.Rewind(machine) || memcmp(&machine.GetState(), &expected[frames - 1 - back], sizeof(MachineState)) != 0)
+		{
+			cerr << "Rewinding " << back + 1 << " frames did not restore the recorded state!" << endl;
+			return 1;
+		}
+	}
+	const double rewindSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	const RewindStats &stats = rewind.GetStats();
+	cout << "frames:              " << frames << "\n";
+	cout << "push ns/frame:       " << (uint64_t)(pushSeconds * 1e9 / frames) << "\n";
+	cout << "full copy ns:        " << (uint64_t)(copySeconds * 1e9 / frames) << "\n";
+	cout << "rewind ns/frame:     " << (uint64_t)(rewindSeconds * 1e9 / held) << "\n";
+	cout << "bytes/snapshot:      " << (uint64_t)bytesPerSnapshot << " (keyframe " << sizeof(MachineState) << ")\n";
+	cout << "pages/delta:         " << (double)stats.PagesStored / stats.Deltas << "\n";
+	cout << "held:                " << held << " snapshots\n";
+	cout << "budget holds:        " << (megabytes << 20) / bytesPerSnapshot / 3600 << " minutes at 60/s in " << megabytes << " MB" << endl;
+	return 0;
+}
@@ -0,0 +1,392 @@
+// Fixed set of headless workloads reported as JSON, for tracking the interpreter, DRW_XYN and display
+// conversion costs across changes.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "machine.h"
+#include "jit.h"
+#include "movie.h"
+
+using namespace std;
+
+#define PIXEL_ON 0xFFFFFFFF
+#define PIXEL_OFF 0xFF000000
+#define PIXEL_PLANE2 0xFFFF6600
+#define PIXEL_BOTH 0xFF662200
+
+static const uint32_t Palette[4] = {PIXEL_OFF, PIXEL_ON, PIXEL_PLANE2, PIXEL_BOTH};
+
+// Register-only loop touching every ALU group, a skip, ANNN and FX1E.
+static const uint8_t AluLoop[] = {
+	0x60, 0x05, // 200: LD V0, 5
+	0x61, 0x03, // 202: LD V1, 3
+	0x70, 0x01, // 204: ADD V0, 1
+	0x80, 0x14, // 206: ADD V0, V1
+	0x82, 0x12, // 208: AND V2, V1
+	0x83, 0x03, // 20A: XOR V3, V0
+	0x84, 0x06, // 20C: SHR V4
+	0x85, 0x0E, // 20E: SHL V5
+	0x86, 0x15, // 210: SUB V6, V1
+	0x30, 0x00, // 212: SE V0, 0
+	0xA3, 0x00, // 214: LD I, 300
+	0xF1, 0x1E, // 216: ADD I, V1
+	0x12, 0x04, // 218: JMP 204
+};
+
+// Two 15-row sprites per iteration walking over the screen, wrapping at both edges.
+static const uint8_t DrawLoop[] = {
+	0xA2, 0x14, // 200: LD I, 214
+	0xD0, 0x1F, // 202: DRW V0, V1, 15
+	0x70, 0x05, // 204: ADD V0, 5
+	0x71, 0x03, // 206: ADD V1, 3
+	0xD1, 0x0F, // 208: DRW V1, V0, 15
+	0x70, 0x07, // 20A: ADD V0, 7
+	0x30, 0x00, // 20C: SE V0, 0
+	0x12, 0x02, // 20E: JMP 202
+	0x00, 0xE0, // 210: CLS
+	0x12, 0x02, // 212: JMP 202
+	0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, 0x3C, 0x42, 0x99, 0xA5, 0x99, 0x42, 0x3C, // 214: sprite
+};
+
+// Recursion 15 calls deep, then all the way back.
+static const uint8_t CallLoop[] = {
+	0x60, 0x00, // 200: LD V0, 0
+	0x22, 0x06, // 202: CALL 206
+	0x12, 0x00, // 204: JMP 200
+	0x70, 0x01, // 206: ADD V0, 1
+	0x30, 0x0F, // 208: SE V0, 15
+	0x22, 0x06, // 20A: CALL 206
+	0x00, 0xEE, // 20C: RET
+};
+
+// BCD of a counter, then all 16 registers stored and loaded back.
+static const uint8_t MemoryLoop[] = {
+	0xA3, 0x00, // 200: LD I, 300
+	0xF3, 0x33, // 202: LD B, V3
+	0xA3, 0x10, // 204: LD I, 310
+	0xFF, 0x55, // 206: LD [I], VF
+	0xA3, 0x10, // 208: LD I, 310
+	0xFF, 0x65, // 20A: LD VF, [I]
+	0x73, 0x01, // 20C: ADD V3, 1
+	0x12, 0x00, // 20E: JMP 200
+};
+
+// SUPER-CHIP hi-res: a 16x16 sprite per iteration, and the screen scrolled down, right and left.
+static const uint8_t ScrollLoop[] = {
+	0x00, 0xFF, // 200: HIGH
+	0xA2, 0x12, // 202: LD I, 212
+	0xD0, 0x10, // 204: DRW V0, V1, 0
+	0x00, 0xC1, // 206: SCD 1
+	0x00, 0xFB, // 208: SCR
+	0x00, 0xFC, // 20A: SCL
+	0x70, 0x0B, // 20C: ADD V0, 11
+	0x71, 0x05, // 20E: ADD V1, 5
+	0x12, 0x04, // 210: JMP 204
+	0xFF, 0xFF, 0x80, 0x01, 0xBF, 0xFD, 0xA0, 0x05, 0xAF, 0xF5, 0xA8, 0x15, 0xAB, 0xD5, 0xAA, 0x55, // 212: sprite
+	0xAA, 0x55, 0xAB, 0xD5, 0xA8, 0x15, 0xAF, 0xF5, 0xA0, 0x05, 0xBF, 0xFD, 0x80, 0x01, 0xFF, 0xFF,
+};
+
+// XO-CHIP: a sprite on both planes, a scroll up, and all registers stored and loaded past 4 KB.
+static const uint8_t PlanesLoop[] = {
+	0xF3, 0x01,				// 200: PLANE 3
+	0xF0, 0x00, 0x02, 0x18, // 202: LD I, long 218
+	0xD0, 0x14,				// 206: DRW V0, V1, 4
+	0x00, 0xD1,				// 208: SCU 1
+	0xF0, 0x00, 0x10, 0x00, // 20A: LD I, long 1000
+	0x50, 0xE2,				// 20E: LD [I], V0-VE
+	0x50, 0xE3,				// 210: LD V0-VE, [I]
+	0x70, 0x05,				// 212: ADD V0, 5
+	0x71, 0x03,				// 214: ADD V1, 3
+	0x12, 0x02,				// 216: JMP 202
+	0x3C, 0x42, 0x81, 0xFF, 0xFF, 0x81, 0x42, 0x3C, // 218: sprite, one per plane
+};
+
+struct Workload
+{
+	string Name;
+	vector<uint8_t> Program; // empty for a rom file.
+	string RomPath;
+	QuirkProfile Quirks = QuirkProfile::Default;
+};
+
+struct Result
+{
+	uint64_t Instructions = 0;
+	double CpuSeconds = 0;
+	double DisplaySeconds = 0;
+	uint64_t Draws = 0;
+	uint64_t StateHash = 0;
+	bool BlockedOnKey = false;
+};
+
+// Both for the whole process so far, not for one workload.
+static long ResidentBytes()
+{
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static long PeakResidentBytes()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024;
+}
+
+static void Load(Machine &machine, const Workload &workload)
+{
+	machine.SetQuirks(workload.Quirks);
+	machine.ResetMachine();
+	machine.SeedRandom(1);
+	if (workload.Program.empty())
+		machine.LoadRom(workload.RomPath);
+	else machine.LoadProgram(workload.Program.data(), workload.Program.size());
+}
+
+// The dirty rows of a frame expanded to pixels, as SdlFrontend::UpdateDisplay does before the upload.
+static void ConvertRows(Machine &machine, uint32_t *pixels)
+{
+	static const uint64_t blank[DISPLAY_HIRES_HEIGHT] = {};
+	const uint64_t rows = machine.ConsumeDirtyRows();
+	const XoChipState *xo = machine.GetXoChipState();
+	const uint64_t *halves[] = {machine.GetDisplay(), machine.GetDisplayRight()};
+	const uint64_t *planeHalves[] = {xo ? xo->bPlane : blank, xo ? xo->bPlaneRight : blank};
+	const int width = machine.GetDisplayWidth();
+	for (int i = 0; i < (int)machine.GetDisplayHeight(); i++)
+	{
+		if ((rows >> i & 1) == 0)
+			continue;
+		for (int half = 0; half < width / DISPLAY_ARRAY_WIDTH; half++)
+		{
+			uint32_t *line = pixels + i * width + half * DISPLAY_ARRAY_WIDTH;
+			const uint64_t first = halves[half][i], second = planeHalves[half][i];
+			for (int j = 0; j < DISPLAY_ARRAY_WIDTH; j++)
+			{
+				const int bit = DISPLAY_ARRAY_WIDTH - 1 - j;
+				line[j] = Palette[(first >> bit & 1) | (second >> bit & 1) << 1];
+			}
+		}
+	}
+}
+
+// Draws are counted on a separate interpreter pass, so the timed run pays nothing for them.
+static uint64_t CountDraws(const Workload &workload, uint64_t frames, uint instructionsPerFrame)
+{
+	Machine machine;
+	Load(machine, workload);
+	uint64_t draws = 0;
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		for (uint i = 0; i < instructionsPerFrame && !machine.IsWaitingForKey() && !machine.HasExited(); i++)
+		{
+			draws += (as_const(machine).GetMemory()[machine.GetProgramCounter()] & 0xF0) == 0xD0; // the const one flushes nothing.
+			machine.Step();
+		}
+		machine.TickTimers();
+	}
+	return draws;
+}
+
+static Result Run(const Workload &workload, Engine engine, uint64_t frames, uint instructionsPerFrame)
+{
+	Machine machine;
+	machine.SetEngine(engine);
+	Load(machine, workload);
+
+	Result result;
+	uint32_t pixels[DISPLAY_HIRES_WIDTH * DISPLAY_HIRES_HEIGHT];
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		const auto start = chrono::steady_clock::now();
+		result.Instructions += machine.Step(instructionsPerFrame);
+		machine.TickTimers();
+		const auto ran = chrono::steady_clock::now();
+		ConvertRows(machine, pixels);
+		result.CpuSeconds += chrono::duration<double>(ran - start).count();
+		result.DisplaySeconds += chrono::duration<double>(chrono::steady_clock::now() - ran).count();
+	}
+
+	result.Draws = CountDraws(workload, frames, instructionsPerFrame);
+	result.StateHash = Movie::HashState(machine);
+	result.BlockedOnKey = machine.IsWaitingForKey();
+	return result;
+}
+
+static string Escape(const string &text)
+{
+	string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if ((unsigned char)c >= 0x20)
+			escaped += c;
+	}
+	return escaped;
+}
+
+static const char *EngineName(Engine engine)
+{
+	switch (engine)
+	{
+	case Engine::Cached:
+		return "cached";
+	case Engine::Jit:
+		return "jit";
+	case Engine::JitChecked:
+		return "jit-checked";
+	case Engine::Aot:
+		return "aot";
+	default:
+		return "interpreter";
+	}
+}
+
+static void PrintUsage()
+{
+	cerr << "Usage: chip8_bench [--frames N] [--ipf N] [--engine interpreter|cached|jit|jit-checked|all] [--roms dir] [--output file.json]\n";
+	cerr << "Runs the synthetic workloads and every .ch8/.c8 rom in dir (default ../roms) headless and writes JSON results." << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t frames = 600;
+	uint instructionsPerFrame = 10000;
+	vector<Engine> engines = {Engine::Interpreter};
+	string romDir = "../roms";
+	string outputPath = "";
+
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc)
+			frames = stoull(argv[++i]);
+		else if (arg == "--ipf" && i + 1 < argc)
+			instructionsPerFrame = stoul(argv[++i]);
+		else if (arg == "--roms" && i + 1 < argc)
+			romDir = argv[++i];
+		else if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (arg == "--engine" && i + 1 < argc)
+		{
+			const string name = argv[++i];
+			Engine engine;
+			if (name == "all")
+			{
+				engines = {Engine::Interpreter, Engine::Cached};
+				if (JitCompiler::IsSupported())
+					engines.push_back(Engine::Jit);
+			}
+			else if (EngineFromName(name, engine))
+				engines = {engine};
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (frames == 0 || instructionsPerFrame == 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	vector<Workload> workloads = {
+		{"alu", vector<uint8_t>(AluLoop, AluLoop + sizeof(AluLoop)), ""},
+		{"draw", vector<uint8_t>(DrawLoop, DrawLoop + sizeof(DrawLoop)), ""},
+		{"call", vector<uint8_t>(CallLoop, CallLoop + sizeof(CallLoop)), ""},
+		{"memory", vector<uint8_t>(MemoryLoop, MemoryLoop + sizeof(MemoryLoop)), ""},
+		{"scroll", vector<uint8_t>(ScrollLoop, ScrollLoop + sizeof(ScrollLoop)), ""},
+		{"planes", vector<uint8_t>(PlanesLoop, PlanesLoop + sizeof(PlanesLoop)), "", QuirkProfile::XoChip},
+	};
+	vector<string> roms;
+	if (filesystem::is_directory(romDir))
+		for (const filesystem::directory_entry &entry : filesystem::directory_iterator(romDir))
+			if (entry.is_regular_file() && IsRomFileName(entry.path().string()))
+				roms.push_back(entry.path().string());
+	sort(roms.begin(), roms.end());
+	for (const string &rom : roms)
+		workloads.push_back({filesystem::path(rom).filename().string(), {}, rom});
+
+	ostringstream json;
+	json << "{\n";
+	json << "  \"frames\": " << frames << ",\n";
+	json << "  \"instructions_per_frame\": " << instructionsPerFrame << ",\n";
+	json << "  \"machine_state_bytes\": " << sizeof(MachineState) << ",\n";
+	json << "  \"machine_bytes\": " << sizeof(Machine) << ",\n";
+	json << "  \"workloads\": [";
+
+	bool first = true;
+	for (const Workload &workload : workloads)
+	{
+		for (Engine engine : engines)
+		{
+			Result result;
+			string error = "";
+			try
+			{
+				result = Run(workload, engine, frames, instructionsPerFrame);
+			}
+			catch (const exception &exception)
+			{
+				error = exception.what();
+			}
+
+			json << (first ? "\n" : ",\n");
+			first = false;
+			json << "    {\"name\": \"" << Escape(workload.Name) << "\", \"engine\": \"" << EngineName(engine) << "\"";
+			if (!error.empty())
+			{
+				json << ", \"error\": \"" << Escape(error) << "\"}";
+				cerr << workload.Name << " (" << EngineName(engine) << "): " << error << endl;
+				continue;
+			}
+			const double seconds = result.CpuSeconds > 0 ? result.CpuSeconds : 1e-9;
+			json << ", \"instructions\": " << result.Instructions;
+			json << ", \"cpu_seconds\": " << result.CpuSeconds;
+			json << ", \"ins_per_sec\": " << (uint64_t)(result.Instructions / seconds);
+			json << ", \"ns_per_ins\": " << (result.Instructions ? seconds * 1e9 / result.Instructions : 0); // 0 for a rom that blocks at once.
+			json << ", \"draws\": " << result.Draws;
+			json << ", \"draws_per_sec\": " << (uint64_t)(result.Draws / seconds);
+			json << ", \"display_ns_per_frame\": " << result.DisplaySeconds * 1e9 / frames;
+			json << ", \"process_resident_bytes\": " << ResidentBytes();
+			json << ", \"process_peak_resident_bytes\": " << PeakResidentBytes();
+			json << ", \"blocked_on_key\": " << (result.BlockedOnKey ? "true" : "false");
+			json << ", \"state_hash\": \"" << hex << result.StateHash << dec << "\"}";
+			cerr << workload.Name << " (" << EngineName(engine) << "): " << (uint64_t)(result.Instructions / seconds) << " ins/sec" << endl;
+		}
+	}
+	json << "\n  ]\n}\n";
+
+	if (outputPath.empty())
+		cout << json.str();
+	else
+	{
+		ofstream output(outputPath);
+		output << json.str();
+		if (!output)
+		{
+			cerr << "Cannot write " << outputPath << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
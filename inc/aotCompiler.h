@@ -0,0 +1,48 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+// Translates a rom to C++ ahead of time. The control flow is recovered from 0x200 by following
+// fall-through, jumps, calls and both outcomes of every skip; each basic block reached becomes a
+// function calling the opcode handlers with its operands as constants, so nothing is fetched or
+// decoded at run time. BNNN ends a block with no known successor: its targets, and anything else
+// the walk did not reach, are left to the interpreter. XO-CHIP roms only run on the interpreter.
+class AotCompiler
+{
+public:
+	struct Block
+	{
+		uint16_t Start = 0;
+		uint16_t End = 0; // one past the last byte.
+		std::vector<uint16_t> Opcodes;
+	};
+
+private:
+	std::string name; // a C++ identifier.
+	QuirkProfile quirks;
+	std::vector<uint8_t> rom;
+	std::vector<Block> blocks;
+	uint indirectJumps = 0;
+
+	bool IsCode(uint address) const { return address >= 0x200 && address + 1 < 0x200 + rom.size(); }
+	uint16_t OpcodeAt(uint address) const { return rom[address - 0x200] << 8 | rom[address - 0x200 + 1]; }
+	void Recover();
+
+public:
+	// The handler call an opcode decodes to, e.g. "m.SE_XNN<VipQuirks>(3, 0x10)", or an empty
+	// string for an invalid opcode. Mirrors Machine::DecodeOpcode for the classic profiles.
+	static std::string CallFor(uint16_t opcode, const char *quirksType);
+
+	AotCompiler(const std::string &nameArg, const uint8_t *program, uint size, QuirkProfile profile);
+
+	// A source that registers the program when linked into an executable, see AotRegistration.
+	void Write(std::ostream &out) const;
+
+	const std::string &GetName() const { return name; }
+	const std::vector<Block> &GetBlocks() const { return blocks; }
+	uint GetIndirectJumps() const { return indirectJumps; }
+};
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+#include "machine.h"
+
+// A block chip8_aot compiled: Entry runs its instructions through the same opcode handlers the
+// interpreter calls and returns how many it ran, fewer than Length when a skip was taken.
+struct AotBlock
+{
+	uint16_t Start;
+	uint16_t End; // one past the last byte.
+	uint16_t Length;
+	uint (*Entry)(Machine &);
+};
+
+// A rom compiled ahead of time, see AotCompiler. Its blocks are checked against Rom, loaded at
+// 0x200, before they run.
+struct AotProgram
+{
+	const char *Name;
+	QuirkProfile Quirks;
+	const uint8_t *Rom;
+	uint RomSize;
+	const AotBlock *Blocks;
+	uint BlockCount;
+};
+
+// The generated code of each program: a specialization per program with one static function per
+// block. Machine befriends the template so the functions can call its opcode handlers.
+template <class Program>
+struct AotCode;
+
+// Adds a program to those every AotEngine chooses from. Generated sources register theirs during
+// static initialization, so they must be linked into the executable itself rather than through a
+// static library, whose unreferenced objects the linker leaves out.
+class AotRegistration
+{
+public:
+	explicit AotRegistration(const AotProgram &program);
+};
+
+const std::vector<const AotProgram *> &GetAotPrograms();
+
+struct AotStats
+{
+	const AotProgram *Program = nullptr; // matched to memory, null when none is.
+	uint64_t NativeInstructions = 0;
+	uint64_t InterpretedInstructions = 0;
+	uint64_t Invalidations = 0; // blocks written to, checked again before their next run.
+	uint64_t StaleBlocks = 0;	// found changed by such a check, interpreted from then on.
+};
+
+// Runs the blocks of the registered program that matches the machine's memory. Code the
+// recompiler never reached, such as the targets of BNNN, and blocks whose bytes no longer match
+// the rom are left to the interpreter.
+class AotEngine
+{
+	enum BlockState : uint8_t
+	{
+		BlockUnchecked,
+		BlockValid,
+		BlockStale,
+	};
+
+	const Machine &Chip8;
+
+	const AotProgram *program = nullptr;
+	bool selectPending = true;
+	std::vector<uint8_t> states; // BlockState per block of program.
+	int blockAt[MEMORY_SIZE];
+	bool covered[MEMORY_SIZE];
+	uint codeBegin = 0, codeEnd = 0; // bounds of the covered bytes.
+
+	AotStats stats;
+
+	void Select();
+	bool Matches(const AotProgram &candidate, const AotBlock &block) const;
+
+public:
+	AotEngine(const Machine &machine);
+
+	const AotBlock *Lookup(uint16_t address)
+	{
+		if (selectPending)
+			Select();
+		const int index = blockAt[address];
+		if (index < 0)
+			return nullptr;
+		if (states[index] == BlockUnchecked)
+		{
+			states[index] = Matches(*program, program->Blocks[index]) ? BlockValid : BlockStale;
+			stats.StaleBlocks += states[index] == BlockStale;
+		}
+		return states[index] == BlockValid ? &program->Blocks[index] : nullptr;
+	}
+	void Invalidate(uint address, uint length);
+	void Flush();
+
+	const AotStats &GetStats() const { return stats; }
+	void CountNative(uint length) { stats.NativeInstructions += length; }
+	void CountInterpreted() { stats.InterpretedInstructions++; }
+};
\ No newline at end of file
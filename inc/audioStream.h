@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "frameScheduler.h"
+#include "machine.h"
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_SAMPLES_PER_FRAME (AUDIO_SAMPLE_RATE / FRAME_RATE)
+#define AUDIO_AMPLITUDE 6000
+#define AUDIO_PATTERN_RATE 4000.0	// pattern bits a second at XO_DEFAULT_PITCH, as in Octo.
+#define AUDIO_CLASSIC_PATTERN 0xF0	// every byte of the classic buzzer: a 500 Hz square wave.
+#define AUDIO_RING_FRAMES 64		// a power of two; frames pushed into a full ring are dropped.
+#define AUDIO_MIN_QUEUE_FRAMES 2	// frames queued before the callback starts playing...
+#define AUDIO_MAX_QUEUE_FRAMES 8	// ...one more after every underrun, up to this...
+#define AUDIO_TARGET_DECAY_FRAMES 600 // ...and one less after this many frames without one.
+#define AUDIO_DRIFT_FRAMES 4		// queued past the target before the callback skips the oldest.
+#define AUDIO_MIN_STRETCH 0.5		// a frame plays for this...
+#define AUDIO_MAX_STRETCH 2.0		// ...to this many AUDIO_SAMPLES_PER_FRAME, by how full the queue is.
+#define AUDIO_FILL_SMOOTHING 8		// frames over which the queue fill is averaged.
+
+// The sound of one emulated frame.
+struct SoundFrame
+{
+	uint8_t Pattern[XO_AUDIO_PATTERN_SIZE]; // 128 one-bit samples played in a loop, first bit first.
+	uint8_t Pitch;
+	bool On;
+	int64_t Pushed; // steady_clock ticks.
+};
+
+// Read after the frame's timer tick: as in Octo, a sound timer of 1 makes no sound.
+SoundFrame MakeSoundFrame(const Machine &machine);
+
+// Renders frames to signed 16-bit mono samples. The pattern's phase carries over from one call
+// to the next, so a tone spanning frames has no seams.
+class ToneGenerator
+{
+	double position = 0; // in pattern bits.
+
+public:
+	void Render(const SoundFrame &frame, int16_t *samples, uint count);
+};
+
+// Lock-free ring between one producer and one consumer. Each side writes only its own counter
+// and reads the other's; neither ever waits.
+class SoundRing
+{
+	SoundFrame frames[AUDIO_RING_FRAMES];
+	alignas(64) std::atomic<uint32_t> pushed{0};
+	alignas(64) std::atomic<uint32_t> popped{0};
+
+public:
+	SoundRing() = default;
+	SoundRing(const SoundRing &) = delete;
+	SoundRing &operator=(const SoundRing &) = delete;
+
+	// Producer: false when the ring is full.
+	bool Push(const SoundFrame &frame);
+	// Consumer:
+	bool Pop(SoundFrame &frame);
+	void Skip(uint32_t count); // at most GetQueued.
+	uint32_t GetQueued() const { return pushed.load(std::memory_order_acquire) - popped.load(std::memory_order_relaxed); }
+};
+
+// Measured by the callback; read once it has stopped.
+struct AudioStats
+{
+	uint64_t Callbacks = 0;
+	uint64_t FramesPlayed = 0;
+	uint64_t Underruns = 0;		// a frame was due and none was queued.
+	uint64_t FramesSkipped = 0; // behind an emulation running ahead.
+	uint QueueTarget = AUDIO_MIN_QUEUE_FRAMES;
+	double LatencySumMs = 0; // from a frame's push to the callback rendering its first sample.
+	double LatencyMaxMs = 0;
+	double CallbackSumUs = 0;
+	double CallbackMaxUs = 0;
+};
+
+// The emulation thread pushes a frame of sound per emulated frame, an audio callback renders
+// each as about AUDIO_SAMPLES_PER_FRAME samples. The callback keeps a target number of frames
+// queued: a frame plays longer while the queue runs below it and shorter above it, so the
+// queue settles for an emulation up to twice too slow or too fast. Otherwise an underrun
+// holds the last tone until the target is queued again and raises the target, and an emulation
+// far ahead (turbo) has its oldest frames skipped, so the delay does not grow. A target raised
+// by underruns comes back down once they stop.
+class AudioStream
+{
+	typedef std::chrono::steady_clock Clock;
+
+	SoundRing ring;
+	uint64_t framesDropped = 0; // producer's: pushed into a full ring.
+
+	// Callback:
+	ToneGenerator generator;
+	SoundFrame current = {};
+	uint samplesLeft = 0; // of current.
+	bool buffering = true;
+	double fill = AUDIO_MIN_QUEUE_FRAMES; // average frames queued.
+	uint64_t cleanFrames = 0; // played since the last underrun or target change.
+	AudioStats stats;
+
+	void NextFrame(Clock::rep now, uint offset);
+
+public:
+	AudioStream() = default;
+	AudioStream(const AudioStream &) = delete;
+	AudioStream &operator=(const AudioStream &) = delete;
+
+	// Emulation thread, after each frame:
+	void Push(const Machine &machine);
+	// Audio callback:
+	void Render(int16_t *samples, uint count);
+
+	const AudioStats &GetStats() const { return stats; }
+	uint64_t GetFramesDropped() const { return framesDropped; }
+	void PrintStats(uint deviceSamples) const; // plus the device buffer in the latency.
+};
+
+// 16-bit mono PCM at AUDIO_SAMPLE_RATE. The sizes in the header are written on Close.
+class WavWriter
+{
+	FILE *file;
+	uint64_t samples = 0;
+
+	void WriteHeader();
+
+public:
+	explicit WavWriter(const std::string &path);
+	~WavWriter();
+	WavWriter(const WavWriter &) = delete;
+	WavWriter &operator=(const WavWriter &) = delete;
+
+	void Write(const int16_t *data, uint count);
+	void Close();
+	uint64_t GetSampleCount() const { return samples; }
+};
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+#define MOVIE_EXTENSION ".c8m" // a script with it is a Movie, played instead of fed frame by frame.
+
+// One headless run: a rom, an optional input script and how many 60 Hz frames to run.
+struct BatchJob
+{
+	std::string RomPath;
+	std::string ScriptPath;
+	uint64_t Frames = 0;
+};
+
+struct BatchResult
+{
+	BatchJob Job;
+	uint64_t Instructions = 0;
+	uint64_t SkippedInstructions = 0;
+	double WallSeconds = 0;
+	uint64_t DisplayHash = 0;
+	std::string Error;
+};
+
+// Runs independent machines on a work-stealing thread pool. Each worker owns a queue and
+// takes jobs from its back; an idle worker steals from the front of the others.
+class BatchRunner
+{
+	uint threadCount;
+	Engine engine;
+	bool skipIdle;
+
+	static BatchResult RunJob(const BatchJob &job, Engine engine, bool skipIdle);
+
+public:
+	// Input script: "<frame> <hex keypad mask>" per line, the mask holds from that frame on.
+	typedef std::vector<std::pair<uint64_t, uint16_t>> InputScript;
+
+	BatchRunner(uint threadCountArg, Engine engineArg, bool skipIdleArg = false);
+	std::vector<BatchResult> Run(const std::vector<BatchJob> &jobs) const;
+
+	static std::vector<BatchJob> LoadManifest(const std::string &filePath);
+	static std::vector<BatchJob> JobsFromDirectory(const std::string &directory, uint64_t frames);
+	static InputScript LoadInputScript(const std::string &filePath);
+	static bool IsMovie(const std::string &scriptPath);
+	static uint64_t HashDisplay(const Machine &machine);
+	static void WriteCsv(std::ostream &out, const std::vector<BatchResult> &results);
+};
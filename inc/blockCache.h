@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include "machine.h"
+
+#define BLOCK_MAX_LENGTH 64
+
+struct BlockCacheStats
+{
+	uint64_t Hits = 0;
+	uint64_t Misses = 0;
+	uint64_t Invalidations = 0;
+};
+
+// Straight-line runs of pre-decoded instructions keyed by their start address in Memory.
+// A block ends after any instruction that can change the program counter other than by 2,
+// or that writes memory, so a write into cached code is seen before the next lookup.
+class BlockCache
+{
+public:
+	struct Block
+	{
+		uint16_t Start = 0;
+		uint16_t End = 0; // one past the last byte.
+		std::vector<const Instruction *> Code;
+	};
+
+private:
+	const Instruction *decodeTable;
+	const uint8_t *memory;
+
+	std::vector<Block> blocks;
+	std::vector<int> freeSlots;
+	int blockAt[MEMORY_SIZE];
+	bool covered[MEMORY_SIZE]; // byte belongs (or belonged) to a cached block.
+
+	BlockCacheStats stats;
+
+	int Build(uint16_t address);
+
+public:
+	static bool EndsBlock(uint16_t opcode);
+
+	BlockCache(const Instruction *decodeTableArg, const uint8_t *memoryArg);
+
+	const Block &Lookup(uint16_t address);
+	void Invalidate(uint address, uint length);
+	void Flush();
+
+	const BlockCacheStats &GetStats() const { return stats; }
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "machine.h"
+
+// The opcode family, e.g. "8XY4 ADD Vx, Vy", or "invalid"; a static string, for grouping counts.
+const char *OpcodePattern(uint16_t opcode);
+// The instruction with its operands, e.g. "ADD V3, V4".
+std::string Disassemble(uint16_t opcode);
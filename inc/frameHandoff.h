@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+
+#include "machine.h"
+
+// One finished frame as the emulation thread hands it to the presenting thread.
+struct HandoffFrame
+{
+	uint64_t Rows[DISPLAY_HIRES_HEIGHT];	   // Machine::GetDisplay, of which lo-res uses the first DISPLAY_ARRAY_HEIGHT.
+	uint64_t RightRows[DISPLAY_HIRES_HEIGHT]; // Machine::GetDisplayRight, in hi-res.
+	uint64_t PlaneRows[DISPLAY_HIRES_HEIGHT];	  // XoChipState::bPlane, with TwoPlanes.
+	uint64_t PlaneRightRows[DISPLAY_HIRES_HEIGHT]; // XoChipState::bPlaneRight, with TwoPlanes in hi-res.
+	bool HiRes = false;
+	bool TwoPlanes = false;
+	uint64_t Frame = 0;
+	uint32_t InputSequence = 0; // of the key state the frame was run with.
+};
+
+// Lock-free triple buffer between one producer and one consumer. The producer fills the back
+// slot and swaps it with the middle one; the consumer swaps the middle one into the front
+// when it is newer. Neither side ever waits, and frames the consumer is too slow for are
+// overwritten, so it always gets the latest.
+class FrameHandoff
+{
+	static constexpr uint8_t FreshBit = 4; // set in middle while it holds an unread frame.
+
+	alignas(64) HandoffFrame slots[3];
+	alignas(64) std::atomic<uint8_t> middle{2};
+	alignas(64) uint8_t back = 0; // producer's slot.
+	alignas(64) uint8_t front = 1; // consumer's slot.
+
+public:
+	FrameHandoff() = default;
+	FrameHandoff(const FrameHandoff &) = delete;
+	FrameHandoff &operator=(const FrameHandoff &) = delete;
+
+	// Producer:
+	HandoffFrame &GetBackFrame() { return slots[back]; }
+	void Publish();
+
+	// Consumer: true when a frame newer than the front one was taken.
+	bool Acquire();
+	const HandoffFrame &GetFrontFrame() const { return slots[front]; }
+};
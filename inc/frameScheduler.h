@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+
+#include "machine.h"
+
+#define FRAME_RATE 60
+#define FRAME_SPIN_MICROS 500 // the end of a wait is spun instead of slept, below the OS sleep granularity.
+#define FRAME_MAX_LAG 5		  // frames behind after which the schedule restarts instead of catching up.
+#define FRAME_ALIGN_DAMPING 4 // after the first AlignTo, the schedule moves this fraction of the phase error per call.
+
+// Frame timing measured by a FrameScheduler.
+struct SchedulerStats
+{
+	uint64_t Frames = 0;
+	uint64_t Instructions = 0;
+	uint64_t Resyncs = 0;	  // times the schedule was dropped after falling FRAME_MAX_LAG frames behind.
+	double WallSeconds = 0;
+	double LatenessSumMs = 0; // frame start after its deadline.
+	double LatenessMaxMs = 0;
+	double PeriodSumMs = 0;	  // between consecutive frame starts.
+	double PeriodSquareSumMs = 0;
+};
+
+// Paces a loop to FRAME_RATE frames a second: the caller runs a frame's instructions in
+// one burst, ticks the timers and presents once, then calls EndFrame, which sleeps until the
+// next deadline. Deadlines are absolute (start + n frames), so sleep overshoot does not
+// accumulate into drift. In turbo mode EndFrame never waits.
+class FrameScheduler
+{
+	typedef std::chrono::steady_clock Clock;
+
+	uint instructionsPerFrame;
+	bool turbo;
+	Clock::duration framePeriod;
+	Clock::time_point start;
+	Clock::time_point deadline;
+	Clock::time_point lastFrameStart;
+	bool aligned = false;
+	SchedulerStats stats;
+
+	void WaitUntil(Clock::time_point time) const;
+
+public:
+	FrameScheduler(uint instructionsPerFrameArg = Machine::insPerTimer, bool turboArg = false);
+
+	uint GetInstructionsPerFrame() const { return instructionsPerFrame; }
+	bool IsTurbo() const { return turbo; }
+	void SetTurbo(bool turboArg);
+	// When the running frame ends: its deadline, or in turbo a frame period after it started.
+	std::chrono::steady_clock::time_point GetFrameEnd() const { return turbo ? lastFrameStart + framePeriod : deadline; }
+
+	void Restart();
+	// Records a frame and waits for the next deadline.
+	void EndFrame();
+
+	// One frame on a machine: the burst, counted into the stats, then one timer tick.
+	void RunFrame(Machine &machine);
+	// Shifts the schedule a step toward deadlines that fall lead before reference plus a whole
+	// number of frames, e.g. just ahead of the vblanks of a display refreshing at FRAME_RATE.
+	void AlignTo(Clock::time_point reference, Clock::duration lead);
+
+	const SchedulerStats &GetStats() const { return stats; }
+	double GetInstructionsPerSecond() const;
+	double GetJitterMs() const; // standard deviation of the frame period.
+	void PrintStats() const;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "machine.h"
+
+#define JIT_HOT_THRESHOLD 8
+#define JIT_CODE_BUFFER_SIZE (1 << 20)
+
+struct JitStats
+{
+	uint64_t BlocksCompiled = 0;
+	uint64_t NativeInstructions = 0;
+	uint64_t InterpretedInstructions = 0;
+	uint64_t Invalidations = 0;
+	uint64_t Flushes = 0;
+};
+
+// Translates hot basic blocks to x86-64. V0-VF, I and PC stay in the Machine and are
+// addressed through pinned host registers; everything that touches the display, keys,
+// timers, the stack or memory calls the interpreter handler instead.
+class JitCompiler
+{
+public:
+	typedef void (*NativeCode)(Machine *);
+
+	struct Block
+	{
+		NativeCode Entry = nullptr;
+		uint16_t Start = 0;
+		uint16_t End = 0; // one past the last byte.
+		uint Length = 0;
+	};
+
+	static bool IsSupported();
+
+private:
+	Machine &Chip8;
+
+	uint8_t *codeBuffer = nullptr;
+	uint codeUsed = 0;
+	std::vector<uint8_t> code; // block being assembled.
+
+	std::vector<Block> blocks;
+	int blockAt[MEMORY_SIZE];
+	uint8_t heat[MEMORY_SIZE];
+	bool covered[MEMORY_SIZE];
+
+	JitStats stats;
+	std::exception_ptr pendingError;
+
+	static bool CallHandler(Machine *machine, const Instruction *ins) noexcept;
+
+	bool Compile(uint16_t address);
+	void Translate(uint16_t address, const Instruction &ins);
+	void EmitHelperCall(uint16_t address, const Instruction &ins);
+	void EmitSetProgramCounter(uint16_t value);
+	void EmitSkip(uint16_t address, bool skipIfEqual);
+	void EmitPrologue();
+	void EmitEpilogue();
+
+	void Emit8(uint8_t value);
+	void Emit16(uint16_t value);
+	void Emit32(uint32_t value);
+	void Emit64(uint64_t value);
+	void EmitRegister(uint8_t opcode, uint8_t reg, uint8_t index);
+
+public:
+	JitCompiler(Machine &machine);
+	~JitCompiler();
+
+	const Block *Lookup(uint16_t address);
+	void Invalidate(uint address, uint length);
+	void Flush();
+
+	const JitStats &GetStats() const { return stats; }
+	void RethrowPendingError();
+	void CountNative(uint length) { stats.NativeInstructions += length; }
+	void CountInterpreted() { stats.InterpretedInstructions++; }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+#define LOCKSTEP_LANE_ALIGN 32		  // one AVX2 register of byte lanes.
+#define LOCKSTEP_MAX_GROUPS 32		  // more PC groups than this in a cycle and lanes step one by one...
+#define LOCKSTEP_REGROUP_INTERVAL 64 // ...for this many cycles before grouping is tried again.
+
+struct LockstepStats
+{
+	uint64_t Cycles = 0;
+	uint64_t Groups = 0; // lanes sharing a PC, executed together.
+	uint64_t VectorInstructions = 0;
+	uint64_t ScalarInstructions = 0;
+	uint64_t DivergentCycles = 0;
+	uint64_t Faults = 0;
+};
+
+// One array per field, a lane per instance. The arrays are padded to a multiple of LOCKSTEP_LANE_ALIGN.
+struct LockstepLanes
+{
+	uint Count = 0; // padded.
+	uint8_t *V[16] = {};
+	uint16_t *PC = nullptr;
+	uint16_t *I = nullptr;
+	uint8_t *DT = nullptr;
+	uint8_t *ST = nullptr;
+	const uint16_t *Keys = nullptr;
+};
+
+// Select marks the lanes whose PC equals pc and which are not done yet in mask (0xFF) and done,
+// and returns how many it marked. Execute runs a vector opcode for the lanes marked in mask.
+struct LockstepKernels
+{
+	uint (*Select)(const uint16_t *pc, uint16_t value, uint8_t *done, uint8_t *mask, uint count);
+	void (*Execute)(const LockstepLanes &lanes, uint16_t opcode, const uint8_t *mask);
+};
+
+const LockstepKernels *GetAvx2LockstepKernels(); // nullptr without AVX2.
+bool IsLockstepVectorOpcode(uint16_t opcode);	 // only touches V, I, PC, the timers and reads the keys.
+
+// N instances of one rom stepped together. Each cycle every lane executes one instruction:
+// lanes are grouped by PC, and a group runs its opcode once, as a masked vector operation
+// over all lanes for the ALU, load, skip, key skip, jump and timer opcodes, or lane by lane for
+// the rest. A lane that faults stops, the others carry on. Lanes run classic CHIP-8 with the
+// default quirk profile: SUPER-CHIP opcodes fault.
+class LockstepMachines
+{
+	template <typename T>
+	class LaneArray
+	{
+		T *data = nullptr;
+
+	public:
+		LaneArray() = default;
+		LaneArray(const LaneArray &) = delete;
+		LaneArray &operator=(const LaneArray &) = delete;
+		~LaneArray();
+		void Allocate(size_t count);
+		T *Get() const { return data; }
+		T &operator[](size_t index) const { return data[index]; }
+	};
+
+	uint laneCount;
+	LockstepLanes lanes;
+
+	LaneArray<uint8_t> registers;
+	LaneArray<uint16_t> programCounters;
+	LaneArray<uint16_t> indexRegisters;
+	LaneArray<uint8_t> delayTimers;
+	LaneArray<uint8_t> soundTimers;
+	LaneArray<uint8_t> stackPointers;
+	LaneArray<uint16_t> stacks; // STACK_SIZE per lane.
+	LaneArray<uint16_t> keys;	// bit per key.
+	LaneArray<uint32_t> randomStates;
+	LaneArray<uint64_t> displays; // DISPLAY_ARRAY_HEIGHT rows per lane.
+	LaneArray<uint8_t> faulted;	  // 0xFF for faulted lanes and the padding.
+
+	// Lanes read one shared image until their first memory write gives them a private copy.
+	std::vector<uint8_t> sharedMemory;
+	std::vector<uint8_t *> memory;
+	std::vector<std::unique_ptr<uint8_t[]>> privateMemory;
+	std::vector<uint> privateLanes;
+
+	LaneArray<uint8_t> mask;
+	LaneArray<uint8_t> done;
+
+	const LockstepKernels *kernels;
+	uint divergentCycles = 0;
+	LockstepStats stats;
+
+	void Initialize(const uint8_t *image);
+	uint16_t Fetch(uint lane, uint16_t address) const { return memory[lane][address] << 8 | memory[lane][address + 1]; }
+	uint8_t *WritableMemory(uint lane);
+	void StepGrouped();
+	void StepEachLane();
+	void ExecuteScalar(uint lane, uint16_t opcode);
+	void Fault(uint lane);
+
+public:
+	LockstepMachines(uint count, const std::string &romPath);
+	LockstepMachines(uint count, const uint8_t *program, uint size);
+	~LockstepMachines();
+
+	void Step(uint64_t cycles = 1);
+	void RunFrames(uint64_t frames);
+	void TickTimers();
+	void SetVectorized(bool enabled); // false runs every group lane by lane, for comparison.
+	bool IsVectorized() const { return kernels != nullptr; }
+
+	uint GetLaneCount() const { return laneCount; }
+	void SetKeys(uint lane, uint16_t keyMask) { keys[lane] = keyMask; }
+	void SeedRandom(uint lane, uint32_t seed) { randomStates[lane] = seed | 1; }
+
+	uint8_t GetRegister(uint lane, uint index) const { return lanes.V[index][lane]; }
+	uint16_t GetProgramCounter(uint lane) const { return programCounters[lane]; }
+	uint16_t GetIndexRegister(uint lane) const { return indexRegisters[lane]; }
+	uint8_t GetDelayTimer(uint lane) const { return delayTimers[lane]; }
+	uint8_t GetSoundTimer(uint lane) const { return soundTimers[lane]; }
+	const uint64_t *GetDisplay(uint lane) const { return &displays[lane * DISPLAY_ARRAY_HEIGHT]; }
+	const uint8_t *GetMemory(uint lane) const { return memory[lane]; }
+	bool IsFaulted(uint lane) const { return faulted[lane] != 0; }
+	const LockstepStats &GetStats() const { return stats; }
+};
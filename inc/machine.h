@@ -2,9 +2,12 @@
 
 #pragma once
 
-#include <unordered_map>
-#include <SDL2/SDL.h>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
+
+#include "quirks.h"
 
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
@@ -12,49 +15,173 @@ typedef unsigned int uint;
 
 #define DISPLAY_ARRAY_WIDTH 64
 #define DISPLAY_ARRAY_HEIGHT 32
+#define DISPLAY_HIRES_WIDTH 128 // SUPER-CHIP hi-res mode, see Machine::IsHiRes.
+#define DISPLAY_HIRES_HEIGHT 64
 #define MEMORY_SIZE 4096
+#define XO_MEMORY_SIZE 0x10000 // XO-CHIP's address space, see XoChipState.
 #define REGISTERS_COUNT 17
 #define KEYBOARD_SIZE 16
 #define STACK_SIZE 16
 #define FONTS_ARRAY_SIZE 90
+#define BIG_FONTS_ADDRESS 0xA0 // the SUPER-CHIP 8x10 digits FX30 points at.
+#define BIG_FONTS_ARRAY_SIZE 160
+#define RPL_FLAGS_COUNT 16 // saved by FX75, loaded by FX85.
+#define XO_AUDIO_PATTERN_SIZE 16 // F002 loads 128 one-bit samples.
+#define XO_DEFAULT_PITCH 64		 // FX3A value of a 4000 Hz playback rate.
+
+static_assert(DISPLAY_ARRAY_WIDTH == 64, "A display row is stored as a single 64-bit word.");
+static_assert(DISPLAY_HIRES_WIDTH == 2 * DISPLAY_ARRAY_WIDTH, "A hi-res row is stored as two 64-bit words.");
+static_assert(DISPLAY_HIRES_HEIGHT <= 64, "Dirty display rows are tracked in a 64-bit mask.");
+static_assert(BIG_FONTS_ADDRESS >= FONTS_ARRAY_SIZE && BIG_FONTS_ADDRESS + BIG_FONTS_ARRAY_SIZE <= 0x200, "The fonts sit below the program.");
+
+#define ALL_ROWS_DIRTY ((1ull << DISPLAY_ARRAY_HEIGHT) - 1)
+#define ALL_HIRES_ROWS_DIRTY (~0ull)
+
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+#define ALL_PAGES_DIRTY ((uint16_t)((1u << MEMORY_PAGES) - 1))
+
+static_assert(MEMORY_PAGES <= 16, "Dirty memory pages are tracked in a 16-bit mask.");
 
 #define VF 0xF
+#define OPCODES_COUNT 0x10000
+
+class Machine;
+class BlockCache;
+struct BlockCacheStats;
+class JitCompiler;
+struct JitStats;
+class AotEngine;
+struct AotStats;
+template <class Program>
+struct AotCode;
+class Profiler;
+class TraceWriter;
+
+// How Step executes instructions.
+enum class Engine
+{
+	Interpreter, // fetch and decode every instruction through the decode table.
+	Cached,		 // run pre-decoded basic blocks from a BlockCache.
+	Jit,		 // run hot basic blocks as x86-64 code.
+	JitChecked,	 // Jit, and after every native block compare against an interpreter in lockstep.
+	Aot,		 // run the blocks chip8_aot compiled from the rom, see inc/aotEngine.h.
+};
+
+// "interpreter", "cached", "jit", "jit-checked" or "aot".
+bool EngineFromName(const std::string &name, Engine &engine);
+
+// A .ch8 or .c8 file name, in either case: what directory scans run, leaving manifests, input
+// scripts and notes beside the roms alone.
+bool IsRomFileName(const std::string &path);
+
+// Opcode with its operands already extracted, see Machine::DecodeOpcode.
+struct Instruction
+{
+	void (*Handler)(Machine &, const Instruction &);
+	uint16_t Opcode;
+	uint16_t NNN;
+	uint8_t X;
+	uint8_t Y;
+	uint8_t N;
+	uint8_t NN;
+};
+
+// Polling loops fast-forwarded by Machine::SetIdleSkip.
+struct IdleStats
+{
+	uint64_t Loops = 0;
+	uint64_t SkippedInstructions = 0;
+};
+
+#define IDLE_LOOP_MAX_LENGTH 8
+#define KEY_WAIT_NONE 0xFF
 
-class Machine
+// Totals reported by a headless run.
+struct RunStats
+{
+	uint64_t Instructions = 0;
+	double WallSeconds = 0;
+};
+
+// Everything the emulated CHIP-8 is, and nothing about how it is run: plain data that
+// can be copied, compared and allocated in bulk. The constant tables are shared statics.
+struct MachineState
 {
-	// Machine:
 	uint8_t Memory[MEMORY_SIZE];
 	uint8_t Registers[REGISTERS_COUNT];
+	uint8_t DelayTimer;
+	uint8_t SoundTimer; // the tone plays while it is above zero.
+	uint8_t keyWaitRegister; // X of the FX0A blocked on a key, KEY_WAIT_NONE while running.
+	uint8_t keyWaitKey;		 // key pressed during the wait, confirmed on its release.
 
-	int DelayTimer = 0;
-	const uint timersDeltaMicroS = 16670;
-	const uint insDeltaMicroS = 1667; // change this to change speed.
-	const uint insPerTimer = timersDeltaMicroS / insDeltaMicroS;
-
-	uint16_t IndexRegister = 0;
-	uint16_t ProgramCounter = 0x200;
-	uint16_t StackPointer = 0;
+	uint16_t IndexRegister;
+	uint16_t ProgramCounter;
+	uint16_t StackPointer;
 	uint16_t Stack[STACK_SIZE];
 
-	uint16_t currentOpcode;
+	uint32_t randomState;
 
 	// Display:
-	bool displayInitFlag = false;
-	uint scale = 1;
-	uint DisplayHeight = DISPLAY_ARRAY_HEIGHT;
-	uint DisplayWidth = DISPLAY_ARRAY_WIDTH;
-	SDL_Window *AppWindow = nullptr;
-	SDL_Renderer *Renderer = nullptr;
-	bool bDisplay[DISPLAY_ARRAY_HEIGHT][DISPLAY_ARRAY_WIDTH];
+	uint64_t bDisplay[DISPLAY_HIRES_HEIGHT]; // one word per row, column 0 is the most significant bit; lo-res uses the first DISPLAY_ARRAY_HEIGHT.
+	uint64_t bDisplayRight[DISPLAY_HIRES_HEIGHT]; // columns 64-127 of the hi-res rows.
+	uint64_t dirtyRows; // bit per display row changed since ConsumeDirtyRows.
+	bool hiRes;			// 00FF switched to 128x64, 00FE back.
+	bool exited;		// 00FD ran; Step returns at once until ResetMachine.
+
+	// SUPER-CHIP RPL user flags, kept by ResetMachine and persisted by SetRplFlagsFile.
+	uint8_t rplFlags[RPL_FLAGS_COUNT];
 
 	// Keyboard
-	SDL_Event Event;
-	bool Keys[KEYBOARD_SIZE];
+	uint16_t Keys; // bit per keypad key held.
+};
+
+static_assert(std::is_trivially_copyable<MachineState>::value, "MachineState is copied with memcpy.");
+
+// What an XO-CHIP machine holds beyond MachineState, kept apart so classic machines stay a few
+// KB. Memory replaces MachineState::Memory, which an XO-CHIP machine leaves unused; the first
+// plane stays bDisplay and bDisplayRight.
+struct XoChipState
+{
+	uint8_t Memory[XO_MEMORY_SIZE];
+	uint64_t bPlane[DISPLAY_HIRES_HEIGHT]; // the second bitplane, laid out as bDisplay.
+	uint64_t bPlaneRight[DISPLAY_HIRES_HEIGHT];
+	uint8_t Planes; // FN01 mask of the planes drawn, cleared and scrolled.
+	uint8_t AudioPattern[XO_AUDIO_PATTERN_SIZE];
+	uint8_t Pitch; // FX3A, the pattern plays at 4000 * 2^((Pitch - 64) / 48) bits a second.
+};
+
+static_assert(std::is_trivially_copyable<XoChipState>::value, "XoChipState is copied with memcpy.");
+
+class Machine : private MachineState
+{
+	friend class DecoderBench;
+	friend class JitCompiler;
+	template <class Program>
+	friend struct AotCode;
+
+	uint16_t currentOpcode;
+	const Instruction *decodeTable;
+
+	Engine engine = Engine::Interpreter;
+	std::unique_ptr<BlockCache> blockCache;
+	std::unique_ptr<JitCompiler> jit;
+	std::unique_ptr<Machine> shadow; // interpreter run in lockstep by Engine::JitChecked.
+	std::unique_ptr<AotEngine> aot;
+
+	uint16_t dirtyPages = ALL_PAGES_DIRTY; // bit per memory page written since ConsumeDirtyPages.
 
-	// Rest
-	bool quitFlag = false;
+	bool idleSkip = false;
+	IdleStats idleStats;
+	uint64_t instructionCount = 0; // executed by Step, idle-skipped ones included.
+	bool keyWaitOnRelease = false;
+	QuirkProfile quirks = QuirkProfile::Default;
+	std::string rplFlagsPath;
+	std::unique_ptr<XoChipState> xo; // under QuirkProfile::XoChip only.
+	Profiler *profiler = nullptr;
+	TraceWriter *tracer = nullptr;
 
-	const uint8_t Fonts[FONTS_ARRAY_SIZE] = {
+	static constexpr uint8_t Fonts[FONTS_ARRAY_SIZE] = {
 		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 		0x20, 0x60, 0x20, 0x20, 0x70, // 1
 		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -73,85 +200,247 @@ class Machine
 		0xF0, 0x80, 0xF0, 0x80, 0x80, // F
 	};
 
-	std::unordered_map<char, char> Keyboard{
-		{'1', '1'},
-		{'2', '2'},
-		{'3', '3'},
-		{'4', 'C'},
-		{'Q', '4'},
-		{'W', '5'},
-		{'E', '6'},
-		{'R', 'D'},
-		{'A', '7'},
-		{'S', '8'},
-		{'D', '9'},
-		{'F', 'E'},
-		{'Z', 'A'},
-		{'X', '0'},
-		{'C', 'B'},
-		{'V', 'F'},
+	static constexpr uint8_t BigFonts[BIG_FONTS_ARRAY_SIZE] = {
+		0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+		0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+		0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+		0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+		0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+		0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+		0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+		0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
 	};
 
 	// Methods
 	void LoadFonts();
-	void InitializeDispaly();
-	void UpdateDisplay();
-	void EndDisplay();
-	void ClearDisplay();
 
 	void HandleOpcode(uint16_t opcode);
-	void HandleInput();
-	void BeepFor(uint16_t val);
+	template <bool Traced, bool XoChip = false>
 	void EmulateIns();
-	void ClearDisplayMatrix();
+	// Each returns how many of count are left when it stops early on FX0A or 00FD.
+	template <bool Traced, bool XoChip = false>
+	uint64_t StepInterpreter(uint64_t count);
+	template <bool Traced>
+	uint64_t StepCached(uint64_t count);
+	uint64_t StepJit(uint64_t count);
+	uint64_t StepAot(uint64_t count);
+	void CompareWithShadow(uint16_t blockStart) const;
+	uint8_t NextRandom();
+	template <bool XoChip = false>
+	void SkipIdleLoop(uint64_t &count);
+	static bool IsPollingOpcode(uint16_t opcode);
+	void FinishKeyWait(uint key);
+	void OnMemoryWrite(uint address, uint length);
+	void ClearDisplayMatrix(uint64_t *left, uint64_t *right);
+	void SetHiRes(bool enabled);
+	uint64_t AllDisplayRows() const { return hiRes ? ALL_HIRES_ROWS_DIRTY : ALL_ROWS_DIRTY; }
+	// The address space of the profile: Memory, or the 64 KB of an XO-CHIP machine.
+	template <bool XoChip>
+	uint8_t *MemoryOf()
+	{
+		if constexpr (XoChip)
+			return xo->Memory;
+		else
+			return Memory;
+	}
+	uint8_t *AddressSpace() { return xo ? xo->Memory : Memory; }
+	uint AddressSpaceSize() const { return xo ? XO_MEMORY_SIZE : MEMORY_SIZE; }
+	template <class Quirks, class Apply>
+	void ForEachPlane(Apply apply);
+	template <class Quirks>
+	uint SkipLength() const;
+	template <class Quirks>
+	uint SpriteBytes(uint bytes) const;
+	template <class Quirks, uint Width>
+	void DrawLoRes(uint X, uint Y, uint rows);
+	template <class Quirks, uint Width>
+	void DrawHiRes(uint X, uint Y, uint rows);
+	void SaveRplFlags() const;
 
-	void LoadRom(std::string filePath);
-	void ResetMachine();
+	static const Instruction *GetDecodeTable(QuirkProfile profile);
+	template <class Quirks>
+	static const Instruction *GetDecodeTable();
+	template <class Quirks>
+	static Instruction DecodeOpcode(uint16_t opcode);
+	static void InvalidOpcode(Machine &, const Instruction &);
 
 	static uint16_t GetValueFromBits(uint16_t, unsigned int, unsigned int);
 	static uint16_t MergeBytes(uint8_t, uint8_t);
 	static void NoSuchOpcode(uint16_t opcode);
-	static uint8_t fromHex(char);
 	static uint64_t getFileSize(const std::string &filePath);
 
-	// Opcodes:
+	// Opcodes; those templated on a policy from quirks.h differ between profiles:
+	template <class Quirks>
 	void CLS();
 	void RET();
+	template <class Quirks>
+	void SCD_N(uint);
+	void SCU_N(uint);
+	template <class Quirks>
+	void SCR();
+	template <class Quirks>
+	void SCL();
+	void EXIT();
+	void LOW();
+	void HIGH();
 	void JMP(uint);
 	void CALL_NNN(uint);
+	template <class Quirks>
 	void SE_XNN(uint, uint);
+	template <class Quirks>
 	void SNE_XNN(uint, uint);
+	template <class Quirks>
 	void SE_XY(uint, uint);
+	void LD_IXY(uint, uint);
+	void LD_XYI(uint, uint);
 	void LD_XNN(uint, uint);
 	void ADD_XNN(uint, uint);
 	void LD_XY(uint, uint);
+	template <class Quirks>
 	void OR_XY(uint, uint);
+	template <class Quirks>
 	void AND_XY(uint, uint);
+	template <class Quirks>
 	void XOR_XY(uint, uint);
 	void ADD_XY(uint, uint);
 	void SUB_XY(uint, uint);
+	template <class Quirks>
 	void SHR_XY(uint, uint);
 	void SUBN_XY(uint, uint);
+	template <class Quirks>
 	void SHL_XY(uint, uint);
+	template <class Quirks>
 	void SNE_XY(uint, uint);
 	void LD_INNN(uint);
+	void LD_INNNN();
+	template <class Quirks>
 	void JMP_0NNN(uint);
 	void RND_XNN(uint, uint);
+	template <class Quirks>
 	void DRW_XYN(uint, uint, uint);
+	template <class Quirks>
+	void DRW_XY0(uint, uint);
+	template <class Quirks>
 	void SKP_X(uint);
+	template <class Quirks>
 	void SKNP_X(uint);
 	void LD_XDT(uint);
 	void LD_XK(uint);
 	void LD_DTX(uint);
 	void LD_STX(uint);
+	template <class Quirks>
 	void ADD_IX(uint);
 	void LD_FX(uint);
+	void LD_HFX(uint);
+	template <class Quirks>
 	void LD_BX(uint);
+	template <class Quirks>
 	void LD_IX(uint);
+	template <class Quirks>
 	void LD_XI(uint);
+	void LD_RX(uint);
+	void LD_XR(uint);
+	void PLANE_N(uint);
+	void AUDIO();
+	void PITCH_X(uint);
 
 public:
-	Machine(uint32_t displayScaleArg = 1);
+	static constexpr uint timersDeltaMicroS = 16670;
+	static constexpr uint insDeltaMicroS = 1667; // default speed, see FrameScheduler for others.
+	static constexpr uint insPerTimer = timersDeltaMicroS / insDeltaMicroS;
+
+	Machine();
 	~Machine();
-	void LaunchRom(std::string);
+
+	void ResetMachine();
+	void LoadRom(std::string filePath);
+	void LoadProgram(const uint8_t *program, uint size);
+	RunStats RunHeadless(std::string filePath, uint64_t frames, uint instructionsPerFrame = insPerTimer);
+
+	// Execution:
+	// Both return the instructions executed, fewer than asked for once FX0A blocks or 00FD exits.
+	uint64_t Step(uint64_t count = 1);
+	uint64_t RunFrames(uint64_t frames, uint instructionsPerFrame = insPerTimer);
+	void TickTimers();
+	void SetEngine(Engine engineArg);
+	Engine GetEngine() const { return engine; }
+	const BlockCacheStats *GetBlockCacheStats() const;
+	const JitStats *GetJitStats() const;
+	const AotStats *GetAotStats() const;
+	// Fast-forwards loops that only poll the delay timer or the keys, see SkipIdleLoop.
+	void SetIdleSkip(bool enabled) { idleSkip = enabled; }
+	bool GetIdleSkip() const { return idleSkip; }
+	const IdleStats &GetIdleStats() const { return idleStats; }
+	// Every instruction Step has executed on this machine.
+	uint64_t GetInstructionCount() const { return instructionCount; }
+	// CXNN draws from a per-machine xorshift32; ResetMachine leaves it alone.
+	void SeedRandom(uint32_t seed) { randomState = seed | 1; }
+	static uint32_t NextSeed(); // a fresh seed per call, as each new machine gets.
+	// Counts every interpreted instruction into profiler when the core is built with CHIP8_PROFILE.
+	void SetProfiler(Profiler *profilerArg) { profiler = profilerArg; }
+	Profiler *GetProfiler() const { return profiler; }
+	// Logs the state before every instruction; a native JIT block logs only its first one.
+	void SetTracer(TraceWriter *tracerArg) { tracer = tracerArg; }
+	TraceWriter *GetTracer() const { return tracer; }
+
+	// State access:
+	// Rows of the current mode: GetDisplayHeight words, and in hi-res as many of GetDisplayRight.
+	const uint64_t *GetDisplay() const { return bDisplay; }
+	const uint64_t *GetDisplayRight() const { return bDisplayRight; }
+	bool IsHiRes() const { return hiRes; }
+	uint GetDisplayWidth() const { return hiRes ? DISPLAY_HIRES_WIDTH : DISPLAY_ARRAY_WIDTH; }
+	uint GetDisplayHeight() const { return hiRes ? DISPLAY_HIRES_HEIGHT : DISPLAY_ARRAY_HEIGHT; }
+	bool GetPixel(uint x, uint y) const
+	{
+		const uint64_t row = x < DISPLAY_ARRAY_WIDTH ? bDisplay[y] : bDisplayRight[y];
+		return (row >> (DISPLAY_ARRAY_WIDTH - 1 - x % DISPLAY_ARRAY_WIDTH)) & 1;
+	}
+	uint64_t ConsumeDirtyRows();
+	uint16_t ConsumeDirtyPages();
+	uint8_t *GetRegisters() { return Registers; }
+	const uint8_t *GetRegisters() const { return Registers; }
+	// The address space: MEMORY_SIZE bytes, or XO_MEMORY_SIZE under QuirkProfile::XoChip.
+	uint8_t *GetMemory(); // drops cached blocks, the caller may write through it.
+	const uint8_t *GetMemory() const { return xo ? xo->Memory : Memory; }
+	uint GetMemorySize() const { return AddressSpaceSize(); }
+	uint16_t GetIndexRegister() const { return IndexRegister; }
+	uint16_t GetProgramCounter() const { return ProgramCounter; }
+	int GetDelayTimer() const { return DelayTimer; }
+	int GetSoundTimer() const { return SoundTimer; }
+	const MachineState &GetState() const { return *this; }
+	// The rest of an XO-CHIP machine's state, null for the other profiles.
+	const XoChipState *GetXoChipState() const { return xo.get(); }
+	void SetState(const MachineState &state); // drops cached blocks.
+
+	// Input:
+	void SetKey(uint key, bool pressed);
+	void SetKeys(uint16_t keyMask); // all 16 keys at once, as SetKey in key order.
+	bool IsKeyPressed(uint key) const { return (Keys >> key) & 1; }
+	uint16_t GetKeys() const { return Keys; }
+	// FX0A blocks the machine: Step returns at once until SetKey ends the wait.
+	bool IsWaitingForKey() const { return keyWaitRegister != KEY_WAIT_NONE; }
+	// 00FD stops the machine for good.
+	bool HasExited() const { return exited; }
+	// Ends the wait on the release of a key pressed during it, as the COSMAC VIP does.
+	void SetKeyWaitOnRelease(bool enabled);
+	bool GetKeyWaitOnRelease() const { return keyWaitOnRelease; }
+
+	// Quirks:
+	// Switches the decode table to the profile's; drops cached and compiled blocks. XoChip
+	// allocates an XoChipState, taking over the first MEMORY_SIZE bytes, and runs on the
+	// interpreter whatever the engine.
+	void SetQuirks(QuirkProfile profile);
+	QuirkProfile GetQuirks() const { return quirks; }
+
+	// SUPER-CHIP RPL flags: loads those saved in the file, if it exists, and has FX75 write them back.
+	void SetRplFlagsFile(const std::string &path);
+	const uint8_t *GetRplFlags() const { return rplFlags; }
 };
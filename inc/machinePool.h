@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "machine.h"
+
+#define MACHINE_POOL_CHUNK 1024 // machines per slab.
+
+// Creates Machines in slabs of MACHINE_POOL_CHUNK, so keeping many instances resident
+// costs one allocation per slab instead of one per machine. Released slots are reused;
+// machines still alive when the pool goes away are destroyed with it.
+class MachinePool
+{
+	struct Slot
+	{
+		alignas(Machine) unsigned char Bytes[sizeof(Machine)];
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	std::vector<uint8_t> used; // per slot, chunk by chunk.
+	std::vector<Slot *> freeSlots;
+	size_t live = 0;
+
+	void AddChunk();
+	size_t SlotIndex(const Machine *machine) const;
+
+public:
+	MachinePool() = default;
+	MachinePool(const MachinePool &) = delete;
+	MachinePool &operator=(const MachinePool &) = delete;
+	~MachinePool();
+
+	Machine *Create();
+	void Release(Machine *machine);
+	void Reserve(size_t count);
+
+	size_t GetLiveCount() const { return live; }
+	size_t GetCapacity() const { return chunks.size() * MACHINE_POOL_CHUNK; }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+#define MOVIE_MAGIC "CH8M"
+#define MOVIE_VERSION 3 // 2: the SUPER-CHIP big font and display are part of the hashed state; 3: the sound timer.
+#define MOVIE_QUIRK_KEY_RELEASE 0x1 // FX0A confirms on release, see Machine::SetKeyWaitOnRelease.
+#define MOVIE_QUIRK_PROFILE_SHIFT 8 // bits 8-15 hold the QuirkProfile, see Machine::SetQuirks.
+
+// Everything besides the keys that decides how a recorded run goes.
+struct MovieHeader
+{
+	uint64_t RomHash = 0; // FNV-1a of the rom file.
+	uint32_t RomSize = 0;
+	uint32_t Seed = 0;
+	uint32_t InstructionsPerFrame = Machine::insPerTimer;
+	uint32_t Quirks = 0;
+	uint64_t Frames = 0;
+	uint64_t FinalStateHash = 0; // Movie::HashState after the last frame.
+};
+
+// A run of a rom reduced to what makes it reproducible: the rom hash, the random seed, the
+// quirks, and the keypad mask held in each frame, run-length encoded. A frame is SetKeys,
+// InstructionsPerFrame instructions and one timer tick, as in Machine::RunFrames, so a movie
+// recorded in a window plays back headless at full speed and ends in the same state.
+//
+// File, little-endian: MOVIE_MAGIC, u16 version, the header fields in order, u32 run count,
+// then per run a u16 key mask and its frame count as an LEB128 varint.
+class Movie
+{
+	struct Run
+	{
+		uint16_t Keys;
+		uint64_t Frames;
+	};
+
+	MovieHeader header;
+	std::vector<Run> runs;
+
+	static uint64_t HashFile(const std::string &filePath, uint32_t &size);
+
+public:
+	explicit Movie(uint32_t seed = Machine::NextSeed());
+
+	// Recording: Start after the rom is loaded, RecordFrame with the keys of every frame
+	// before it runs, Finish after the last one.
+	void Start(Machine &machine, const std::string &romPath, uint instructionsPerFrame);
+	void RecordFrame(uint16_t keys);
+	void Finish(const Machine &machine);
+
+	// Resets the machine, runs the whole movie on it and tells whether it ended in the
+	// recorded state. Throws when the rom is not the recorded one.
+	bool Play(Machine &machine, const std::string &romPath) const;
+
+	void Save(const std::string &filePath) const;
+	static Movie Load(const std::string &filePath);
+
+	const MovieHeader &GetHeader() const { return header; }
+	size_t GetRunCount() const { return runs.size(); }
+
+	// FNV-1a over the emulated state field by field, leaving out struct padding.
+	static uint64_t HashState(const Machine &machine);
+};
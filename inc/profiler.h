@@ -0,0 +1,86 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+#define PROFILE_MAX_CALL_NODES 65536
+#define PROFILE_ROOT_NODE 0
+#define PROFILE_REPORT_ROWS 20
+
+// Where a run spends its instructions, filled in by Machine::EmulateIns when the core is built
+// with CHIP8_PROFILE; without it the hook is compiled out and a profiler attached to a machine
+// stays empty. Only the interpreter goes through EmulateIns, so profile with Engine::Interpreter.
+class Profiler
+{
+	// A call path from the entry point: one node per distinct chain of CALL targets.
+	struct CallNode
+	{
+		uint32_t Parent;
+		uint16_t Function; // CALL target, 0x200 for the root.
+		uint8_t Depth;	   // StackPointer inside it.
+		uint64_t Calls = 0;
+		uint64_t Instructions = 0; // executed in the function itself, not in its callees.
+		std::vector<uint32_t> Children;
+	};
+
+	std::vector<uint64_t> opcodeCounts; // by full opcode.
+	std::vector<uint64_t> pcCounts;	 // by address, over XO-CHIP's 64 KB so any profile fits.
+	std::vector<uint16_t> pcOpcodes; // last executed at each address, for the report.
+	std::vector<CallNode> nodes;
+	uint32_t current = PROFILE_ROOT_NODE;
+	uint64_t instructions = 0;
+	double cpuSeconds = 0;
+	double displaySeconds = 0;
+	uint64_t displayUpdates = 0;
+
+	void EnterCall(uint16_t function);
+	std::string PathOf(uint32_t node) const;
+
+public:
+	static constexpr bool Enabled =
+#ifdef CHIP8_PROFILE
+		true;
+#else
+		false;
+#endif
+
+	Profiler();
+
+	// Before the instruction at pc executes; stackPointer is the machine's at that point.
+	void OnInstruction(uint16_t pc, uint16_t opcode, uint16_t stackPointer)
+	{
+		opcodeCounts[opcode]++;
+		pcCounts[pc]++;
+		pcOpcodes[pc] = opcode;
+		instructions++;
+
+		// Returned from, or a state loaded with a shallower stack: follow it up.
+		while (nodes[current].Depth > stackPointer)
+			current = nodes[current].Parent;
+		nodes[current].Instructions++;
+
+		// RET needs nothing: the next instruction sees the lower StackPointer.
+		if ((opcode & 0xF000) == 0x2000 && stackPointer + 1 < STACK_SIZE)
+			EnterCall(opcode & 0x0FFF);
+	}
+
+	void AddCpuTime(double seconds) { cpuSeconds += seconds; }
+	void AddDisplayTime(double seconds)
+	{
+		displaySeconds += seconds;
+		displayUpdates++;
+	}
+	void Clear();
+
+	uint64_t GetInstructions() const { return instructions; }
+	uint64_t GetOpcodeCount(uint16_t opcode) const { return opcodeCounts[opcode]; }
+	uint64_t GetPcCount(uint16_t pc) const { return pcCounts[pc]; }
+
+	// Opcode groups, hot addresses, CPU and display time and the call graph.
+	void WriteReport(std::ostream &out) const;
+	// "0x200;0x2A4;0x310 <instructions>" lines, as flamegraph.pl and speedscope read them.
+	void WriteCollapsedStacks(std::ostream &out) const;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+
+// Behaviour that differs between CHIP-8 interpreters. Each profile is a policy type whose
+// constants the quirk-dependent opcode handlers read at compile time; Machine builds one decode
+// table per profile and SetQuirks picks it, so the handlers never test a flag at run time.
+enum class QuirkProfile
+{
+	Default, // this interpreter's behaviour before profiles existed.
+	Vip,	 // the COSMAC VIP interpreter.
+	Chip48,	 // CHIP-48 on the HP-48.
+	Schip,	 // SUPER-CHIP 1.1.
+	XoChip,	 // XO-CHIP, as Octo runs it: 64 KB of memory, two bitplanes and an audio pattern.
+};
+
+// FX55 and FX65 leave I at I + X + 1, I + X or untouched.
+enum class IndexIncrement
+{
+	XPlusOne,
+	X,
+	None,
+};
+
+struct DefaultQuirks
+{
+	static constexpr bool ShiftReadsVY = false;	  // 8XY6/8XYE shift VY into VX, rather than VX in place.
+	static constexpr IndexIncrement LoadStoreIncrement = IndexIncrement::XPlusOne;
+	static constexpr bool AddIndexSetsVF = true;  // FX1E sets VF when I passes 0xFFF.
+	static constexpr bool JumpAddsVX = false;	  // BXNN jumps to XNN + VX, rather than NNN + V0.
+	static constexpr bool ClipSprites = false;	  // DXYN drops what passes the screen edge, rather than wrapping it.
+	static constexpr bool LogicResetsVF = false; // 8XY1/8XY2/8XY3 clear VF.
+	static constexpr bool XoChip = false;		  // the XO-CHIP opcodes, address space and planes, see XoChipState.
+};
+
+struct VipQuirks
+{
+	static constexpr bool ShiftReadsVY = true;
+	static constexpr IndexIncrement LoadStoreIncrement = IndexIncrement::XPlusOne;
+	static constexpr bool AddIndexSetsVF = false;
+	static constexpr bool JumpAddsVX = false;
+	static constexpr bool ClipSprites = true;
+	static constexpr bool LogicResetsVF = true;
+	static constexpr bool XoChip = false;
+};
+
+struct Chip48Quirks
+{
+	static constexpr bool ShiftReadsVY = false;
+	static constexpr IndexIncrement LoadStoreIncrement = IndexIncrement::X;
+	static constexpr bool AddIndexSetsVF = false;
+	static constexpr bool JumpAddsVX = true;
+	static constexpr bool ClipSprites = true;
+	static constexpr bool LogicResetsVF = false;
+	static constexpr bool XoChip = false;
+};
+
+struct SchipQuirks
+{
+	static constexpr bool ShiftReadsVY = false;
+	static constexpr IndexIncrement LoadStoreIncrement = IndexIncrement::None;
+	static constexpr bool AddIndexSetsVF = false;
+	static constexpr bool JumpAddsVX = true;
+	static constexpr bool ClipSprites = true;
+	static constexpr bool LogicResetsVF = false;
+	static constexpr bool XoChip = false;
+};
+
+struct XoChipQuirks
+{
+	static constexpr bool ShiftReadsVY = true;
+	static constexpr IndexIncrement LoadStoreIncrement = IndexIncrement::XPlusOne;
+	static constexpr bool AddIndexSetsVF = false;
+	static constexpr bool JumpAddsVX = false;
+	static constexpr bool ClipSprites = false;
+	static constexpr bool LogicResetsVF = false;
+	static constexpr bool XoChip = true;
+};
+
+// The constants of a profile as values, for code that compiles or checks per profile at run
+// time (the JIT) rather than per instruction.
+struct QuirkSettings
+{
+	bool ShiftReadsVY;
+	IndexIncrement LoadStoreIncrement;
+	bool AddIndexSetsVF;
+	bool JumpAddsVX;
+	bool ClipSprites;
+	bool LogicResetsVF;
+	bool XoChip;
+};
+
+template <class Quirks>
+constexpr QuirkSettings MakeQuirkSettings()
+{
+	return {Quirks::ShiftReadsVY, Quirks::LoadStoreIncrement, Quirks::AddIndexSetsVF, Quirks::JumpAddsVX, Quirks::ClipSprites, Quirks::LogicResetsVF,
+			Quirks::XoChip};
+}
+
+// Calls visit with a value of the profile's policy type: the one switch from a run-time profile
+// to a compile-time one.
+template <class Visitor>
+auto VisitQuirks(QuirkProfile profile, Visitor visit)
+{
+	switch (profile)
+	{
+	case QuirkProfile::Vip:
+		return visit(VipQuirks());
+	case QuirkProfile::Chip48:
+		return visit(Chip48Quirks());
+	case QuirkProfile::Schip:
+		return visit(SchipQuirks());
+	case QuirkProfile::XoChip:
+		return visit(XoChipQuirks());
+	default:
+		return visit(DefaultQuirks());
+	}
+}
+
+const QuirkSettings &GetQuirkSettings(QuirkProfile profile);
+
+// "default", "vip", "chip48", "schip" or "xochip".
+bool QuirkProfileFromName(const std::string &name, QuirkProfile &profile);
+const char *QuirkProfileName(QuirkProfile profile);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "machine.h"
+
+#define REWIND_KEYFRAME_INTERVAL 60 // one full snapshot a second at one snapshot per frame.
+
+struct RewindStats
+{
+	uint64_t Keyframes = 0;
+	uint64_t Deltas = 0;
+	uint64_t PagesStored = 0;
+	uint64_t Evicted = 0;
+};
+
+// Snapshots of one machine in a fixed number of bytes, the oldest dropped first. Every
+// REWIND_KEYFRAME_INTERVAL pushes a keyframe stores the whole MachineState; the pushes in
+// between store everything but Memory plus the MEMORY_PAGE_SIZE pages written since the
+// keyframe. The buffer consumes the machine's dirty pages, so it must be their only reader.
+class RewindBuffer
+{
+	struct Entry
+	{
+		size_t Offset;
+		size_t Size;
+		uint64_t Keyframe; // sequence number of the keyframe a delta applies to.
+		uint16_t Pages;	   // pages differing from the keyframe, stored in ascending order.
+		bool IsKeyframe;
+	};
+
+	std::vector<uint8_t> buffer;
+	std::deque<Entry> entries;
+	uint64_t firstSequence = 0; // of entries.front().
+	uint keyframeInterval;
+	uint sinceKeyframe;		  // pushes since the last keyframe.
+	uint16_t pagesSinceKeyframe = 0;
+	RewindStats stats;
+
+	size_t Allocate(size_t size);
+	void EvictOldest();
+
+public:
+	RewindBuffer(size_t bytes, uint keyframeIntervalArg = REWIND_KEYFRAME_INTERVAL);
+
+	void Push(Machine &machine);
+	// Restores the state pushed `count` pushes ago (1 is the latest) and forgets it and
+	// everything newer. Fails when fewer snapshots are held.
+	bool Rewind(Machine &machine, uint count = 1);
+	void Clear();
+
+	size_t GetCount() const { return entries.size(); }
+	size_t GetBytesUsed() const;
+	size_t GetCapacity() const { return buffer.size(); }
+	const RewindStats &GetStats() const { return stats; }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <string>
+
+#include "machine.h"
+#include "audioStream.h"
+#include "frameHandoff.h"
+#include "frameScheduler.h"
+#include "movie.h"
+
+#define KEY_UNBOUND 0xFF
+#define EVENT_WAIT_TIMEOUT_MS 100 // the SDL thread otherwise sleeps until an event or a new frame.
+#define VSYNC_LEAD_MICROS 2000	  // frames are scheduled to be published this long before a vblank.
+#define AUDIO_DEVICE_SAMPLES 512  // per callback, about 11 ms at AUDIO_SAMPLE_RATE.
+#define KEY_WAIT_POLL_MICROS 1000 // while FX0A blocks, how often the emulation thread looks for input.
+#define FAST_FORWARD_KEY SDL_SCANCODE_TAB // held, frames run unthrottled; unless the key map binds it.
+
+// Render times of the frames actually presented.
+struct FrameStats
+{
+	uint64_t Presents = 0;
+	uint64_t RowsUploaded = 0;
+	uint64_t FramesPublished = 0; // by the emulation thread, newer ones replace those not yet presented.
+	double TotalMs = 0;
+	double MaxMs = 0;
+	// From a key event to the present of the first frame run with it.
+	uint64_t InputSamples = 0;
+	double InputLatencySumMs = 0;
+	double InputLatencyMaxMs = 0;
+};
+
+// Window, renderer and keyboard around a Machine. The core itself knows nothing about SDL.
+// The machine runs on its own thread, paced by a FrameScheduler; the thread that called
+// LaunchRom only handles events and presents. Frames go one way through a FrameHandoff and
+// key state the other way through one atomic word, so neither thread waits for the other.
+// Sound goes from the emulation thread to SDL's audio callback through an AudioStream.
+class SdlFrontend
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Machine &Chip8;
+
+	// Display:
+	bool displayInitFlag = false;
+	uint scale = 1;
+	uint DisplayHeight = DISPLAY_ARRAY_HEIGHT;
+	uint DisplayWidth = DISPLAY_ARRAY_WIDTH;
+	SDL_Window *AppWindow = nullptr;
+	SDL_Renderer *Renderer = nullptr;
+	SDL_Texture *Texture = nullptr; // at the resolution of shownHiRes.
+	uint32_t Pixels[DISPLAY_HIRES_HEIGHT * DISPLAY_HIRES_WIDTH];
+	uint64_t shownRows[DISPLAY_HIRES_HEIGHT]; // display rows as they are in Pixels.
+	uint64_t shownRightRows[DISPLAY_HIRES_HEIGHT];
+	uint64_t shownPlaneRows[DISPLAY_HIRES_HEIGHT]; // the XO-CHIP second plane, zero otherwise.
+	uint64_t shownPlaneRightRows[DISPLAY_HIRES_HEIGHT];
+	bool shownHiRes = false;
+	uint64_t pendingRows = 0; // rows changed since the last present.
+	FrameStats frameStats;
+
+	// Emulation thread:
+	FrameHandoff handoff;
+	Uint32 frameEventType = 0; // pushed after a published frame or on quitting, to wake the SDL thread.
+	std::atomic<bool> frameEventPending{false}; // at most one in the queue, however fast frames come.
+	std::exception_ptr emulationError;
+	Movie *movie = nullptr; // recorded by the emulation thread when set.
+	bool alignToVsync = false;				  // the display refreshes at FRAME_RATE.
+	std::atomic<Clock::rep> lastPresent{0}; // when the latest vsynced present returned.
+
+	// Audio: the callback runs on SDL's audio thread and only touches the stream.
+	std::unique_ptr<AudioStream> audio;
+	SDL_AudioDeviceID audioDevice = 0; // 0 without an audio device, the machine then runs silent.
+	uint audioDeviceSamples = 0;
+
+	// Keyboard
+	SDL_Event Event;
+	uint8_t keyMap[SDL_NUM_SCANCODES]; // keypad key per scancode, KEY_UNBOUND for the rest.
+	uint16_t keys = 0;
+	std::atomic<uint32_t> inputState{0}; // keys in the low half, a sequence number of changes in the high half.
+	std::atomic<uint16_t> pressedKeys{0}; // pressed since the last frame, so a tap between two frames is seen.
+	uint16_t inputSequence = 0;
+	Clock::time_point inputTime;	// of the latest change, until a frame run with it is presented.
+	bool inputPending = false;
+
+	// Rest
+	std::atomic<bool> quitFlag{false};
+	uint instructionsPerFrame = Machine::insPerTimer;
+	bool turbo = false;
+	std::atomic<bool> fastForward{false}; // FAST_FORWARD_KEY held.
+
+	// Methods
+	void InitializeDisplay();
+	void CreateTexture(bool hiRes);
+	void ClearShownRows();
+	void UpdateDisplay();
+	void EndDisplay();
+	void InitializeAudio();
+	void EndAudio();
+	static void AudioCallback(void *frontend, Uint8 *stream, int bytes);
+	void HandleEvent(const SDL_Event &event);
+	void PresentLatestFrame();
+	void RunEmulation(FrameScheduler &scheduler);
+	void WaitForKey(const FrameScheduler &scheduler, uint32_t input);
+	void WakeEventLoop();
+	void PrintFrameStats() const;
+
+public:
+	SdlFrontend(Machine &machine, uint32_t displayScaleArg = 1);
+	~SdlFrontend();
+	void SetSpeed(uint instructionsPerFrameArg, bool turboArg);
+	// The QWERTY block 1234/QWER/ASDF/ZXCV laid over the 123C/456D/789E/A0BF keypad.
+	void SetDefaultKeyMap();
+	// "<hex keypad key> <SDL scancode name>" per line, '#' starts a comment. Replaces the whole map.
+	void LoadKeyMap(const std::string &filePath);
+	void SetMovie(Movie *movieArg) { movie = movieArg; }
+	void LaunchRom(std::string);
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+#define TRACE_MAGIC "CH8T"
+#define TRACE_VERSION 1
+#define TRACE_CHUNK_RECORDS 4096 // records between writes to a file, or header updates of a ring.
+
+// The machine just before one instruction executes. What it changed is the difference to the
+// next record. Index counts instructions from the start of the trace, so instructions run
+// without a record (native JIT blocks after their first, fast-forwarded idle loops) leave gaps.
+struct TraceRecord
+{
+	uint64_t Index;
+	uint16_t ProgramCounter;
+	uint16_t Opcode;
+	uint16_t IndexRegister;
+	uint8_t DelayTimer;
+	uint8_t StackPointer;
+	uint8_t Registers[16];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "Trace records are 32 bytes on disk.");
+
+// Little-endian on disk, as the host writes it.
+struct TraceHeader
+{
+	char Magic[4];
+	uint16_t Version;
+	uint16_t RecordSize;
+	uint64_t Capacity; // records held by a ring, 0 for a plain file.
+	uint64_t Written;  // records written; a ring keeps the last Capacity of them.
+	uint64_t Reserved;
+};
+
+static_assert(sizeof(TraceHeader) == 32, "The trace header is 32 bytes on disk.");
+
+// Logs a record per instruction from Machine::EmulateIns and the cached engine. With a ring
+// capacity the file is a memory-mapped ring of that many records holding the latest ones, which
+// survive the process dying up to the last whole chunk; without one every record is appended.
+class TraceWriter
+{
+	TraceRecord *records; // where the next records go: chunk for a file, the mapping for a ring.
+	uint64_t next = 0;	  // slot of the next record.
+	uint64_t end;		  // slot ending the current chunk.
+	uint64_t chunkStart = 0;
+	uint64_t index = 0; // of the next instruction.
+	uint64_t written = 0; // records before the current chunk.
+	uint64_t capacity;
+	std::vector<TraceRecord> chunk;
+	FILE *file = nullptr;
+	int descriptor = -1;
+	TraceHeader *mapping = nullptr;
+	size_t mappingSize = 0;
+
+	void Advance();
+	void WriteHeader();
+
+public:
+	TraceWriter(const std::string &path, uint64_t ringRecords = 0);
+	~TraceWriter();
+	TraceWriter(const TraceWriter &) = delete;
+	TraceWriter &operator=(const TraceWriter &) = delete;
+
+	void Record(const MachineState &state, uint16_t opcode)
+	{
+		TraceRecord &record = records[next];
+		record.Index = index++;
+		record.ProgramCounter = state.ProgramCounter;
+		record.Opcode = opcode;
+		record.IndexRegister = state.IndexRegister;
+		record.DelayTimer = state.DelayTimer;
+		record.StackPointer = state.StackPointer;
+		memcpy(record.Registers, state.Registers, sizeof(record.Registers));
+		if (++next == end)
+			Advance();
+	}
+	// Instructions that ran without records.
+	void Skip(uint64_t instructions) { index += instructions; }
+	void Flush();
+
+	uint64_t GetRecordCount() const { return written + next - chunkStart; }
+	uint64_t GetInstructionCount() const { return index; }
+};
+
+// Reads a trace file, or the records a ring still holds, oldest first.
+class TraceReader
+{
+	FILE *file;
+	TraceHeader header;
+	uint64_t remaining;
+	uint64_t position; // record slot of the next read in a ring.
+
+public:
+	explicit TraceReader(const std::string &path);
+	~TraceReader();
+	TraceReader(const TraceReader &) = delete;
+	TraceReader &operator=(const TraceReader &) = delete;
+
+	bool Next(TraceRecord &record);
+	const TraceHeader &GetHeader() const { return header; }
+};
@@ -0,0 +1,332 @@
+#include "aotCompiler.h"
+
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+
+#include "blockCache.h"
+#include "disassembler.h"
+
+namespace
+{
+	const char *QuirksType(QuirkProfile profile)
+	{
+		switch (profile)
+		{
+		case QuirkProfile::Vip:
+			return "VipQuirks";
+		case QuirkProfile::Chip48:
+			return "Chip48Quirks";
+		case QuirkProfile::Schip:
+			return "SchipQuirks";
+		default:
+			return "DefaultQuirks";
+		}
+	}
+
+	const char *QuirksEnumerator(QuirkProfile profile)
+	{
+		switch (profile)
+		{
+		case QuirkProfile::Vip:
+			return "QuirkProfile::Vip";
+		case QuirkProfile::Chip48:
+			return "QuirkProfile::Chip48";
+		case QuirkProfile::Schip:
+			return "QuirkProfile::Schip";
+		default:
+			return "QuirkProfile::Default";
+		}
+	}
+
+	bool IsSkip(uint16_t opcode)
+	{
+		switch (opcode >> 12)
+		{
+		case 0x3:
+		case 0x4:
+		case 0x5:
+		case 0x9:
+		case 0xE:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// As in the block cache, less the skips: a taken one returns from the middle of the block.
+	bool EndsBlock(uint16_t opcode)
+	{
+		return BlockCache::EndsBlock(opcode) && !IsSkip(opcode);
+	}
+
+	std::string Format(const char *format, uint a, uint b = 0, uint c = 0)
+	{
+		char text[64];
+		snprintf(text, sizeof(text), format, a, b, c);
+		return text;
+	}
+}
+
+std::string AotCompiler::CallFor(uint16_t opcode, const char *quirksType)
+{
+	const uint NNN = opcode & 0xFFF, NN = opcode & 0xFF, N = opcode & 0xF;
+	const uint X = opcode >> 8 & 0xF, Y = opcode >> 4 & 0xF;
+	const std::string q = std::string("<") + quirksType + ">";
+
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		if (NNN == 0x0E0)
+			return "m.CLS" + q + "()";
+		if (NNN == 0x0EE)
+			return "m.RET()";
+		if ((NNN & 0xFF0) == 0x0C0)
+			return "m.SCD_N" + q + Format("(%u)", N);
+		if (NNN == 0x0FB)
+			return "m.SCR" + q + "()";
+		if (NNN == 0x0FC)
+			return "m.SCL" + q + "()";
+		if (NNN == 0x0FD)
+			return "m.EXIT()";
+		if (NNN == 0x0FE)
+			return "m.LOW()";
+		if (NNN == 0x0FF)
+			return "m.HIGH()";
+		return "";
+	case 0x1:
+		return Format("m.JMP(0x%03X)", NNN);
+	case 0x2:
+		return Format("m.CALL_NNN(0x%03X)", NNN);
+	case 0x3:
+		return "m.SE_XNN" + q + Format("(%u, 0x%02X)", X, NN);
+	case 0x4:
+		return "m.SNE_XNN" + q + Format("(%u, 0x%02X)", X, NN);
+	case 0x5:
+		return "m.SE_XY" + q + Format("(%u, %u)", X, Y);
+	case 0x6:
+		return Format("m.LD_XNN(%u, 0x%02X)", X, NN);
+	case 0x7:
+		return Format("m.ADD_XNN(%u, 0x%02X)", X, NN);
+	case 0x8:
+		switch (N)
+		{
+		case 0x0:
+			return Format("m.LD_XY(%u, %u)", X, Y);
+		case 0x1:
+			return "m.OR_XY" + q + Format("(%u, %u)", X, Y);
+		case 0x2:
+			return "m.AND_XY" + q + Format("(%u, %u)", X, Y);
+		case 0x3:
+			return "m.XOR_XY" + q + Format("(%u, %u)", X, Y);
+		case 0x4:
+			return Format("m.ADD_XY(%u, %u)", X, Y);
+		case 0x5:
+			return Format("m.SUB_XY(%u, %u)", X, Y);
+		case 0x6:
+			return "m.SHR_XY" + q + Format("(%u, %u)", X, Y);
+		case 0x7:
+			return Format("m.SUBN_XY(%u, %u)", X, Y);
+		case 0xE:
+			return "m.SHL_XY" + q + Format("(%u, %u)", X, Y);
+		}
+		return "";
+	case 0x9:
+		return "m.SNE_XY" + q + Format("(%u, %u)", X, Y);
+	case 0xA:
+		return Format("m.LD_INNN(0x%03X)", NNN);
+	case 0xB:
+		return "m.JMP_0NNN" + q + Format("(0x%03X)", NNN);
+	case 0xC:
+		return Format("m.RND_XNN(%u, 0x%02X)", X, NN);
+	case 0xD:
+		if (N == 0)
+			return "m.DRW_XY0" + q + Format("(%u, %u)", X, Y);
+		return "m.DRW_XYN" + q + Format("(%u, %u, %u)", X, Y, N);
+	case 0xE:
+		if (NN == 0x9E)
+			return "m.SKP_X" + q + Format("(%u)", X);
+		if (NN == 0xA1)
+			return "m.SKNP_X" + q + Format("(%u)", X);
+		return "";
+	default:
+		switch (NN)
+		{
+		case 0x07:
+			return Format("m.LD_XDT(%u)", X);
+		case 0x0A:
+			return Format("m.LD_XK(%u)", X);
+		case 0x15:
+			return Format("m.LD_DTX(%u)", X);
+		case 0x18:
+			return Format("m.LD_STX(%u)", X);
+		case 0x1E:
+			return "m.ADD_IX" + q + Format("(%u)", X);
+		case 0x29:
+			return Format("m.LD_FX(%u)", X);
+		case 0x30:
+			return Format("m.LD_HFX(%u)", X);
+		case 0x33:
+			return "m.LD_BX" + q + Format("(%u)", X);
+		case 0x55:
+			return "m.LD_IX" + q + Format("(%u)", X);
+		case 0x65:
+			return "m.LD_XI" + q + Format("(%u)", X);
+		case 0x75:
+			return Format("m.LD_RX(%u)", X);
+		case 0x85:
+			return Format("m.LD_XR(%u)", X);
+		}
+		return "";
+	}
+}
+
+AotCompiler::AotCompiler(const std::string &nameArg, const uint8_t *program, uint size, QuirkProfile profile)
+{
+	if (profile == QuirkProfile::XoChip)
+		throw std::runtime_error("XO-CHIP roms only run on the interpreter.");
+	if (size > MEMORY_SIZE - 0x200)
+		throw std::runtime_error("The program is too big.");
+
+	for (char c : nameArg)
+		name += isalnum((unsigned char)c) ? c : '_';
+	if (name.empty())
+		name = "rom";
+	quirks = profile;
+	rom.assign(program, program + size);
+	Recover();
+	if (blocks.empty())
+		throw std::runtime_error("No instruction is reachable from 0x200.");
+}
+
+// Marks every instruction reachable from 0x200 and the addresses blocks must start at: the entry,
+// branch targets, the instructions after block ends and those a taken skip lands on. A block runs
+// from each to the next block end, so blocks overlap where one falls through another's start.
+void AotCompiler::Recover()
+{
+	const char *quirksType = QuirksType(quirks);
+	std::vector<bool> reached(MEMORY_SIZE + 2), leader(MEMORY_SIZE + 2);
+	std::vector<uint> work = {0x200};
+	leader[0x200] = true;
+	const auto branch = [&](uint target)
+	{
+		if (target < MEMORY_SIZE)
+		{
+			leader[target] = true;
+			work.push_back(target);
+		}
+	};
+
+	while (!work.empty())
+	{
+		uint pc = work.back();
+		work.pop_back();
+		while (IsCode(pc) && !reached[pc] && !CallFor(OpcodeAt(pc), quirksType).empty())
+		{
+			reached[pc] = true;
+			const uint16_t opcode = OpcodeAt(pc);
+			if (IsSkip(opcode))
+				branch(pc + 4);
+			if (!EndsBlock(opcode))
+			{
+				pc += 2;
+				continue;
+			}
+
+			switch (opcode >> 12)
+			{
+			case 0x0:
+				if (opcode != 0x00EE && opcode != 0x00FD)
+					branch(pc + 2);
+				break;
+			case 0x1:
+				branch(opcode & 0xFFF);
+				break;
+			case 0x2:
+				branch(opcode & 0xFFF);
+				branch(pc + 2); // where RET comes back to.
+				break;
+			case 0xB:
+				indirectJumps++;
+				break;
+			default: // FX0A, FX33 and FX55.
+				branch(pc + 2);
+				break;
+			}
+			break;
+		}
+	}
+
+	for (uint start = 0x200; start < MEMORY_SIZE; start++)
+	{
+		if (!leader[start] || !reached[start])
+			continue;
+
+		Block block;
+		block.Start = start;
+		uint pc = start;
+		for (;;)
+		{
+			const uint16_t opcode = OpcodeAt(pc);
+			block.Opcodes.push_back(opcode);
+			pc += 2;
+			if (EndsBlock(opcode) || !reached[pc])
+				break;
+			if (block.Opcodes.size() == BLOCK_MAX_LENGTH)
+			{
+				leader[pc] = true;
+				break;
+			}
+		}
+		block.End = pc;
+		blocks.push_back(block);
+	}
+}
+
+void AotCompiler::Write(std::ostream &out) const
+{
+	const char *quirksType = QuirksType(quirks);
+	char line[96];
+
+	out << "// " << name << ": " << rom.size() << " bytes compiled ahead of time by chip8_aot for the " << QuirkProfileName(quirks)
+		<< " quirks. Do not edit.\n\n";
+	out << "#include \"aotEngine.h\"\n\n";
+	out << "namespace\n{\n\tnamespace aot_" << name << "\n\t{\n\t\tstruct Program;\n\t}\n}\n\n";
+
+	out << "template <>\nstruct AotCode<aot_" << name << "::Program>\n{\n";
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		const Block &block = blocks[i];
+		snprintf(line, sizeof(line), "\tstatic uint Block%03X(Machine &m)\n\t{\n", block.Start);
+		out << (i ? "\n" : "") << line;
+		for (size_t j = 0; j < block.Opcodes.size(); j++)
+		{
+			const uint address = block.Start + 2 * j;
+			out << "\t\t" << CallFor(block.Opcodes[j], quirksType) << "; // " << Format("%03X: ", address) << Disassemble(block.Opcodes[j]) << "\n";
+			if (IsSkip(block.Opcodes[j]) && j + 1 < block.Opcodes.size())
+				out << Format("\t\tif (m.GetProgramCounter() != 0x%03X)\n\t\t\treturn %u;\n", address + 2, j + 1);
+		}
+		out << "\t\treturn " << block.Opcodes.size() << ";\n\t}\n";
+	}
+	out << "};\n\n";
+
+	out << "namespace\n{\n\tnamespace aot_" << name << "\n\t{\n";
+	out << "\t\tconst uint8_t Rom[] = {";
+	for (size_t i = 0; i < rom.size(); i++)
+		out << (i % 16 ? " " : "\n\t\t\t") << Format("0x%02X,", rom[i]);
+	out << "\n\t\t};\n\n";
+
+	out << "\t\tconst AotBlock Blocks[] = {\n";
+	for (const Block &block : blocks)
+	{
+		snprintf(line, sizeof(line), "\t\t\t{0x%03X, 0x%03X, %u, AotCode<Program>::Block%03X},\n", block.Start, block.End, (uint)block.Opcodes.size(),
+				 block.Start);
+		out << line;
+	}
+	out << "\t\t};\n\n";
+
+	out << "\t\tconst AotProgram Compiled = {\"" << name << "\", " << QuirksEnumerator(quirks) << ", Rom, sizeof(Rom), Blocks, sizeof(Blocks) / sizeof(Blocks[0])};\n";
+	out << "\t\tconst AotRegistration Registration(Compiled);\n";
+	out << "\t}\n}\n";
+	out.flush();
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "aotEngine.h"
+
+#include <algorithm>
+#include <cstring>
+
+static std::vector<const AotProgram *> &Programs()
+{
+	static std::vector<const AotProgram *> programs;
+	return programs;
+}
+
+AotRegistration::AotRegistration(const AotProgram &program)
+{
+	Programs().push_back(&program);
+}
+
+const std::vector<const AotProgram *> &GetAotPrograms()
+{
+	return Programs();
+}
+
+AotEngine::AotEngine(const Machine &machine) : Chip8(machine)
+{
+	Flush();
+}
+
+bool AotEngine::Matches(const AotProgram &candidate, const AotBlock &block) const
+{
+	return memcmp(Chip8.GetState().Memory + block.Start, candidate.Rom + (block.Start - 0x200), block.End - block.Start) == 0;
+}
+
+// The program of the machine's profile with the most blocks matching memory: a game that has
+// written over some of its code still runs the rest natively.
+void AotEngine::Select()
+{
+	selectPending = false;
+	program = nullptr;
+	uint best = 0;
+	for (const AotProgram *candidate : Programs())
+	{
+		if (candidate->Quirks != Chip8.GetQuirks())
+			continue;
+		uint matching = 0;
+		for (uint i = 0; i < candidate->BlockCount; i++)
+			matching += Matches(*candidate, candidate->Blocks[i]);
+		if (matching > best)
+		{
+			best = matching;
+			program = candidate;
+		}
+	}
+
+	stats.Program = program;
+	for (uint i = 0; i < MEMORY_SIZE; i++)
+	{
+		blockAt[i] = -1;
+		covered[i] = false;
+	}
+	codeBegin = MEMORY_SIZE;
+	codeEnd = 0;
+	if (program == nullptr)
+		return;
+
+	states.assign(program->BlockCount, BlockUnchecked);
+	for (uint i = 0; i < program->BlockCount; i++)
+	{
+		const AotBlock &block = program->Blocks[i];
+		blockAt[block.Start] = i;
+		for (uint address = block.Start; address < block.End; address++)
+			covered[address] = true;
+		codeBegin = std::min(codeBegin, (uint)block.Start);
+		codeEnd = std::max(codeEnd, (uint)block.End);
+	}
+}
+
+void AotEngine::Invalidate(uint address, uint length)
+{
+	// Without a program, a write over 0x200 may be the one loading a rom.
+	if (program == nullptr)
+	{
+		selectPending |= address <= 0x200 && 0x200 < address + length;
+		return;
+	}
+
+	// Most writes land on data past the code; only those within its bounds need the byte map.
+	if (address >= codeEnd || address + length <= codeBegin)
+		return;
+	bool hit = false;
+	for (uint i = address; i < address + length && i < MEMORY_SIZE; i++)
+		hit |= covered[i];
+	if (!hit)
+		return;
+
+	for (uint i = 0; i < program->BlockCount; i++)
+	{
+		const AotBlock &block = program->Blocks[i];
+		if (block.Start < address + length && address < block.End && states[i] != BlockUnchecked)
+		{
+			states[i] = BlockUnchecked;
+			stats.Invalidations++;
+		}
+	}
+}
+
+void AotEngine::Flush()
+{
+	selectPending = true;
+}
\ No newline at end of file
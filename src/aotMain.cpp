@@ -0,0 +1,85 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "aotCompiler.h"
+
+using namespace std;
+
+void printUsage();
+
+// chip8_aot [--quirks default|vip|chip48|schip] [--name NAME] --output file.cpp <rom>
+int main(int argc, char *argv[])
+{
+	QuirkProfile quirks = QuirkProfile::Default;
+	string name = "";
+	string outputPath = "";
+	string romPath = "";
+
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--quirks" && i + 1 < argc)
+		{
+			if (!QuirkProfileFromName(argv[++i], quirks))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--name" && i + 1 < argc)
+			name = argv[++i];
+		else if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (romPath.empty() && arg[0] != '-')
+			romPath = arg;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+	if (romPath.empty() || outputPath.empty())
+	{
+		printUsage();
+		return 1;
+	}
+	if (name.empty())
+		name = filesystem::path(romPath).stem().string();
+
+	try
+	{
+		ifstream file(romPath, ios::binary);
+		if (!file.good())
+			throw runtime_error("Cannot read the rom " + romPath);
+		const vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+		const AotCompiler compiler(name, rom.data(), rom.size(), quirks);
+		ofstream output(outputPath);
+		compiler.Write(output);
+		if (!output)
+			throw runtime_error("Cannot write " + outputPath);
+
+		uint instructions = 0;
+		for (const AotCompiler::Block &block : compiler.GetBlocks())
+			instructions += block.Opcodes.size();
+		cout << compiler.GetName() << ": " << compiler.GetBlocks().size() << " blocks, " << instructions << " instructions, "
+			 << compiler.GetIndirectJumps() << " indirect jumps left to the interpreter" << endl;
+	}
+	catch (const exception &exception)
+	{
+		cerr << exception.what() << endl;
+		return 2;
+	}
+	return 0;
+}
+
+void printUsage()
+{
+	cout << "Usage: chip8_aot [--quirks default|vip|chip48|schip] [--name NAME] --output file.cpp <rom>\n";
+	cout << "Translates the basic blocks reachable from 0x200 to a C++ source; linked into an executable, it lets\n";
+	cout << "--engine aot run the rom without fetching or decoding. NAME defaults to the rom's file name." << endl;
+}
\ No newline at end of file
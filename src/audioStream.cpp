@@ -0,0 +1,216 @@
+#include "audioStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	void Put(FILE *file, uint32_t value, uint bytes)
+	{
+		for (uint i = 0; i < bytes; i++)
+			fputc((uint8_t)(value >> (i * 8)), file);
+	}
+}
+
+SoundFrame MakeSoundFrame(const Machine &machine)
+{
+	SoundFrame frame;
+	frame.On = machine.GetSoundTimer() > 0;
+	if (const XoChipState *xo = machine.GetXoChipState())
+	{
+		memcpy(frame.Pattern, xo->AudioPattern, sizeof(frame.Pattern));
+		frame.Pitch = xo->Pitch;
+	}
+	else
+	{
+		memset(frame.Pattern, AUDIO_CLASSIC_PATTERN, sizeof(frame.Pattern));
+		frame.Pitch = XO_DEFAULT_PITCH;
+	}
+	frame.Pushed = 0;
+	return frame;
+}
+
+void ToneGenerator::Render(const SoundFrame &frame, int16_t *samples, uint count)
+{
+	if (!frame.On)
+	{
+		std::fill(samples, samples + count, 0);
+		return;
+	}
+
+	// 48 pitch steps an octave around XO_DEFAULT_PITCH, as XO-CHIP defines FX3A.
+	const double step = AUDIO_PATTERN_RATE * std::exp2((frame.Pitch - XO_DEFAULT_PITCH) / 48.0) / AUDIO_SAMPLE_RATE;
+	const double length = sizeof(frame.Pattern) * 8;
+	for (uint i = 0; i < count; i++)
+	{
+		const uint bit = (uint)position;
+		samples[i] = (frame.Pattern[bit >> 3] >> (7 - (bit & 7)) & 1) ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+		position += step;
+		if (position >= length)
+			position -= length;
+	}
+}
+
+bool SoundRing::Push(const SoundFrame &frame)
+{
+	const uint32_t next = pushed.load(std::memory_order_relaxed);
+	if (next - popped.load(std::memory_order_acquire) == AUDIO_RING_FRAMES)
+		return false;
+	frames[next % AUDIO_RING_FRAMES] = frame;
+	// Release publishes the frame before the counter; the acquire above kept the consumer's
+	// last read of this slot before the write.
+	pushed.store(next + 1, std::memory_order_release);
+	return true;
+}
+
+bool SoundRing::Pop(SoundFrame &frame)
+{
+	const uint32_t next = popped.load(std::memory_order_relaxed);
+	if (next == pushed.load(std::memory_order_acquire))
+		return false;
+	frame = frames[next % AUDIO_RING_FRAMES];
+	popped.store(next + 1, std::memory_order_release);
+	return true;
+}
+
+void SoundRing::Skip(uint32_t count)
+{
+	popped.store(popped.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+void AudioStream::Push(const Machine &machine)
+{
+	SoundFrame frame = MakeSoundFrame(machine);
+	frame.Pushed = Clock::now().time_since_epoch().count();
+	if (!ring.Push(frame))
+		framesDropped++;
+}
+
+void AudioStream::Render(int16_t *samples, uint count)
+{
+	const Clock::time_point start = Clock::now();
+	for (uint done = 0; done < count;)
+	{
+		if (samplesLeft == 0)
+			NextFrame(start.time_since_epoch().count(), done);
+		const uint length = std::min(samplesLeft, count - done);
+		generator.Render(current, samples + done, length);
+		samplesLeft -= length;
+		done += length;
+	}
+
+	const double elapsedUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	stats.Callbacks++;
+	stats.CallbackSumUs += elapsedUs;
+	stats.CallbackMaxUs = std::max(stats.CallbackMaxUs, elapsedUs);
+}
+
+// Starts the next frame, offset samples into a callback that began at now. While buffering, or
+// after an underrun, that is the current frame once more.
+void AudioStream::NextFrame(Clock::rep now, uint offset)
+{
+	samplesLeft = AUDIO_SAMPLES_PER_FRAME;
+	uint32_t queued = ring.GetQueued();
+	if (buffering)
+	{
+		if (queued < stats.QueueTarget)
+			return;
+		buffering = false;
+		fill = queued;
+	}
+	else if (queued == 0)
+	{
+		stats.Underruns++;
+		stats.QueueTarget = std::min(stats.QueueTarget + 1, (uint)AUDIO_MAX_QUEUE_FRAMES);
+		cleanFrames = 0;
+		buffering = true;
+		return;
+	}
+	else if (queued > stats.QueueTarget + AUDIO_DRIFT_FRAMES)
+	{
+		ring.Skip(queued - stats.QueueTarget);
+		stats.FramesSkipped += queued - stats.QueueTarget;
+		queued = fill = stats.QueueTarget;
+	}
+
+	if (++cleanFrames == AUDIO_TARGET_DECAY_FRAMES && stats.QueueTarget > AUDIO_MIN_QUEUE_FRAMES)
+	{
+		stats.QueueTarget--;
+		cleanFrames = 0;
+	}
+
+	fill += (queued - fill) / AUDIO_FILL_SMOOTHING;
+	const double stretch = std::clamp(stats.QueueTarget / std::max(fill, 0.5), AUDIO_MIN_STRETCH, AUDIO_MAX_STRETCH);
+	samplesLeft = (uint)(AUDIO_SAMPLES_PER_FRAME * stretch);
+
+	ring.Pop(current);
+	stats.FramesPlayed++;
+	const double latencyMs = std::chrono::duration<double, std::milli>(Clock::duration(now - current.Pushed)).count() + offset * 1000.0 / AUDIO_SAMPLE_RATE;
+	stats.LatencySumMs += latencyMs;
+	stats.LatencyMaxMs = std::max(stats.LatencyMaxMs, latencyMs);
+}
+
+void AudioStream::PrintStats(uint deviceSamples) const
+{
+	if (stats.Callbacks == 0)
+		return;
+
+	std::cout << "audio callbacks:  " << stats.Callbacks << ", " << stats.CallbackSumUs / stats.Callbacks << " / " << stats.CallbackMaxUs << " us avg/max\n";
+	if (stats.FramesPlayed > 0)
+		std::cout << "audio latency:    " << stats.LatencySumMs / stats.FramesPlayed << " / " << stats.LatencyMaxMs << " ms avg/max, plus "
+				  << deviceSamples * 1000.0 / AUDIO_SAMPLE_RATE << " ms of device buffer\n";
+	std::cout << "audio underruns:  " << stats.Underruns << " (queue target " << stats.QueueTarget << " frames)\n";
+	std::cout << "frames skipped:   " << stats.FramesSkipped << " by the callback, " << framesDropped << " dropped by a full ring\n";
+	std::cout.flush();
+}
+
+WavWriter::WavWriter(const std::string &path)
+{
+	file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot write the audio " + path);
+	WriteHeader();
+}
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+void WavWriter::WriteHeader()
+{
+	const uint32_t dataBytes = samples * sizeof(int16_t);
+	fwrite("RIFF", 1, 4, file);
+	Put(file, 36 + dataBytes, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	Put(file, 16, 4); // format chunk size
+	Put(file, 1, 2);  // PCM
+	Put(file, 1, 2);  // channels
+	Put(file, AUDIO_SAMPLE_RATE, 4);
+	Put(file, AUDIO_SAMPLE_RATE * sizeof(int16_t), 4);
+	Put(file, sizeof(int16_t), 2);
+	Put(file, 16, 2);
+	fwrite("data", 1, 4, file);
+	Put(file, dataBytes, 4);
+}
+
+// Samples are little-endian on disk, as the host writes them.
+void WavWriter::Write(const int16_t *data, uint count)
+{
+	if (fwrite(data, sizeof(int16_t), count, file) != count)
+		throw std::runtime_error("Could not write the audio.");
+	samples += count;
+}
+
+void WavWriter::Close()
+{
+	if (file == nullptr)
+		return;
+	fseek(file, 0, SEEK_SET);
+	WriteHeader();
+	fclose(file);
+	file = nullptr;
+}
\ No newline at end of file
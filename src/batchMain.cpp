@@ -0,0 +1,90 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "batchRunner.h"
+
+using namespace std;
+
+void printUsage();
+
+// chip8_batch [--threads N] [--engine E] [--frames N] [--skip-idle] [--output results.csv] <manifest | rom directory>
+int main(int argc, char *argv[])
+{
+	uint threads = thread::hardware_concurrency();
+	Engine engine = Engine::Interpreter;
+	uint64_t frames = 600;
+	bool skipIdle = false;
+	string outputPath = "";
+	string source = "";
+
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc)
+			threads = stoul(argv[++i]);
+		else if (arg == "--engine" && i + 1 < argc)
+		{
+			if (!EngineFromName(argv[++i], engine))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+			frames = stoull(argv[++i]);
+		else if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (arg == "--skip-idle")
+			skipIdle = true;
+		else if (source.empty() && arg[0] != '-')
+			source = arg;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (source.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	const vector<BatchJob> jobs = filesystem::is_directory(source) ? BatchRunner::JobsFromDirectory(source, frames)
+																   : BatchRunner::LoadManifest(source);
+
+	const auto start = chrono::steady_clock::now();
+	const vector<BatchResult> results = BatchRunner(threads, engine, skipIdle).Run(jobs);
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if (outputPath.empty())
+		BatchRunner::WriteCsv(cout, results);
+	else
+	{
+		ofstream output(outputPath);
+		BatchRunner::WriteCsv(output, results);
+	}
+
+	uint64_t instructions = 0;
+	uint failed = 0;
+	for (const BatchResult &result : results)
+	{
+		instructions += result.Instructions;
+		failed += !result.Error.empty();
+	}
+	cerr << jobs.size() << " jobs (" << failed << " failed) on " << threads << " threads in " << seconds << " s, "
+		 << (uint64_t)(seconds > 0 ? instructions / seconds : 0) << " ins/sec" << endl;
+
+	return failed > 0 ? 2 : 0;
+}
+
+void printUsage()
+{
+	cout << "Usage: chip8_batch [--threads N] [--engine interpreter|cached|jit|jit-checked|aot] [--frames N] [--skip-idle] [--output file.csv] <manifest | rom directory>\n";
+	cout << "Manifest lines: <rom> <frames> [input script | movie.c8m]\n";
+	cout << "A movie replaces the frame count and checks the final state it recorded\n";
+	cout << "Input script lines: <frame> <hex keypad mask held from that frame on>" << endl;
+}
@@ -0,0 +1,257 @@
+#include "batchRunner.h"
+#include "movie.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	class WorkQueue
+	{
+		std::mutex lock;
+		std::deque<size_t> jobs;
+
+	public:
+		void Push(size_t job)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.push_back(job);
+		}
+
+		bool PopBack(size_t &job)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (jobs.empty())
+				return false;
+			job = jobs.back();
+			jobs.pop_back();
+			return true;
+		}
+
+		bool StealFront(size_t &job)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (jobs.empty())
+				return false;
+			job = jobs.front();
+			jobs.pop_front();
+			return true;
+		}
+	};
+}
+
+BatchRunner::BatchRunner(uint threadCountArg, Engine engineArg, bool skipIdleArg)
+{
+	threadCount = threadCountArg > 0 ? threadCountArg : 1;
+	engine = engineArg;
+	skipIdle = skipIdleArg;
+}
+
+std::vector<BatchResult> BatchRunner::Run(const std::vector<BatchJob> &jobs) const
+{
+	std::vector<BatchResult> results(jobs.size());
+	std::vector<WorkQueue> queues(threadCount);
+	for (size_t i = 0; i < jobs.size(); i++)
+		queues[i % threadCount].Push(i);
+
+	auto worker = [&](uint self)
+	{
+		size_t job;
+		while (true)
+		{
+			bool found = queues[self].PopBack(job);
+			for (uint other = 1; !found && other < threadCount; other++)
+				found = queues[(self + other) % threadCount].StealFront(job);
+			if (!found)
+				return; // no job is ever added after the start, so empty everywhere means done.
+
+			results[job] = RunJob(jobs[job], engine, skipIdle);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint i = 0; i < threadCount; i++)
+		threads.emplace_back(worker, i);
+	for (std::thread &thread : threads)
+		thread.join();
+
+	return results;
+}
+
+BatchResult BatchRunner::RunJob(const BatchJob &job, Engine engine, bool skipIdle)
+{
+	BatchResult result;
+	result.Job = job;
+
+	const auto start = std::chrono::steady_clock::now();
+	try
+	{
+		if (IsMovie(job.ScriptPath))
+		{
+			const Movie movie = Movie::Load(job.ScriptPath);
+			std::unique_ptr<Machine> chip8(new Machine());
+			chip8->SetEngine(engine);
+			chip8->SetIdleSkip(skipIdle);
+			if (!movie.Play(*chip8, job.RomPath))
+				result.Error = "final state differs from the movie";
+			result.Instructions = chip8->GetInstructionCount();
+			result.DisplayHash = HashDisplay(*chip8);
+			result.SkippedInstructions = chip8->GetIdleStats().SkippedInstructions;
+			result.Job.Frames = movie.GetHeader().Frames;
+		}
+		else
+		{
+			const InputScript script = job.ScriptPath.empty() ? InputScript() : LoadInputScript(job.ScriptPath);
+			size_t nextInput = 0;
+
+			std::unique_ptr<Machine> chip8(new Machine());
+			chip8->SetEngine(engine);
+			chip8->SetIdleSkip(skipIdle);
+			chip8->LoadRom(job.RomPath);
+
+			for (uint64_t frame = 0; frame < job.Frames; frame++)
+			{
+				while (nextInput < script.size() && script[nextInput].first <= frame)
+				{
+					chip8->SetKeys(script[nextInput].second);
+					nextInput++;
+				}
+
+				result.Instructions += chip8->RunFrames(1);
+			}
+
+			result.DisplayHash = HashDisplay(*chip8);
+			result.SkippedInstructions = chip8->GetIdleStats().SkippedInstructions;
+		}
+	}
+	catch (const std::exception &error)
+	{
+		result.Error = error.what();
+	}
+	result.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// "<rom> <frames> [input script | movie]" per line, '#' starts a comment. Relative paths are taken from the manifest's directory.
+std::vector<BatchJob> BatchRunner::LoadManifest(const std::string &filePath)
+{
+	std::ifstream file(filePath);
+	if (!file.good())
+		throw std::runtime_error("Could not open manifest " + filePath);
+
+	const std::filesystem::path base = std::filesystem::path(filePath).parent_path();
+	auto resolve = [&](const std::string &path)
+	{
+		const std::filesystem::path fsPath(path);
+		return fsPath.is_absolute() ? path : (base / fsPath).string();
+	};
+
+	std::vector<BatchJob> jobs;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		BatchJob job;
+		std::string rom;
+		if (!(fields >> rom))
+			continue;
+		if (!(fields >> job.Frames))
+			throw std::runtime_error("Manifest line without a frame count: " + line);
+
+		std::string script;
+		job.RomPath = resolve(rom);
+		if (fields >> script)
+			job.ScriptPath = resolve(script);
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+std::vector<BatchJob> BatchRunner::JobsFromDirectory(const std::string &directory, uint64_t frames)
+{
+	std::vector<BatchJob> jobs;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory))
+	{
+		if (!entry.is_regular_file() || !IsRomFileName(entry.path().string()))
+			continue;
+		BatchJob job;
+		job.RomPath = entry.path().string();
+		job.Frames = frames;
+		jobs.push_back(job);
+	}
+	std::sort(jobs.begin(), jobs.end(), [](const BatchJob &a, const BatchJob &b)
+			  { return a.RomPath < b.RomPath; });
+	return jobs;
+}
+
+BatchRunner::InputScript BatchRunner::LoadInputScript(const std::string &filePath)
+{
+	std::ifstream file(filePath);
+	if (!file.good())
+		throw std::runtime_error("Could not open input script " + filePath);
+
+	InputScript script;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		uint64_t frame;
+		uint mask;
+		if (fields >> frame >> std::hex >> mask)
+			script.emplace_back(frame, (uint16_t)mask);
+	}
+	std::stable_sort(script.begin(), script.end(), [](const auto &a, const auto &b)
+					 { return a.first < b.first; });
+	return script;
+}
+
+bool BatchRunner::IsMovie(const std::string &scriptPath)
+{
+	return std::filesystem::path(scriptPath).extension() == MOVIE_EXTENSION;
+}
+
+// FNV-1a over the display rows, the right halves following in hi-res.
+uint64_t BatchRunner::HashDisplay(const Machine &machine)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	// An XO-CHIP machine's second plane follows the first.
+	const XoChipState *xo = machine.GetXoChipState();
+	const uint64_t *halves[] = {machine.GetDisplay(), machine.GetDisplayRight(), xo ? xo->bPlane : nullptr, xo ? xo->bPlaneRight : nullptr};
+	for (uint half = 0; half < (xo ? 4u : 2u); half++)
+	{
+		if (half % 2 == 1 && !machine.IsHiRes())
+			continue;
+		for (uint row = 0; row < machine.GetDisplayHeight(); row++)
+		{
+			for (uint byte = 0; byte < 8; byte++)
+			{
+				hash ^= (halves[half][row] >> (56 - byte * 8)) & 0xFF;
+				hash *= 0x100000001B3ull;
+			}
+		}
+	}
+	return hash;
+}
+
+void BatchRunner::WriteCsv(std::ostream &out, const std::vector<BatchResult> &results)
+{
+	out << "rom,script,frames,instructions,skipped,wall_ms,display_hash,error\n";
+	for (const BatchResult &result : results)
+	{
+		std::string error = result.Error;
+		std::replace(error.begin(), error.end(), ',', ';');
+		out << result.Job.RomPath << ',' << result.Job.ScriptPath << ',' << result.Job.Frames << ','
+			<< result.Instructions << ',' << result.SkippedInstructions << ',' << result.WallSeconds * 1000 << ','
+			<< std::hex << result.DisplayHash << std::dec << ',' << error << '\n';
+	}
+}
@@ -0,0 +1,113 @@
+#include "blockCache.h"
+
+BlockCache::BlockCache(const Instruction *decodeTableArg, const uint8_t *memoryArg)
+{
+	decodeTable = decodeTableArg;
+	memory = memoryArg;
+	Flush();
+}
+
+const BlockCache::Block &BlockCache::Lookup(uint16_t address)
+{
+	int slot = blockAt[address];
+	if (slot >= 0)
+		stats.Hits++;
+	else
+	{
+		stats.Misses++;
+		slot = Build(address);
+	}
+	return blocks[slot];
+}
+
+int BlockCache::Build(uint16_t address)
+{
+	int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = blocks.size();
+		blocks.emplace_back();
+	}
+
+	Block &block = blocks[slot];
+	block.Start = address;
+	block.Code.clear();
+
+	uint pc = address;
+	while (pc + 1 < MEMORY_SIZE && block.Code.size() < BLOCK_MAX_LENGTH)
+	{
+		const uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
+		block.Code.push_back(&decodeTable[opcode]);
+		covered[pc] = covered[pc + 1] = true;
+		pc += 2;
+		if (EndsBlock(opcode))
+			break;
+	}
+
+	block.End = pc;
+	blockAt[address] = slot;
+	return slot;
+}
+
+bool BlockCache::EndsBlock(uint16_t opcode)
+{
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		return opcode != 0x00E0; // RET, or an invalid opcode.
+	case 0x1:
+	case 0x2:
+	case 0x3:
+	case 0x4:
+	case 0x5:
+	case 0x9:
+	case 0xB:
+	case 0xE:
+		return true;
+	case 0xF:
+	{
+		const uint type = opcode & 0xFF;
+		return type == 0x0A || type == 0x33 || type == 0x55;
+	}
+	default:
+		return false;
+	}
+}
+
+void BlockCache::Invalidate(uint address, uint length)
+{
+	bool hit = false;
+	for (uint i = address; i < address + length && i < MEMORY_SIZE; i++)
+		hit |= covered[i];
+	if (!hit)
+		return;
+
+	for (int slot = 0; slot < (int)blocks.size(); slot++)
+	{
+		Block &block = blocks[slot];
+		if (blockAt[block.Start] != slot)
+			continue;
+		if (block.Start < address + length && address < block.End)
+		{
+			blockAt[block.Start] = -1;
+			freeSlots.push_back(slot);
+			stats.Invalidations++;
+		}
+	}
+}
+
+void BlockCache::Flush()
+{
+	blocks.clear();
+	freeSlots.clear();
+	for (uint i = 0; i < MEMORY_SIZE; i++)
+	{
+		blockAt[i] = -1;
+		covered[i] = false;
+	}
+}
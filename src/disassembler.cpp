@@ -0,0 +1,171 @@
+#include "disassembler.h"
+
+#include <cstdio>
+
+const char *OpcodePattern(uint16_t opcode)
+{
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		if (opcode == 0x00E0)
+			return "00E0 CLS";
+		if (opcode == 0x00EE)
+			return "00EE RET";
+		if ((opcode & 0xFFF0) == 0x00C0)
+			return "00CN SCD N";
+		if ((opcode & 0xFFF0) == 0x00D0)
+			return "00DN SCU N";
+		switch (opcode)
+		{
+		case 0x00FB:
+			return "00FB SCR";
+		case 0x00FC:
+			return "00FC SCL";
+		case 0x00FD:
+			return "00FD EXIT";
+		case 0x00FE:
+			return "00FE LOW";
+		case 0x00FF:
+			return "00FF HIGH";
+		}
+		return "invalid";
+	case 0x1:
+		return "1NNN JMP NNN";
+	case 0x2:
+		return "2NNN CALL NNN";
+	case 0x3:
+		return "3XNN SE Vx, NN";
+	case 0x4:
+		return "4XNN SNE Vx, NN";
+	case 0x5:
+		switch (opcode & 0xF)
+		{
+		case 0x0:
+			return "5XY0 SE Vx, Vy";
+		case 0x2:
+			return "5XY2 LD [I], Vx-Vy";
+		case 0x3:
+			return "5XY3 LD Vx-Vy, [I]";
+		default:
+			return "invalid";
+		}
+	case 0x6:
+		return "6XNN LD Vx, NN";
+	case 0x7:
+		return "7XNN ADD Vx, NN";
+	case 0x8:
+		switch (opcode & 0xF)
+		{
+		case 0x0:
+			return "8XY0 LD Vx, Vy";
+		case 0x1:
+			return "8XY1 OR Vx, Vy";
+		case 0x2:
+			return "8XY2 AND Vx, Vy";
+		case 0x3:
+			return "8XY3 XOR Vx, Vy";
+		case 0x4:
+			return "8XY4 ADD Vx, Vy";
+		case 0x5:
+			return "8XY5 SUB Vx, Vy";
+		case 0x6:
+			return "8XY6 SHR Vx";
+		case 0x7:
+			return "8XY7 SUBN Vx, Vy";
+		case 0xE:
+			return "8XYE SHL Vx";
+		default:
+			return "invalid";
+		}
+	case 0x9:
+		return (opcode & 0xF) == 0 ? "9XY0 SNE Vx, Vy" : "invalid";
+	case 0xA:
+		return "ANNN LD I, NNN";
+	case 0xB:
+		return "BNNN JMP V0, NNN";
+	case 0xC:
+		return "CXNN RND Vx, NN";
+	case 0xD:
+		return (opcode & 0xF) == 0 ? "DXY0 DRW Vx, Vy, 0" : "DXYN DRW Vx, Vy, N";
+	case 0xE:
+		if ((opcode & 0xFF) == 0x9E)
+			return "EX9E SKP Vx";
+		if ((opcode & 0xFF) == 0xA1)
+			return "EXA1 SKNP Vx";
+		return "invalid";
+	default:
+		if (opcode == 0xF000)
+			return "F000 LD I, long"; // the address is the next word.
+		if (opcode == 0xF002)
+			return "F002 AUDIO";
+		switch (opcode & 0xFF)
+		{
+		case 0x01:
+			return "FN01 PLANE x";
+		case 0x07:
+			return "FX07 LD Vx, DT";
+		case 0x0A:
+			return "FX0A LD Vx, K";
+		case 0x15:
+			return "FX15 LD DT, Vx";
+		case 0x18:
+			return "FX18 LD ST, Vx";
+		case 0x1E:
+			return "FX1E ADD I, Vx";
+		case 0x29:
+			return "FX29 LD F, Vx";
+		case 0x30:
+			return "FX30 LD HF, Vx";
+		case 0x33:
+			return "FX33 LD B, Vx";
+		case 0x3A:
+			return "FX3A PITCH Vx";
+		case 0x55:
+			return "FX55 LD [I], Vx";
+		case 0x65:
+			return "FX65 LD Vx, [I]";
+		case 0x75:
+			return "FX75 LD R, Vx";
+		case 0x85:
+			return "FX85 LD Vx, R";
+		default:
+			return "invalid";
+		}
+	}
+}
+
+// The pattern's mnemonic with X, Y, N, NN and NNN filled in.
+std::string Disassemble(uint16_t opcode)
+{
+	const char *pattern = OpcodePattern(opcode);
+	char hexOpcode[8];
+	snprintf(hexOpcode, sizeof(hexOpcode), "%04X", opcode);
+	if (pattern[0] == 'i')
+		return std::string("DW 0x") + hexOpcode;
+
+	std::string text;
+	for (const char *c = pattern + 5; *c; c++)
+	{
+		char field[8] = "";
+		if (c[0] == 'N' && c[1] == 'N' && c[2] == 'N')
+		{
+			snprintf(field, sizeof(field), "0x%03X", opcode & 0xFFF);
+			c += 2;
+		}
+		else if (c[0] == 'N' && c[1] == 'N')
+		{
+			snprintf(field, sizeof(field), "0x%02X", opcode & 0xFF);
+			c += 1;
+		}
+		else if (c[0] == 'N' && c[-1] == ' ')
+			snprintf(field, sizeof(field), "%X", opcode & 0xF);
+		else if (c[0] == 'x')
+			snprintf(field, sizeof(field), "%X", (opcode >> 8) & 0xF);
+		else if (c[0] == 'y')
+			snprintf(field, sizeof(field), "%X", (opcode >> 4) & 0xF);
+		else
+			field[0] = *c;
+		text += field;
+	}
+	return text;
+}
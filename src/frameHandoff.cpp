@@ -0,0 +1,16 @@
+#include "frameHandoff.h"
+
+void FrameHandoff::Publish()
+{
+	// Release makes the frame's contents visible before its index; acquire takes over the
+	// slot the consumer may have just finished reading.
+	back = middle.exchange(back | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+}
+
+bool FrameHandoff::Acquire()
+{
+	if ((middle.load(std::memory_order_relaxed) & FreshBit) == 0)
+		return false;
+	front = middle.exchange(front, std::memory_order_acq_rel) & ~FreshBit;
+	return true;
+}
@@ -0,0 +1,123 @@
+#include "frameScheduler.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+FrameScheduler::FrameScheduler(uint instructionsPerFrameArg, bool turboArg)
+{
+	if (instructionsPerFrameArg == 0)
+		throw std::invalid_argument("At least one instruction per frame is needed.");
+
+	instructionsPerFrame = instructionsPerFrameArg;
+	turbo = turboArg;
+	framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / FRAME_RATE));
+	Restart();
+}
+
+void FrameScheduler::Restart()
+{
+	stats = SchedulerStats();
+	start = Clock::now();
+	deadline = start + framePeriod;
+	lastFrameStart = start;
+	aligned = false;
+}
+
+void FrameScheduler::SetTurbo(bool turboArg)
+{
+	turbo = turboArg;
+	deadline = Clock::now() + framePeriod; // throttling resumes from now, not from the old schedule.
+}
+
+void FrameScheduler::RunFrame(Machine &machine)
+{
+	Profiler *profiler = machine.GetProfiler();
+	const Clock::time_point start = profiler ? Clock::now() : Clock::time_point();
+	stats.Instructions += machine.Step(instructionsPerFrame);
+	machine.TickTimers();
+	if (profiler)
+		profiler->AddCpuTime(std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+void FrameScheduler::AlignTo(Clock::time_point reference, Clock::duration lead)
+{
+	if (turbo)
+		return;
+
+	const Clock::rep period = framePeriod.count();
+	Clock::rep error = ((reference - lead - deadline).count() % period + period) % period;
+	if (error > period / 2)
+		error -= period;
+	deadline += Clock::duration(aligned ? error / FRAME_ALIGN_DAMPING : error);
+	aligned = true;
+}
+
+void FrameScheduler::WaitUntil(Clock::time_point time) const
+{
+	const Clock::time_point wake = time - std::chrono::microseconds(FRAME_SPIN_MICROS);
+	if (Clock::now() < wake)
+		std::this_thread::sleep_until(wake);
+	while (Clock::now() < time)
+		std::this_thread::yield();
+}
+
+void FrameScheduler::EndFrame()
+{
+	stats.Frames++;
+
+	if (!turbo)
+	{
+		if (Clock::now() > deadline + FRAME_MAX_LAG * framePeriod)
+		{
+			deadline = Clock::now();
+			stats.Resyncs++;
+		}
+		WaitUntil(deadline);
+	}
+
+	const Clock::time_point now = Clock::now();
+	const double periodMs = std::chrono::duration<double, std::milli>(now - lastFrameStart).count();
+	stats.PeriodSumMs += periodMs;
+	stats.PeriodSquareSumMs += periodMs * periodMs;
+	if (!turbo)
+	{
+		const double latenessMs = std::chrono::duration<double, std::milli>(now - deadline).count();
+		stats.LatenessSumMs += latenessMs;
+		if (latenessMs > stats.LatenessMaxMs)
+			stats.LatenessMaxMs = latenessMs;
+		deadline += framePeriod;
+	}
+	lastFrameStart = now;
+	stats.WallSeconds = std::chrono::duration<double>(now - start).count();
+}
+
+double FrameScheduler::GetInstructionsPerSecond() const
+{
+	return stats.WallSeconds > 0 ? stats.Instructions / stats.WallSeconds : 0;
+}
+
+double FrameScheduler::GetJitterMs() const
+{
+	if (stats.Frames == 0)
+		return 0;
+	const double mean = stats.PeriodSumMs / stats.Frames;
+	const double variance = stats.PeriodSquareSumMs / stats.Frames - mean * mean;
+	return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+void FrameScheduler::PrintStats() const
+{
+	if (stats.Frames == 0)
+		return;
+
+	std::cout << "frames:           " << stats.Frames << (turbo ? " (turbo)" : "") << "\n";
+	std::cout << "ins/sec:          " << (uint64_t)GetInstructionsPerSecond() << " (" << instructionsPerFrame << " per frame)\n";
+	std::cout << "frames/sec:       " << stats.Frames / stats.WallSeconds << "\n";
+	std::cout << "frame period:     " << stats.PeriodSumMs / stats.Frames << " ms, jitter " << GetJitterMs() << " ms\n";
+	if (!turbo)
+		std::cout << "late avg/max:     " << stats.LatenessSumMs / stats.Frames << " / " << stats.LatenessMaxMs << " ms, " << stats.Resyncs << " resyncs" << std::endl;
+	std::cout.flush();
+}
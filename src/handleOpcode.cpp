@@ -2,216 +2,275 @@
 
 #include "machine.h"
 
+#include <vector>
+
 /*
-/ This way of handling opcodes is naive. At least there is not too much of them.
+/ Every possible opcode is decoded once into a table, so executing an instruction
+/ is a single lookup followed by an indirect call. Each quirk profile has its own
+/ table, pointing at the handlers instantiated for it.
 */
 
-void Machine::HandleOpcode(uint16_t opcode)
+namespace
 {
-	const int group = GetValueFromBits(opcode, 0, 4);
-	switch (group)
+	template <void (Machine::*Op)()>
+	void Call(Machine &machine, const Instruction &)
 	{
+		(machine.*Op)();
+	}
 
-	case 0:
+	template <void (Machine::*Op)(uint)>
+	void CallNNN(Machine &machine, const Instruction &ins)
 	{
-		const int rest = GetValueFromBits(opcode, 4, 12);
-		if (rest == 0x0E0)
-			CLS();
-		else if (rest == 0x0EE)
-			RET();
-		else NoSuchOpcode(opcode);
+		(machine.*Op)(ins.NNN);
 	}
-	break;
 
-	case 1:
+	template <void (Machine::*Op)(uint)>
+	void CallN(Machine &machine, const Instruction &ins)
 	{
-		const int address = GetValueFromBits(opcode, 4, 12);
-		JMP(address);
+		(machine.*Op)(ins.N);
 	}
-	break;
 
-	case 2:
+	template <void (Machine::*Op)(uint)>
+	void CallX(Machine &machine, const Instruction &ins)
 	{
-		const int address = GetValueFromBits(opcode, 4, 12);
-		CALL_NNN(address);
+		(machine.*Op)(ins.X);
 	}
-	break;
 
-	case 3:
+	template <void (Machine::*Op)(uint, uint)>
+	void CallXNN(Machine &machine, const Instruction &ins)
 	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int value = GetValueFromBits(opcode, 8, 8);
-		SE_XNN(X, value);
+		(machine.*Op)(ins.X, ins.NN);
 	}
-	break;
 
-	case 4:
+	template <void (Machine::*Op)(uint, uint)>
+	void CallXY(Machine &machine, const Instruction &ins)
 	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int value = GetValueFromBits(opcode, 8, 8);
-		SNE_XNN(X, value);
+		(machine.*Op)(ins.X, ins.Y);
 	}
-	break;
 
-	case 5:
+	template <void (Machine::*Op)(uint, uint, uint)>
+	void CallXYN(Machine &machine, const Instruction &ins)
 	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int Y = GetValueFromBits(opcode, 8, 4);
-		SE_XY(X, Y);
+		(machine.*Op)(ins.X, ins.Y, ins.N);
 	}
-	break;
+}
 
-	case 6:
+void Machine::HandleOpcode(uint16_t opcode)
+{
+	const Instruction &ins = decodeTable[opcode];
+	ins.Handler(*this, ins);
+}
+
+template <class Quirks>
+const Instruction *Machine::GetDecodeTable()
+{
+	static const std::vector<Instruction> table = []
 	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int value = GetValueFromBits(opcode, 8, 8);
-		LD_XNN(X, value);
-	}
-	break;
+		std::vector<Instruction> decoded(OPCODES_COUNT);
+		for (uint opcode = 0; opcode < OPCODES_COUNT; opcode++)
+			decoded[opcode] = DecodeOpcode<Quirks>(opcode);
+		return decoded;
+	}();
+	return table.data();
+}
 
-	case 7:
+const Instruction *Machine::GetDecodeTable(QuirkProfile profile)
+{
+	return VisitQuirks(profile, [](auto quirks)
+					   { return GetDecodeTable<decltype(quirks)>(); });
+}
+
+void Machine::InvalidOpcode(Machine &, const Instruction &ins)
+{
+	NoSuchOpcode(ins.Opcode);
+}
+
+template <class Quirks>
+Instruction Machine::DecodeOpcode(uint16_t opcode)
+{
+	Instruction ins;
+	ins.Handler = InvalidOpcode;
+	ins.Opcode = opcode;
+	ins.NNN = GetValueFromBits(opcode, 4, 12);
+	ins.X = GetValueFromBits(opcode, 4, 4);
+	ins.Y = GetValueFromBits(opcode, 8, 4);
+	ins.N = GetValueFromBits(opcode, 12, 4);
+	ins.NN = GetValueFromBits(opcode, 8, 8);
+
+	const int group = GetValueFromBits(opcode, 0, 4);
+	switch (group)
 	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int value = GetValueFromBits(opcode, 8, 8);
-		ADD_XNN(X, value);
-	}
-	break;
+	case 0:
+		if (ins.NNN == 0x0E0)
+			ins.Handler = Call<&Machine::CLS<Quirks>>;
+		else if (ins.NNN == 0x0EE)
+			ins.Handler = Call<&Machine::RET>;
+		else if ((ins.NNN & 0xFF0) == 0x0C0)
+			ins.Handler = CallN<&Machine::SCD_N<Quirks>>;
+		else if ((ins.NNN & 0xFF0) == 0x0D0 && Quirks::XoChip)
+			ins.Handler = CallN<&Machine::SCU_N>;
+		else if (ins.NNN == 0x0FB)
+			ins.Handler = Call<&Machine::SCR<Quirks>>;
+		else if (ins.NNN == 0x0FC)
+			ins.Handler = Call<&Machine::SCL<Quirks>>;
+		else if (ins.NNN == 0x0FD)
+			ins.Handler = Call<&Machine::EXIT>;
+		else if (ins.NNN == 0x0FE)
+			ins.Handler = Call<&Machine::LOW>;
+		else if (ins.NNN == 0x0FF)
+			ins.Handler = Call<&Machine::HIGH>;
+		break;
 
-	case 8:
-	{	
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int Y = GetValueFromBits(opcode, 8, 4);
-		const int instructionType = GetValueFromBits(opcode, 12, 4);
+	case 1:
+		ins.Handler = CallNNN<&Machine::JMP>;
+		break;
+
+	case 2:
+		ins.Handler = CallNNN<&Machine::CALL_NNN>;
+		break;
+
+	case 3:
+		ins.Handler = CallXNN<&Machine::SE_XNN<Quirks>>;
+		break;
+
+	case 4:
+		ins.Handler = CallXNN<&Machine::SNE_XNN<Quirks>>;
+		break;
+
+	case 5:
+		if (ins.N == 0)
+			ins.Handler = CallXY<&Machine::SE_XY<Quirks>>;
+		else if (ins.N == 2 && Quirks::XoChip)
+			ins.Handler = CallXY<&Machine::LD_IXY>;
+		else if (ins.N == 3 && Quirks::XoChip)
+			ins.Handler = CallXY<&Machine::LD_XYI>;
+		else
+			ins.Handler = CallXY<&Machine::SE_XY<Quirks>>;
+		break;
+
+	case 6:
+		ins.Handler = CallXNN<&Machine::LD_XNN>;
+		break;
+
+	case 7:
+		ins.Handler = CallXNN<&Machine::ADD_XNN>;
+		break;
 
-		switch (instructionType)
+	case 8:
+		switch (ins.N)
 		{
 		case 0:
-			LD_XY(X, Y);
+			ins.Handler = CallXY<&Machine::LD_XY>;
 			break;
 		case 1:
-			OR_XY(X, Y);
+			ins.Handler = CallXY<&Machine::OR_XY<Quirks>>;
 			break;
 		case 2:
-			AND_XY(X, Y);
+			ins.Handler = CallXY<&Machine::AND_XY<Quirks>>;
 			break;
 		case 3:
-			XOR_XY(X, Y);
+			ins.Handler = CallXY<&Machine::XOR_XY<Quirks>>;
 			break;
 		case 4:
-			ADD_XY(X, Y);
+			ins.Handler = CallXY<&Machine::ADD_XY>;
 			break;
 		case 5:
-			SUB_XY(X, Y);
+			ins.Handler = CallXY<&Machine::SUB_XY>;
 			break;
 		case 6:
-			SHR_XY(X, Y);
+			ins.Handler = CallXY<&Machine::SHR_XY<Quirks>>;
 			break;
 		case 7:
-			SUBN_XY(X, Y);
+			ins.Handler = CallXY<&Machine::SUBN_XY>;
 			break;
 		case 0xE:
-			SHL_XY(X, Y);
-			break;
-		default:
-			NoSuchOpcode(opcode);
+			ins.Handler = CallXY<&Machine::SHL_XY<Quirks>>;
 			break;
 		}
-	}
-	break;
+		break;
 
 	case 9:
-	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int Y = GetValueFromBits(opcode, 8, 4);
-		SNE_XY(X, Y);
-	}
-	break;
+		ins.Handler = CallXY<&Machine::SNE_XY<Quirks>>;
+		break;
 
 	case 0xA:
-	{
-		const int address = GetValueFromBits(opcode, 4, 12);
-		LD_INNN(address);
-	}
-	break;
+		ins.Handler = CallNNN<&Machine::LD_INNN>;
+		break;
 
 	case 0xB:
-	{
-		const int address = GetValueFromBits(opcode, 4, 12);
-		JMP_0NNN(address);
-	}
-	break;
+		ins.Handler = CallNNN<&Machine::JMP_0NNN<Quirks>>;
+		break;
 
 	case 0xC:
-	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int value = GetValueFromBits(opcode, 8, 8);
-		RND_XNN(X, value);
-	}
-	break;
+		ins.Handler = CallXNN<&Machine::RND_XNN>;
+		break;
 
 	case 0xD:
-	{
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int Y = GetValueFromBits(opcode, 8, 4);
-		const int value = GetValueFromBits(opcode, 12, 4);
-		DRW_XYN(X, Y, value);
-	}
-	break;
+		if (ins.N == 0)
+			ins.Handler = CallXY<&Machine::DRW_XY0<Quirks>>;
+		else ins.Handler = CallXYN<&Machine::DRW_XYN<Quirks>>;
+		break;
 
 	case 0xE:
-	{	
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int instructionType = GetValueFromBits(opcode, 8, 8);
-		if (instructionType == 0x9E)
-			SKP_X(X);
-		else if (instructionType == 0xA1)
-			SKNP_X(X);
-		else NoSuchOpcode(opcode);
-	}
-	break;
+		if (ins.NN == 0x9E)
+			ins.Handler = CallX<&Machine::SKP_X<Quirks>>;
+		else if (ins.NN == 0xA1)
+			ins.Handler = CallX<&Machine::SKNP_X<Quirks>>;
+		break;
 
 	case 0xF:
-	{	
-		const int X = GetValueFromBits(opcode, 4, 4);
-		const int instructionType = GetValueFromBits(opcode, 8, 8);
-		switch (instructionType)
+		if constexpr (Quirks::XoChip)
+		{
+			if (opcode == 0xF000)
+				ins.Handler = Call<&Machine::LD_INNNN>;
+			else if (ins.NN == 0x01)
+				ins.Handler = CallX<&Machine::PLANE_N>;
+			else if (opcode == 0xF002)
+				ins.Handler = Call<&Machine::AUDIO>;
+			else if (ins.NN == 0x3A)
+				ins.Handler = CallX<&Machine::PITCH_X>;
+		}
+		switch (ins.NN)
 		{
 		case 0x07:
-			LD_XDT(X);
+			ins.Handler = CallX<&Machine::LD_XDT>;
 			break;
 		case 0x0A:
-			LD_XK(X);
+			ins.Handler = CallX<&Machine::LD_XK>;
 			break;
 		case 0x15:
-			LD_DTX(X);
+			ins.Handler = CallX<&Machine::LD_DTX>;
 			break;
 		case 0x18:
-			LD_STX(X);
+			ins.Handler = CallX<&Machine::LD_STX>;
 			break;
 		case 0x1E:
-			ADD_IX(X);
+			ins.Handler = CallX<&Machine::ADD_IX<Quirks>>;
 			break;
 		case 0x29:
-			LD_FX(X);
+			ins.Handler = CallX<&Machine::LD_FX>;
+			break;
+		case 0x30:
+			ins.Handler = CallX<&Machine::LD_HFX>;
 			break;
 		case 0x33:
-			LD_BX(X);
+			ins.Handler = CallX<&Machine::LD_BX<Quirks>>;
 			break;
 		case 0x55:
-			LD_IX(X);
+			ins.Handler = CallX<&Machine::LD_IX<Quirks>>;
 			break;
 		case 0x65:
-			LD_XI(X);
+			ins.Handler = CallX<&Machine::LD_XI<Quirks>>;
 			break;
-		default:
-			NoSuchOpcode(opcode);
+		case 0x75:
+			ins.Handler = CallX<&Machine::LD_RX>;
+			break;
+		case 0x85:
+			ins.Handler = CallX<&Machine::LD_XR>;
 			break;
 		}
-	}
-	break;
-
-	default:
-		
 		break;
 	}
-}
\ No newline at end of file
+
+	return ins;
+}
@@ -0,0 +1,436 @@
+#include "jit.h"
+#include "blockCache.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define JIT_AVAILABLE 1
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+/*
+/ Pinned host registers inside a block:
+/ rbx = Machine *, r12 = Registers, r13 = &IndexRegister, r14 = &ProgramCounter.
+/ Every CHIP-8 statement is translated literally, in the same order as in opcodes.cpp,
+/ so aliasing cases such as X == VF behave exactly like the interpreter.
+*/
+
+#define AL 0
+#define CL 1
+#define DL 2
+
+// Handlers may throw, but an exception cannot unwind through generated code. It is
+// parked here and the block returns early, StepJit rethrows it.
+bool JitCompiler::CallHandler(Machine *machine, const Instruction *ins) noexcept
+{
+	try
+	{
+		ins->Handler(*machine, *ins);
+		return true;
+	}
+	catch (...)
+	{
+		machine->jit->pendingError = std::current_exception();
+		return false;
+	}
+}
+
+void JitCompiler::RethrowPendingError()
+{
+	if (pendingError)
+	{
+		std::exception_ptr error = pendingError;
+		pendingError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+bool JitCompiler::IsSupported()
+{
+	return JIT_AVAILABLE;
+}
+
+JitCompiler::JitCompiler(Machine &machine) : Chip8(machine)
+{
+	if (!IsSupported())
+		throw std::runtime_error("The JIT is only available on x86-64 Unix.");
+
+#if JIT_AVAILABLE
+	void *buffer = mmap(nullptr, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer == MAP_FAILED)
+		throw std::runtime_error("Could not map memory for the JIT.");
+	codeBuffer = static_cast<uint8_t *>(buffer);
+#endif
+
+	Flush();
+	stats.Flushes = 0;
+}
+
+JitCompiler::~JitCompiler()
+{
+#if JIT_AVAILABLE
+	munmap(codeBuffer, JIT_CODE_BUFFER_SIZE);
+#endif
+}
+
+// -1: not compiled yet, -2: could not be compiled.
+const JitCompiler::Block *JitCompiler::Lookup(uint16_t address)
+{
+	const int slot = blockAt[address];
+	if (slot >= 0)
+		return &blocks[slot];
+	if (slot == -2)
+		return nullptr;
+
+	if (heat[address] < JIT_HOT_THRESHOLD)
+	{
+		heat[address]++;
+		return nullptr;
+	}
+
+	if (!Compile(address))
+	{
+		blockAt[address] = -2;
+		return nullptr;
+	}
+	return &blocks[blockAt[address]];
+}
+
+bool JitCompiler::Compile(uint16_t address)
+{
+	code.clear();
+	EmitPrologue();
+
+	uint pc = address;
+	uint length = 0;
+	bool ended = false;
+	while (pc + 1 < MEMORY_SIZE && length < BLOCK_MAX_LENGTH)
+	{
+		const uint16_t opcode = Chip8.Memory[pc] << 8 | Chip8.Memory[pc + 1];
+		const Instruction &ins = Chip8.decodeTable[opcode];
+		if (ins.Handler == Machine::InvalidOpcode) // let the interpreter throw.
+			break;
+
+		ended = BlockCache::EndsBlock(opcode);
+		Translate(pc, ins);
+		pc += 2;
+		length++;
+		if (ended)
+			break;
+	}
+
+	if (length == 0)
+		return false;
+	if (!ended)
+		EmitSetProgramCounter(pc);
+	EmitEpilogue();
+
+	if (codeUsed + code.size() > JIT_CODE_BUFFER_SIZE)
+	{
+		Flush();
+		stats.Flushes++;
+	}
+
+#if JIT_AVAILABLE
+	mprotect(codeBuffer, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE);
+	memcpy(codeBuffer + codeUsed, code.data(), code.size());
+	mprotect(codeBuffer, JIT_CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC);
+#endif
+
+	Block block;
+	block.Entry = reinterpret_cast<NativeCode>(codeBuffer + codeUsed);
+	block.Start = address;
+	block.End = pc;
+	block.Length = length;
+	codeUsed += code.size();
+
+	blockAt[address] = blocks.size();
+	blocks.push_back(block);
+	for (uint i = address; i < pc; i++)
+		covered[i] = true;
+
+	stats.BlocksCompiled++;
+	return true;
+}
+
+void JitCompiler::Translate(uint16_t address, const Instruction &ins)
+{
+	const uint8_t X = ins.X;
+	const uint8_t Y = ins.Y;
+	const QuirkSettings &quirks = GetQuirkSettings(Chip8.quirks);
+
+	switch (ins.Opcode >> 12)
+	{
+	case 0x1: // JMP
+		EmitSetProgramCounter(ins.NNN);
+		return;
+
+	case 0x3: // SE_XNN
+	case 0x4: // SNE_XNN
+		EmitRegister(0x80, 7, X); // cmp byte [VX], NN
+		Emit8(ins.NN);
+		EmitSkip(address, ins.Opcode >> 12 == 0x3);
+		return;
+
+	case 0x5: // SE_XY
+	case 0x9: // SNE_XY
+		EmitRegister(0x8A, AL, X);
+		EmitRegister(0x3A, AL, Y); // cmp al, [VY]
+		EmitSkip(address, ins.Opcode >> 12 == 0x5);
+		return;
+
+	case 0x6: // LD_XNN
+		EmitRegister(0xC6, 0, X);
+		Emit8(ins.NN);
+		return;
+
+	case 0x7: // ADD_XNN
+		EmitRegister(0x80, 0, X);
+		Emit8(ins.NN);
+		return;
+
+	case 0x8:
+		switch (ins.N)
+		{
+		case 0x0: // LD_XY
+			EmitRegister(0x8A, AL, Y);
+			EmitRegister(0x88, AL, X);
+			return;
+		case 0x1: // OR_XY
+		case 0x2: // AND_XY
+		case 0x3: // XOR_XY
+		{
+			const uint8_t operation[] = {0x08, 0x20, 0x30};
+			EmitRegister(0x8A, AL, Y);
+			EmitRegister(operation[ins.N - 1], AL, X);
+			if (quirks.LogicResetsVF)
+			{
+				EmitRegister(0xC6, 0, VF); // mov byte [VF], 0
+				Emit8(0);
+			}
+			return;
+		}
+		case 0x4: // ADD_XY
+			EmitRegister(0x8A, AL, X);
+			EmitRegister(0x02, AL, Y);
+			Emit8(0x0F), Emit8(0x92), Emit8(0xC1); // setc cl
+			EmitRegister(0x88, CL, VF);
+			EmitRegister(0x8A, AL, X);
+			EmitRegister(0x02, AL, Y);
+			EmitRegister(0x88, AL, X);
+			return;
+		case 0x5: // SUB_XY
+		case 0x7: // SUBN_XY
+		{
+			const uint8_t minuend = ins.N == 0x5 ? X : Y;
+			const uint8_t subtrahend = ins.N == 0x5 ? Y : X;
+			EmitRegister(0x8A, AL, minuend);
+			EmitRegister(0x3A, AL, subtrahend);
+			Emit8(0x0F), Emit8(0x93), Emit8(0xC1); // setae cl
+			EmitRegister(0x88, CL, VF);
+			EmitRegister(0x8A, AL, minuend);
+			EmitRegister(0x2A, AL, subtrahend);
+			EmitRegister(0x88, AL, X);
+			return;
+		}
+		case 0x6: // SHR_XY
+			if (quirks.ShiftReadsVY)
+			{
+				EmitRegister(0x8A, AL, Y);
+				Emit8(0x88), Emit8(0xC1);			   // mov cl, al
+				Emit8(0x80), Emit8(0xE1), Emit8(0x01); // and cl, 1
+				Emit8(0xD0), Emit8(0xE8);			   // shr al, 1
+				EmitRegister(0x88, AL, X);
+				EmitRegister(0x88, CL, VF);
+				return;
+			}
+			EmitRegister(0x8A, AL, X);
+			Emit8(0x24), Emit8(0x01); // and al, 1
+			EmitRegister(0x88, AL, VF);
+			EmitRegister(0xD0, 5, X); // shr byte [VX], 1
+			return;
+		case 0xE: // SHL_XY
+			if (quirks.ShiftReadsVY)
+			{
+				EmitRegister(0x8A, AL, Y);
+				Emit8(0x88), Emit8(0xC1);			   // mov cl, al
+				Emit8(0xC0), Emit8(0xE9), Emit8(0x07); // shr cl, 7
+				Emit8(0xD0), Emit8(0xE0);			   // shl al, 1
+				EmitRegister(0x88, AL, X);
+				EmitRegister(0x88, CL, VF);
+				return;
+			}
+			EmitRegister(0x8A, AL, X);
+			Emit8(0xC0), Emit8(0xE8), Emit8(0x07); // shr al, 7
+			EmitRegister(0x88, AL, VF);
+			EmitRegister(0xD0, 4, X); // shl byte [VX], 1
+			return;
+		}
+		break;
+
+	case 0xA: // LD_INNN
+		Emit8(0x66), Emit8(0x41), Emit8(0xC7), Emit8(0x45), Emit8(0x00); // mov word [r13], NNN
+		Emit16(ins.NNN);
+		return;
+
+	case 0xF:
+		if (ins.NN == 0x1E) // ADD_IX
+		{
+			// The first pass only computes VF, for the profiles where FX1E sets it.
+			for (int pass = quirks.AddIndexSetsVF ? 0 : 1; pass < 2; pass++)
+			{
+				Emit8(0x41), Emit8(0x0F), Emit8(0xB7), Emit8(0x45), Emit8(0x00);			 // movzx eax, word [r13]
+				Emit8(0x41), Emit8(0x0F), Emit8(0xB6), Emit8(0x4C), Emit8(0x24), Emit8(X); // movzx ecx, byte [VX]
+				Emit8(0x01), Emit8(0xC8);													 // add eax, ecx
+				if (pass == 0)
+				{
+					Emit8(0x3D), Emit32(0xFFF);			   // cmp eax, 0xFFF
+					Emit8(0x0F), Emit8(0x97), Emit8(0xC2); // seta dl
+					EmitRegister(0x88, DL, VF);
+				}
+			}
+			Emit8(0x66), Emit8(0x41), Emit8(0x89), Emit8(0x45), Emit8(0x00); // mov [r13], ax
+			return;
+		}
+		break;
+	}
+
+	EmitHelperCall(address, ins);
+}
+
+void JitCompiler::EmitHelperCall(uint16_t address, const Instruction &ins)
+{
+	EmitSetProgramCounter(address);
+	Emit8(0x48), Emit8(0x89), Emit8(0xDF); // mov rdi, rbx
+	Emit8(0x48), Emit8(0xBE);			   // mov rsi, imm64
+	Emit64(reinterpret_cast<uint64_t>(&ins));
+	Emit8(0x48), Emit8(0xB8); // mov rax, imm64
+	Emit64(reinterpret_cast<uint64_t>(&CallHandler));
+	Emit8(0xFF), Emit8(0xD0); // call rax
+
+	Emit8(0x84), Emit8(0xC0); // test al, al
+	Emit8(0x75);			  // jne over the early return.
+	const size_t jump = code.size();
+	Emit8(0);
+	EmitEpilogue();
+	code[jump] = code.size() - jump - 1;
+}
+
+void JitCompiler::EmitSetProgramCounter(uint16_t value)
+{
+	Emit8(0x66), Emit8(0x41), Emit8(0xC7), Emit8(0x06); // mov word [r14], imm16
+	Emit16(value);
+}
+
+// Expects the flags of the comparison. mov does not touch them.
+void JitCompiler::EmitSkip(uint16_t address, bool skipIfEqual)
+{
+	EmitSetProgramCounter(address + 2);
+	Emit8(skipIfEqual ? 0x75 : 0x74); // jne / je over the next mov.
+	Emit8(0x06);
+	EmitSetProgramCounter(address + 4);
+}
+
+void JitCompiler::EmitPrologue()
+{
+	Emit8(0x53);						 // push rbx
+	Emit8(0x41), Emit8(0x54);			 // push r12
+	Emit8(0x41), Emit8(0x55);			 // push r13
+	Emit8(0x41), Emit8(0x56);			 // push r14
+	Emit8(0x48), Emit8(0x83), Emit8(0xEC), Emit8(0x08); // sub rsp, 8 (keeps calls 16-byte aligned)
+	Emit8(0x48), Emit8(0x89), Emit8(0xFB); // mov rbx, rdi
+	Emit8(0x49), Emit8(0xBC);			   // mov r12, imm64
+	Emit64(reinterpret_cast<uint64_t>(Chip8.Registers));
+	Emit8(0x49), Emit8(0xBD); // mov r13, imm64
+	Emit64(reinterpret_cast<uint64_t>(&Chip8.IndexRegister));
+	Emit8(0x49), Emit8(0xBE); // mov r14, imm64
+	Emit64(reinterpret_cast<uint64_t>(&Chip8.ProgramCounter));
+}
+
+void JitCompiler::EmitEpilogue()
+{
+	Emit8(0x48), Emit8(0x83), Emit8(0xC4), Emit8(0x08); // add rsp, 8
+	Emit8(0x41), Emit8(0x5E);							 // pop r14
+	Emit8(0x41), Emit8(0x5D);							 // pop r13
+	Emit8(0x41), Emit8(0x5C);							 // pop r12
+	Emit8(0x5B);										 // pop rbx
+	Emit8(0xC3);										 // ret
+}
+
+// op reg, byte [r12 + index]
+void JitCompiler::EmitRegister(uint8_t opcode, uint8_t reg, uint8_t index)
+{
+	Emit8(0x41);
+	Emit8(opcode);
+	Emit8(0x44 | reg << 3);
+	Emit8(0x24);
+	Emit8(index);
+}
+
+void JitCompiler::Emit8(uint8_t value)
+{
+	code.push_back(value);
+}
+
+void JitCompiler::Emit16(uint16_t value)
+{
+	Emit8(value & 0xFF);
+	Emit8(value >> 8);
+}
+
+void JitCompiler::Emit32(uint32_t value)
+{
+	Emit16(value & 0xFFFF);
+	Emit16(value >> 16);
+}
+
+void JitCompiler::Emit64(uint64_t value)
+{
+	Emit32(value & 0xFFFFFFFF);
+	Emit32(value >> 32);
+}
+
+// Compiled code stays mapped until the next flush, so a block that invalidates itself can still return.
+void JitCompiler::Invalidate(uint address, uint length)
+{
+	for (uint i = address; i < address + length && i < MEMORY_SIZE; i++)
+	{
+		heat[i] = 0;
+		if (blockAt[i] == -2)
+			blockAt[i] = -1;
+	}
+
+	bool hit = false;
+	for (uint i = address; i < address + length && i < MEMORY_SIZE; i++)
+		hit |= covered[i];
+	if (!hit)
+		return;
+
+	for (int slot = 0; slot < (int)blocks.size(); slot++)
+	{
+		const Block &block = blocks[slot];
+		if (blockAt[block.Start] != slot)
+			continue;
+		if (block.Start < address + length && address < block.End)
+		{
+			blockAt[block.Start] = -1;
+			heat[block.Start] = 0;
+			stats.Invalidations++;
+		}
+	}
+}
+
+void JitCompiler::Flush()
+{
+	blocks.clear();
+	codeUsed = 0;
+	for (uint i = 0; i < MEMORY_SIZE; i++)
+	{
+		blockAt[i] = -1;
+		heat[i] = 0;
+		covered[i] = false;
+	}
+}
@@ -0,0 +1,491 @@
+#include "lockstep.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+template <typename T>
+LockstepMachines::LaneArray<T>::~LaneArray()
+{
+	std::free(data);
+}
+
+template <typename T>
+void LockstepMachines::LaneArray<T>::Allocate(size_t count)
+{
+	size_t bytes = count * sizeof(T);
+	bytes = (bytes + LOCKSTEP_LANE_ALIGN - 1) / LOCKSTEP_LANE_ALIGN * LOCKSTEP_LANE_ALIGN;
+	data = static_cast<T *>(std::aligned_alloc(LOCKSTEP_LANE_ALIGN, bytes));
+	if (data == nullptr)
+		throw std::bad_alloc();
+	memset(data, 0, bytes);
+}
+
+bool IsLockstepVectorOpcode(uint16_t opcode)
+{
+	switch (opcode >> 12)
+	{
+	case 0x1:
+	case 0x3:
+	case 0x4:
+	case 0x5:
+	case 0x6:
+	case 0x7:
+	case 0x9:
+	case 0xA:
+		return true;
+	case 0x8:
+		return (opcode & 0xF) <= 0x7 || (opcode & 0xF) == 0xE;
+	case 0xE:
+		return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+	case 0xF:
+		switch (opcode & 0xFF)
+		{
+		case 0x07:
+		case 0x15:
+		case 0x18:
+		case 0x1E:
+			return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+static uint SelectLanes(const uint16_t *pc, uint16_t value, uint8_t *done, uint8_t *mask, uint count)
+{
+	uint selected = 0;
+	for (uint lane = 0; lane < count; lane++)
+	{
+		const bool match = pc[lane] == value && done[lane] == 0;
+		mask[lane] = match ? 0xFF : 0;
+		done[lane] |= mask[lane];
+		selected += match;
+	}
+	return selected;
+}
+
+LockstepMachines::LockstepMachines(uint count, const std::string &romPath)
+	: laneCount(count)
+{
+	Machine prototype;
+	prototype.LoadRom(romPath);
+	Initialize(static_cast<const Machine &>(prototype).GetMemory());
+}
+
+LockstepMachines::LockstepMachines(uint count, const uint8_t *program, uint size)
+	: laneCount(count)
+{
+	Machine prototype;
+	prototype.LoadProgram(program, size);
+	Initialize(static_cast<const Machine &>(prototype).GetMemory());
+}
+
+LockstepMachines::~LockstepMachines() = default;
+
+void LockstepMachines::Initialize(const uint8_t *image)
+{
+	if (laneCount == 0)
+		throw std::invalid_argument("LockstepMachines needs at least one lane.");
+
+	const uint padded = (laneCount + LOCKSTEP_LANE_ALIGN - 1) / LOCKSTEP_LANE_ALIGN * LOCKSTEP_LANE_ALIGN;
+	registers.Allocate(16 * padded);
+	programCounters.Allocate(padded);
+	indexRegisters.Allocate(padded);
+	delayTimers.Allocate(padded);
+	soundTimers.Allocate(padded);
+	stackPointers.Allocate(padded);
+	stacks.Allocate(padded * STACK_SIZE);
+	keys.Allocate(padded);
+	randomStates.Allocate(padded);
+	displays.Allocate(padded * DISPLAY_ARRAY_HEIGHT);
+	faulted.Allocate(padded);
+	mask.Allocate(padded);
+	done.Allocate(padded);
+
+	lanes.Count = padded;
+	for (uint index = 0; index < 16; index++)
+		lanes.V[index] = registers.Get() + index * padded;
+	lanes.PC = programCounters.Get();
+	lanes.I = indexRegisters.Get();
+	lanes.DT = delayTimers.Get();
+	lanes.ST = soundTimers.Get();
+	lanes.Keys = keys.Get();
+
+	sharedMemory.assign(image, image + MEMORY_SIZE);
+	memory.assign(laneCount, sharedMemory.data());
+	privateMemory.resize(laneCount);
+
+	for (uint lane = 0; lane < padded; lane++)
+	{
+		programCounters[lane] = 0x200;
+		randomStates[lane] = (lane + 1) * 0x9E3779B9u | 1;
+		faulted[lane] = lane < laneCount ? 0 : 0xFF;
+	}
+
+	kernels = GetAvx2LockstepKernels();
+}
+
+void LockstepMachines::SetVectorized(bool enabled)
+{
+	kernels = enabled ? GetAvx2LockstepKernels() : nullptr;
+}
+
+uint8_t *LockstepMachines::WritableMemory(uint lane)
+{
+	if (!privateMemory[lane])
+	{
+		privateMemory[lane].reset(new uint8_t[MEMORY_SIZE]);
+		memcpy(privateMemory[lane].get(), sharedMemory.data(), MEMORY_SIZE);
+		memory[lane] = privateMemory[lane].get();
+		privateLanes.push_back(lane);
+	}
+	return memory[lane];
+}
+
+void LockstepMachines::Fault(uint lane)
+{
+	faulted[lane] = 0xFF;
+	stats.Faults++;
+}
+
+void LockstepMachines::Step(uint64_t cycles)
+{
+	for (uint64_t cycle = 0; cycle < cycles; cycle++)
+	{
+		stats.Cycles++;
+		if (divergentCycles > 0)
+		{
+			divergentCycles--;
+			stats.DivergentCycles++;
+			StepEachLane();
+		}
+		else
+			StepGrouped();
+	}
+}
+
+void LockstepMachines::StepGrouped()
+{
+	const auto select = kernels ? kernels->Select : SelectLanes;
+	memcpy(done.Get(), faulted.Get(), lanes.Count);
+
+	uint groups = 0;
+	uint leader = 0;
+	while (true)
+	{
+		const uint8_t *next = static_cast<const uint8_t *>(memchr(done.Get() + leader, 0, laneCount - leader));
+		if (next == nullptr)
+			break;
+		leader = next - done.Get();
+
+		const uint16_t address = programCounters[leader];
+		if (address > MEMORY_SIZE - 2)
+		{
+			Fault(leader);
+			done[leader] = 0xFF;
+			continue;
+		}
+		const uint16_t opcode = Fetch(leader, address);
+		groups++;
+
+		// A lane that rewrote its code may hold another opcode at the same address.
+		if (memory[leader] != sharedMemory.data() && opcode != (sharedMemory[address] << 8 | sharedMemory[address + 1]))
+		{
+			done[leader] = 0xFF;
+			ExecuteScalar(leader, opcode);
+			stats.ScalarInstructions++;
+			continue;
+		}
+		uint selected = select(programCounters.Get(), address, done.Get(), mask.Get(), lanes.Count);
+		for (uint lane : privateLanes)
+		{
+			if (mask[lane] != 0 && Fetch(lane, address) != opcode)
+			{
+				mask[lane] = 0;
+				done[lane] = 0;
+				selected--;
+			}
+		}
+
+		if (kernels && IsLockstepVectorOpcode(opcode))
+		{
+			kernels->Execute(lanes, opcode, mask.Get());
+			stats.VectorInstructions += selected;
+		}
+		else
+		{
+			for (uint lane = leader; lane < laneCount && selected > 0; lane++)
+			{
+				if (mask[lane] != 0)
+				{
+					ExecuteScalar(lane, opcode);
+					selected--;
+					stats.ScalarInstructions++;
+				}
+			}
+		}
+	}
+
+	stats.Groups += groups;
+	if (groups > LOCKSTEP_MAX_GROUPS)
+		divergentCycles = LOCKSTEP_REGROUP_INTERVAL;
+}
+
+void LockstepMachines::StepEachLane()
+{
+	for (uint lane = 0; lane < laneCount; lane++)
+	{
+		if (faulted[lane] != 0)
+			continue;
+		const uint16_t address = programCounters[lane];
+		if (address > MEMORY_SIZE - 2)
+		{
+			Fault(lane);
+			continue;
+		}
+		ExecuteScalar(lane, Fetch(lane, address));
+		stats.ScalarInstructions++;
+	}
+}
+
+void LockstepMachines::RunFrames(uint64_t frames)
+{
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		Step(Machine::insPerTimer);
+		TickTimers();
+	}
+}
+
+void LockstepMachines::TickTimers()
+{
+	for (uint lane = 0; lane < lanes.Count; lane++)
+	{
+		delayTimers[lane] -= delayTimers[lane] != 0;
+		soundTimers[lane] -= soundTimers[lane] != 0;
+	}
+}
+
+// Same semantics as the Machine opcode handlers, see opcodes.cpp.
+void LockstepMachines::ExecuteScalar(uint lane, uint16_t opcode)
+{
+	uint8_t &vx = lanes.V[(opcode >> 8) & 0xF][lane];
+	uint8_t &vy = lanes.V[(opcode >> 4) & 0xF][lane];
+	uint8_t &vf = lanes.V[VF][lane];
+	uint16_t &pc = programCounters[lane];
+	uint16_t &index = indexRegisters[lane];
+	uint8_t &sp = stackPointers[lane];
+	uint16_t *stack = &stacks[lane * STACK_SIZE];
+	uint64_t *display = &displays[lane * DISPLAY_ARRAY_HEIGHT];
+	const uint X = (opcode >> 8) & 0xF;
+	const uint NNN = opcode & 0xFFF;
+	const uint NN = opcode & 0xFF;
+	const uint N = opcode & 0xF;
+
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		if (NNN == 0x0E0)
+		{
+			memset(display, 0, DISPLAY_ARRAY_HEIGHT * sizeof(uint64_t));
+			pc += 2;
+		}
+		else if (NNN == 0x0EE && sp != 0)
+		{
+			pc = stack[sp] + 2;
+			sp--;
+		}
+		else
+			Fault(lane);
+		return;
+	case 0x1:
+		pc = NNN;
+		return;
+	case 0x2:
+		if (sp + 1 >= STACK_SIZE)
+		{
+			Fault(lane);
+			return;
+		}
+		sp++;
+		stack[sp] = pc;
+		pc = NNN;
+		return;
+	case 0x3:
+		pc += vx == NN ? 4 : 2;
+		return;
+	case 0x4:
+		pc += vx != NN ? 4 : 2;
+		return;
+	case 0x5:
+		pc += vx == vy ? 4 : 2;
+		return;
+	case 0x6:
+		vx = NN;
+		pc += 2;
+		return;
+	case 0x7:
+		vx += NN;
+		pc += 2;
+		return;
+	case 0x8:
+		switch (N)
+		{
+		case 0x0:
+			vx = vy;
+			break;
+		case 0x1:
+			vx |= vy;
+			break;
+		case 0x2:
+			vx &= vy;
+			break;
+		case 0x3:
+			vx ^= vy;
+			break;
+		case 0x4:
+			vf = vx + vy > 0xFF;
+			vx += vy;
+			break;
+		case 0x5:
+			vf = vx >= vy;
+			vx -= vy;
+			break;
+		case 0x6:
+			vf = vx & 0x01;
+			vx /= 2;
+			break;
+		case 0x7:
+			vf = vy >= vx;
+			vx = vy - vx;
+			break;
+		case 0xE:
+			vf = (vx & 0x80) >> 7;
+			vx *= 2;
+			break;
+		default:
+			Fault(lane);
+			return;
+		}
+		pc += 2;
+		return;
+	case 0x9:
+		pc += vx != vy ? 4 : 2;
+		return;
+	case 0xA:
+		index = NNN;
+		pc += 2;
+		return;
+	case 0xB:
+		pc = lanes.V[0][lane] + NNN;
+		return;
+	case 0xC:
+	{
+		uint32_t &state = randomStates[lane];
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		vx = (state >> 24) & NN;
+		pc += 2;
+		return;
+	}
+	case 0xD:
+	{
+		if (N == 0 || index + N > MEMORY_SIZE) // DXY0 is a SUPER-CHIP sprite.
+		{
+			Fault(lane);
+			return;
+		}
+		const uint8_t *sprites = memory[lane];
+		const uint xcoord = vx % DISPLAY_ARRAY_WIDTH;
+		uint ycoord = vy % DISPLAY_ARRAY_HEIGHT;
+		uint64_t flipped = 0;
+		for (uint row = 0; row < N; row++)
+		{
+			const uint64_t sprite = (uint64_t)sprites[index + row] << (DISPLAY_ARRAY_WIDTH - 8);
+			const uint64_t placed = (sprite >> xcoord) | (sprite << ((DISPLAY_ARRAY_WIDTH - xcoord) % DISPLAY_ARRAY_WIDTH));
+			flipped |= display[ycoord] & placed;
+			display[ycoord] ^= placed;
+			ycoord = (ycoord + 1) % DISPLAY_ARRAY_HEIGHT;
+		}
+		vf = flipped != 0;
+		pc += 2;
+		return;
+	}
+	case 0xE:
+		if (NN == 0x9E)
+			pc += (keys[lane] >> (vx & 0xF)) & 1 ? 4 : 2;
+		else if (NN == 0xA1)
+			pc += (keys[lane] >> (vx & 0xF)) & 1 ? 2 : 4;
+		else
+			Fault(lane);
+		return;
+	case 0xF:
+		switch (NN)
+		{
+		case 0x07:
+			vx = delayTimers[lane];
+			break;
+		case 0x0A:
+			if (keys[lane] == 0)
+				return; // lanes get no key events, so the wait repeats until a key is held.
+			vx = __builtin_ctz(keys[lane]);
+			break;
+		case 0x15:
+			delayTimers[lane] = vx;
+			break;
+		case 0x18:
+			soundTimers[lane] = vx;
+			break;
+		case 0x1E:
+			vf = index + vx > 0xFFF;
+			index += vx;
+			break;
+		case 0x29:
+			index = vx * 0x05;
+			break;
+		case 0x33:
+		{
+			if (index + 3 > MEMORY_SIZE)
+			{
+				Fault(lane);
+				return;
+			}
+			uint8_t *target = WritableMemory(lane);
+			target[index] = vx / 100;
+			target[index + 1] = (vx / 10) % 10;
+			target[index + 2] = vx % 10;
+			break;
+		}
+		case 0x55:
+		{
+			if (index + X + 1 > MEMORY_SIZE)
+			{
+				Fault(lane);
+				return;
+			}
+			uint8_t *target = WritableMemory(lane);
+			for (uint i = 0; i <= X; i++)
+				target[index + i] = lanes.V[i][lane];
+			index += X + 1;
+			break;
+		}
+		case 0x65:
+			if (index + X + 1 > MEMORY_SIZE)
+			{
+				Fault(lane);
+				return;
+			}
+			for (uint i = 0; i <= X; i++)
+				lanes.V[i][lane] = memory[lane][index + i];
+			index += X + 1;
+			break;
+		default:
+			Fault(lane);
+			return;
+		}
+		pc += 2;
+		return;
+	}
+}
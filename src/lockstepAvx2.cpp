@@ -0,0 +1,270 @@
+#include "lockstep.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+/*
+/ Lane kernels, built with -mavx2 and picked at run time only when the CPU has it.
+/ Byte fields go 32 lanes per register, PC and I go 16 lanes per register. A masked
+/ lane keeps its old value through a blend, so stores never need a scalar tail.
+*/
+
+namespace
+{
+	inline __m256i Load(const void *address)
+	{
+		return _mm256_load_si256(static_cast<const __m256i *>(address));
+	}
+
+	inline void StoreMasked(void *address, __m256i value, __m256i mask)
+	{
+		_mm256_store_si256(static_cast<__m256i *>(address), _mm256_blendv_epi8(Load(address), value, mask));
+	}
+
+	// Byte mask of 16 lanes widened to 16-bit lanes.
+	inline __m256i WideMask(const uint8_t *mask)
+	{
+		return _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(mask)));
+	}
+
+	inline __m256i WideBytes(const uint8_t *bytes)
+	{
+		return _mm256_cvtepu8_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(bytes)));
+	}
+
+	void AdvancePC(const LockstepLanes &lanes, const uint8_t *mask)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+		for (uint lane = 0; lane < lanes.Count; lane += 16)
+			StoreMasked(lanes.PC + lane, _mm256_add_epi16(Load(lanes.PC + lane), two), WideMask(mask + lane));
+	}
+
+	// 3XNN, 4XNN, 5XY0, 9XY0: PC advances by 4 where the comparison equals skipIfEqual.
+	void Skip(const LockstepLanes &lanes, uint X, const uint8_t *other, __m256i immediate, bool skipIfEqual, const uint8_t *mask)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+		const __m256i invert = skipIfEqual ? _mm256_setzero_si256() : _mm256_set1_epi16(-1);
+		for (uint lane = 0; lane < lanes.Count; lane += 16)
+		{
+			const __m256i right = other ? WideBytes(other + lane) : immediate;
+			const __m256i equal = _mm256_xor_si256(_mm256_cmpeq_epi16(WideBytes(lanes.V[X] + lane), right), invert);
+			const __m256i step = _mm256_add_epi16(two, _mm256_and_si256(equal, two));
+			StoreMasked(lanes.PC + lane, _mm256_add_epi16(Load(lanes.PC + lane), step), WideMask(mask + lane));
+		}
+	}
+
+	// EX9E, EXA1: the key bit is shifted out 8 lanes at a time, AVX2 has no 16-bit variable shift.
+	void KeySkip(const LockstepLanes &lanes, uint X, bool skipIfPressed, const uint8_t *mask)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i key = _mm256_set1_epi32(0xF);
+		const __m256i invert = skipIfPressed ? _mm256_setzero_si256() : _mm256_set1_epi16(-1);
+		for (uint lane = 0; lane < lanes.Count; lane += 16)
+		{
+			__m256i halves[2];
+			for (uint half = 0; half < 2; half++)
+			{
+				const uint first = lane + half * 8;
+				const __m256i index = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(lanes.V[X] + first))), key);
+				const __m256i held = _mm256_cvtepu16_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(lanes.Keys + first)));
+				halves[half] = _mm256_and_si256(_mm256_srlv_epi32(held, index), one);
+			}
+			const __m256i pressed = _mm256_permute4x64_epi64(_mm256_packus_epi32(halves[0], halves[1]), 0xD8);
+			const __m256i skip = _mm256_xor_si256(_mm256_cmpeq_epi16(pressed, _mm256_set1_epi16(1)), invert);
+			const __m256i step = _mm256_add_epi16(two, _mm256_and_si256(skip, two));
+			StoreMasked(lanes.PC + lane, _mm256_add_epi16(Load(lanes.PC + lane), step), WideMask(mask + lane));
+		}
+	}
+
+	// 8XYn. VF is written before VX is, and both are reloaded, so X or Y being F behaves like Machine.
+	void Arithmetic(const LockstepLanes &lanes, uint X, uint Y, uint N, const uint8_t *mask)
+	{
+		const __m256i one = _mm256_set1_epi8(1);
+		for (uint lane = 0; lane < lanes.Count; lane += 32)
+		{
+			const __m256i m = Load(mask + lane);
+			__m256i vx = Load(lanes.V[X] + lane);
+			__m256i vy = Load(lanes.V[Y] + lane);
+			__m256i flag;
+			bool setsFlag = true;
+			switch (N)
+			{
+			case 0x4:
+				flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(vx, vy), _mm256_add_epi8(vx, vy)), one);
+				break;
+			case 0x5:
+				flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vx, vy), vx), one);
+				break;
+			case 0x6:
+				flag = _mm256_and_si256(vx, one);
+				break;
+			case 0x7:
+				flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vx, vy), vy), one);
+				break;
+			case 0xE:
+				flag = _mm256_and_si256(_mm256_srli_epi16(vx, 7), one);
+				break;
+			default:
+				setsFlag = false;
+				break;
+			}
+			if (setsFlag)
+			{
+				StoreMasked(lanes.V[VF] + lane, flag, m);
+				vx = Load(lanes.V[X] + lane);
+				vy = Load(lanes.V[Y] + lane);
+			}
+
+			__m256i result;
+			switch (N)
+			{
+			case 0x0:
+				result = vy;
+				break;
+			case 0x1:
+				result = _mm256_or_si256(vx, vy);
+				break;
+			case 0x2:
+				result = _mm256_and_si256(vx, vy);
+				break;
+			case 0x3:
+				result = _mm256_xor_si256(vx, vy);
+				break;
+			case 0x4:
+				result = _mm256_add_epi8(vx, vy);
+				break;
+			case 0x5:
+				result = _mm256_sub_epi8(vx, vy);
+				break;
+			case 0x6:
+				result = _mm256_and_si256(_mm256_srli_epi16(vx, 1), _mm256_set1_epi8(0x7F));
+				break;
+			case 0x7:
+				result = _mm256_sub_epi8(vy, vx);
+				break;
+			default: // 0xE
+				result = _mm256_add_epi8(vx, vx);
+				break;
+			}
+			StoreMasked(lanes.V[X] + lane, result, m);
+		}
+	}
+
+	// FX1E: VF is set when I + VX passes 0xFFF, including past 0xFFFF.
+	void AddIndex(const LockstepLanes &lanes, uint X, const uint8_t *mask)
+	{
+		const __m256i limit = _mm256_set1_epi16(0xFFF);
+		const __m256i one = _mm256_set1_epi16(1);
+		for (uint lane = 0; lane < lanes.Count; lane += 16)
+		{
+			const __m256i index = Load(lanes.I + lane);
+			const __m256i sum = _mm256_add_epi16(index, WideBytes(lanes.V[X] + lane));
+			const __m256i within = _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(sum, limit), limit), _mm256_cmpeq_epi16(_mm256_max_epu16(sum, index), sum));
+			const __m256i flag = _mm256_andnot_si256(within, one);
+			const __m128i flagBytes = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(flag, flag), 0x08));
+			const __m128i m = _mm_load_si128(reinterpret_cast<const __m128i *>(mask + lane));
+			__m128i *vf = reinterpret_cast<__m128i *>(lanes.V[VF] + lane);
+			_mm_store_si128(vf, _mm_blendv_epi8(_mm_load_si128(vf), flagBytes, m));
+		}
+		for (uint lane = 0; lane < lanes.Count; lane += 16)
+			StoreMasked(lanes.I + lane, _mm256_add_epi16(Load(lanes.I + lane), WideBytes(lanes.V[X] + lane)), WideMask(mask + lane));
+	}
+
+	void StoreBytes(uint8_t *target, const uint8_t *source, __m256i immediate, const LockstepLanes &lanes, const uint8_t *mask)
+	{
+		for (uint lane = 0; lane < lanes.Count; lane += 32)
+			StoreMasked(target + lane, source ? Load(source + lane) : immediate, Load(mask + lane));
+	}
+
+	uint Select(const uint16_t *pc, uint16_t value, uint8_t *done, uint8_t *mask, uint count)
+	{
+		const __m256i wanted = _mm256_set1_epi16(value);
+		uint selected = 0;
+		for (uint lane = 0; lane < count; lane += 32)
+		{
+			const __m256i low = _mm256_cmpeq_epi16(Load(pc + lane), wanted);
+			const __m256i high = _mm256_cmpeq_epi16(Load(pc + lane + 16), wanted);
+			const __m256i match = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+			const __m256i d = Load(done + lane);
+			const __m256i m = _mm256_andnot_si256(d, match);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(mask + lane), m);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(done + lane), _mm256_or_si256(d, m));
+			selected += __builtin_popcount(_mm256_movemask_epi8(m));
+		}
+		return selected;
+	}
+
+	void Execute(const LockstepLanes &lanes, uint16_t opcode, const uint8_t *mask)
+	{
+		const uint X = (opcode >> 8) & 0xF;
+		const uint Y = (opcode >> 4) & 0xF;
+		const uint16_t NNN = opcode & 0xFFF;
+		const uint8_t NN = opcode & 0xFF;
+
+		switch (opcode >> 12)
+		{
+		case 0x1:
+			for (uint lane = 0; lane < lanes.Count; lane += 16)
+				StoreMasked(lanes.PC + lane, _mm256_set1_epi16(NNN), WideMask(mask + lane));
+			return;
+		case 0x3:
+			Skip(lanes, X, nullptr, _mm256_set1_epi16(NN), true, mask);
+			return;
+		case 0x4:
+			Skip(lanes, X, nullptr, _mm256_set1_epi16(NN), false, mask);
+			return;
+		case 0x5:
+			Skip(lanes, X, lanes.V[Y], _mm256_setzero_si256(), true, mask);
+			return;
+		case 0x9:
+			Skip(lanes, X, lanes.V[Y], _mm256_setzero_si256(), false, mask);
+			return;
+		case 0xE:
+			KeySkip(lanes, X, NN == 0x9E, mask);
+			return;
+		case 0x6:
+			StoreBytes(lanes.V[X], nullptr, _mm256_set1_epi8(NN), lanes, mask);
+			break;
+		case 0x7:
+			for (uint lane = 0; lane < lanes.Count; lane += 32)
+				StoreMasked(lanes.V[X] + lane, _mm256_add_epi8(Load(lanes.V[X] + lane), _mm256_set1_epi8(NN)), Load(mask + lane));
+			break;
+		case 0x8:
+			Arithmetic(lanes, X, Y, opcode & 0xF, mask);
+			break;
+		case 0xA:
+			for (uint lane = 0; lane < lanes.Count; lane += 16)
+				StoreMasked(lanes.I + lane, _mm256_set1_epi16(NNN), WideMask(mask + lane));
+			break;
+		case 0xF:
+			if (NN == 0x07)
+				StoreBytes(lanes.V[X], lanes.DT, _mm256_setzero_si256(), lanes, mask);
+			else if (NN == 0x15)
+				StoreBytes(lanes.DT, lanes.V[X], _mm256_setzero_si256(), lanes, mask);
+			else if (NN == 0x18)
+				StoreBytes(lanes.ST, lanes.V[X], _mm256_setzero_si256(), lanes, mask);
+			else if (NN == 0x1E)
+				AddIndex(lanes, X, mask);
+			break;
+		}
+		AdvancePC(lanes, mask);
+	}
+
+	const LockstepKernels avx2Kernels = {Select, Execute};
+}
+
+const LockstepKernels *GetAvx2LockstepKernels()
+{
+	return __builtin_cpu_supports("avx2") ? &avx2Kernels : nullptr;
+}
+
+#else
+
+const LockstepKernels *GetAvx2LockstepKernels()
+{
+	return nullptr;
+}
+
+#endif
@@ -1,93 +1,572 @@
 // Written by Wojciech Kieloch circa 2022.
 
 #include "machine.h"
+#include "aotEngine.h"
+#include "blockCache.h"
+#include "jit.h"
+#include "profiler.h"
+#include "traceWriter.h"
 
 #include <fstream>
-#include <thread>
 #include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <random>
+#include <sstream>
+
+bool EngineFromName(const std::string &name, Engine &engine)
+{
+	if (name == "interpreter")
+		engine = Engine::Interpreter;
+	else if (name == "cached")
+		engine = Engine::Cached;
+	else if (name == "jit")
+		engine = Engine::Jit;
+	else if (name == "jit-checked")
+		engine = Engine::JitChecked;
+	else if (name == "aot")
+		engine = Engine::Aot;
+	else
+		return false;
+	return true;
+}
 
-Machine::Machine(uint32_t displayScaleArg)
+bool IsRomFileName(const std::string &path)
 {
-	srand((unsigned int)time(nullptr));
-	scale = displayScaleArg;
-	DisplayHeight = displayScaleArg * DISPLAY_ARRAY_HEIGHT;
-	DisplayWidth = displayScaleArg * DISPLAY_ARRAY_WIDTH;
+	std::string extension = std::filesystem::path(path).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+				   { return tolower(c); });
+	return extension == ".ch8" || extension == ".c8";
 }
 
-Machine::~Machine()
+Machine::Machine()
 {
-	EndDisplay();
+	randomState = NextSeed();
+	decodeTable = GetDecodeTable(quirks);
+	memset(rplFlags, 0, sizeof(rplFlags));
+	ResetMachine();
+}
+
+Machine::~Machine() = default;
+
+uint32_t Machine::NextSeed()
+{
+	// One random_device read per process, then splitmix64 over a Weyl sequence: creating
+	// machines in bulk does not pay for a system call each.
+	static std::atomic<uint64_t> sequence{std::random_device()()};
+	uint64_t z = sequence.fetch_add(0x9E3779B97F4A7C15ull) + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return (uint32_t)(z ^ (z >> 31)) | 1;
 }
 
 void Machine::LoadFonts()
 {
+	uint8_t *memory = AddressSpace();
 	for (int i = 0; i < FONTS_ARRAY_SIZE; i++)
-		Memory[i] = Fonts[i];
+		memory[i] = Fonts[i];
+	for (int i = 0; i < BIG_FONTS_ARRAY_SIZE; i++)
+		memory[BIG_FONTS_ADDRESS + i] = BigFonts[i];
 }
 
-void Machine::LaunchRom(std::string filePath)
+// No window, no input and no sleeping: timers advance every instructionsPerFrame executed instructions.
+RunStats Machine::RunHeadless(std::string filePath, uint64_t frames, uint instructionsPerFrame)
 {
 	ResetMachine();
-	InitializeDispaly();
 	LoadRom(filePath);
 
-	int insCount = -1;
+	RunStats stats;
+	const auto start = std::chrono::steady_clock::now();
+
+	stats.Instructions = RunFrames(frames, instructionsPerFrame);
+
+	stats.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
 
-	while (!quitFlag)
+uint64_t Machine::Step(uint64_t count)
+{
+	if (exited || IsWaitingForKey())
+		return 0;
+
+	// Tracing picks its own instantiation once per call, so the untraced loops test nothing.
+	// XO-CHIP likewise, and only interprets: blocks are cached and compiled for 4 KB of
+	// two-byte instructions.
+	uint64_t left;
+	if (xo)
+	{
+		if (tracer)
+			left = StepInterpreter<true, true>(count);
+		else left = StepInterpreter<false, true>(count);
+	}
+	else if (engine == Engine::Cached)
+	{
+		if (tracer)
+			left = StepCached<true>(count);
+		else left = StepCached<false>(count);
+	}
+	else if (engine == Engine::Jit || engine == Engine::JitChecked)
+		left = StepJit(count);
+	else if (engine == Engine::Aot)
+		left = StepAot(count);
+	else if (tracer)
+		left = StepInterpreter<true>(count);
+	else left = StepInterpreter<false>(count);
+
+	instructionCount += count - left;
+	return count - left;
+}
+
+template <bool Traced, bool XoChip>
+uint64_t Machine::StepInterpreter(uint64_t count)
+{
+	while (count > 0)
 	{
-		if (ProgramCounter >= MEMORY_SIZE)
+		if (ProgramCounter >= (XoChip ? XO_MEMORY_SIZE : MEMORY_SIZE) - 1)
 			throw std::runtime_error("ProgamCounter out of bounds.");
 
-		HandleInput();
+		const uint16_t start = ProgramCounter;
+		EmulateIns<Traced, XoChip>();
+		count--;
+		if (ProgramCounter <= start)
+		{
+			if (IsWaitingForKey() || exited)
+				return count;
+			if (idleSkip)
+				SkipIdleLoop<XoChip>(count);
+		}
+	}
+	return 0;
+}
 
-		EmulateIns();
+// A loop made only of polling opcodes that comes back to its head with every register and I
+// unchanged repeats identically until the delay timer or the keys change, which only happens
+// between Step calls. So after one checked iteration, the remaining whole iterations of count
+// can be counted without running them.
+template <bool XoChip>
+void Machine::SkipIdleLoop(uint64_t &count)
+{
+	const uint16_t head = ProgramCounter;
+	uint8_t registers[REGISTERS_COUNT];
+	memcpy(registers, Registers, sizeof(Registers));
+	const uint16_t index = IndexRegister;
+
+	const uint8_t *memory = MemoryOf<XoChip>();
+	uint length = 0;
+	do
+	{
+		if (length == IDLE_LOOP_MAX_LENGTH || count == 0 || ProgramCounter >= (XoChip ? XO_MEMORY_SIZE : MEMORY_SIZE) - 1)
+			return;
+		if (!IsPollingOpcode(MergeBytes(memory[ProgramCounter], memory[ProgramCounter + 1])))
+			return;
+		if (tracer)
+			EmulateIns<true, XoChip>();
+		else EmulateIns<false, XoChip>();
+		length++;
+		count--;
+	} while (ProgramCounter != head);
+
+	if (memcmp(registers, Registers, sizeof(Registers)) != 0 || IndexRegister != index)
+		return;
+
+	const uint64_t skipped = count / length * length;
+	count -= skipped;
+	if (tracer)
+		tracer->Skip(skipped);
+	idleStats.Loops++;
+	idleStats.SkippedInstructions += skipped;
+}
 
-		insCount = (insCount + 1) % insPerTimer;
+// Opcodes whose effect depends only on registers, memory, the delay timer and the keys, and
+// which write nothing but registers, I and PC.
+bool Machine::IsPollingOpcode(uint16_t opcode)
+{
+	switch (opcode >> 12)
+	{
+	case 0x1:
+	case 0x3:
+	case 0x4:
+	case 0x6:
+	case 0x7:
+	case 0x8:
+	case 0x9:
+	case 0xA:
+	case 0xB:
+		return true;
+	case 0x5:
+		return (opcode & 0xF) != 2; // XO-CHIP's 5XY2 stores registers.
+	case 0xE:
+		return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+	case 0xF:
+		switch (opcode & 0xFF)
+		{
+		case 0x07:
+		case 0x1E:
+		case 0x29:
+		case 0x65:
+			return true;
+		}
+		return false;
+	}
+	return false;
+}
 
-		std::this_thread::sleep_for(std::chrono::microseconds(insDeltaMicroS));
+// Runs whole cached blocks, cut short only when fewer than a block's instructions remain.
+template <bool Traced>
+uint64_t Machine::StepCached(uint64_t count)
+{
+	while (count > 0)
+	{
+		if (ProgramCounter >= MEMORY_SIZE - 1)
+			throw std::runtime_error("ProgamCounter out of bounds.");
 
-		if (insCount == 0)
+		const BlockCache::Block &block = blockCache->Lookup(ProgramCounter);
+		if (block.Code.empty())
+			throw std::runtime_error("ProgamCounter out of bounds.");
+		const uint16_t start = ProgramCounter;
+		const uint64_t length = block.Code.size() < count ? block.Code.size() : count;
+		for (uint64_t i = 0; i < length; i++)
 		{
-			DelayTimer--;
-			if (DelayTimer < 0)
-				DelayTimer = 0;
+			const Instruction &ins = *block.Code[i];
+			currentOpcode = ins.Opcode;
+			if (Traced)
+				tracer->Record(*this, currentOpcode);
+			ins.Handler(*this, ins);
 		}
+		count -= length;
+		if (IsWaitingForKey() || exited)
+			return count;
+		if (idleSkip && ProgramCounter <= start)
+			SkipIdleLoop(count);
 	}
-
-	EndDisplay();
+	return 0;
 }
 
-void Machine::HandleInput()
+// Whole native blocks run only when they fit in count, the remainder is interpreted.
+uint64_t Machine::StepJit(uint64_t count)
 {
-	while (SDL_PollEvent(&Event))
+	if (shadow)
+		shadow->SetState(GetState());
+
+	while (count > 0)
 	{
-		if (Event.type == SDL_WINDOWEVENT)
+		if (ProgramCounter >= MEMORY_SIZE - 1)
+			throw std::runtime_error("ProgamCounter out of bounds.");
+
+		const uint16_t start = ProgramCounter;
+		const JitCompiler::Block *block = jit->Lookup(ProgramCounter);
+		if (block != nullptr && block->Length <= count)
 		{
-			if (Event.window.event == SDL_WINDOWEVENT_CLOSE)
+			const uint length = block->Length;
+			if (tracer)
 			{
-				quitFlag = true;
-				break;
+				tracer->Record(*this, MergeBytes(Memory[ProgramCounter], Memory[ProgramCounter + 1]));
+				tracer->Skip(length - 1);
 			}
-		}
-		else if (Event.type == SDL_KEYDOWN)
-		{
-			std::string pressedCharacter = SDL_GetKeyName(Event.key.keysym.sym);
-			if (pressedCharacter.length() == 1 && Keyboard.count(pressedCharacter[0]) == 1)
+			block->Entry(this);
+			jit->RethrowPendingError();
+			jit->CountNative(length);
+			count -= length;
+
+			if (shadow)
 			{
-				char hexForm = fromHex(Keyboard[pressedCharacter[0]]);
-				Keys[hexForm] = true;
+				shadow->Step(length);
+				CompareWithShadow(start);
 			}
 		}
-		else if (Event.type == SDL_KEYUP)
+		else
+		{
+			if (tracer)
+				EmulateIns<true>();
+			else EmulateIns<false>();
+			jit->CountInterpreted();
+			count--;
+
+			if (shadow)
+				shadow->Step(1);
+		}
+
+		if (IsWaitingForKey() || exited)
+			return count;
+		if (idleSkip && ProgramCounter <= start)
 		{
-			std::string liftedCharacter = SDL_GetKeyName(Event.key.keysym.sym);
-			if (liftedCharacter.length() == 1 && Keyboard.count(liftedCharacter[0]) == 1)
+			const uint64_t before = count;
+			SkipIdleLoop(count);
+			if (shadow)
 			{
-				char hexForm = fromHex(Keyboard[liftedCharacter[0]]);
-				Keys[hexForm] = false;
+				shadow->Step(before - count);
+				CompareWithShadow(start);
 			}
 		}
 	}
+	return 0;
+}
+
+// Whole compiled blocks run only when they fit in count, the rest is interpreted. A block can end
+// on FX0A or 00FD past its start, so the wait and the exit are checked after every block.
+uint64_t Machine::StepAot(uint64_t count)
+{
+	while (count > 0)
+	{
+		if (ProgramCounter >= MEMORY_SIZE - 1)
+			throw std::runtime_error("ProgamCounter out of bounds.");
+
+		const uint16_t start = ProgramCounter;
+		const AotBlock *block = aot->Lookup(ProgramCounter);
+		if (block != nullptr && block->Length <= count)
+		{
+			if (tracer)
+				tracer->Record(*this, MergeBytes(Memory[ProgramCounter], Memory[ProgramCounter + 1]));
+			const uint length = block->Entry(*this);
+			if (tracer)
+				tracer->Skip(length - 1);
+			aot->CountNative(length);
+			count -= length;
+		}
+		else
+		{
+			if (tracer)
+				EmulateIns<true>();
+			else EmulateIns<false>();
+			aot->CountInterpreted();
+			count--;
+		}
+
+		if (IsWaitingForKey() || exited)
+			return count;
+		if (idleSkip && ProgramCounter <= start)
+			SkipIdleLoop(count);
+	}
+	return 0;
+}
+
+void Machine::SetState(const MachineState &state)
+{
+	static_cast<MachineState &>(*this) = state;
+	dirtyPages = ALL_PAGES_DIRTY;
+	if (blockCache)
+		blockCache->Flush();
+	if (jit)
+		jit->Flush();
+	if (aot)
+		aot->Flush();
+}
+
+void Machine::CompareWithShadow(uint16_t blockStart) const
+{
+	std::string field;
+	if (memcmp(Registers, shadow->Registers, sizeof(Registers)) != 0)
+		field = "registers";
+	else if (IndexRegister != shadow->IndexRegister)
+		field = "index register";
+	else if (ProgramCounter != shadow->ProgramCounter)
+		field = "program counter";
+	else if (StackPointer != shadow->StackPointer || memcmp(Stack, shadow->Stack, sizeof(Stack)) != 0)
+		field = "stack";
+	else if (DelayTimer != shadow->DelayTimer)
+		field = "delay timer";
+	else if (SoundTimer != shadow->SoundTimer)
+		field = "sound timer";
+	else if (memcmp(Memory, shadow->Memory, sizeof(Memory)) != 0)
+		field = "memory";
+	else if (hiRes != shadow->hiRes || memcmp(bDisplay, shadow->bDisplay, sizeof(bDisplay)) != 0 ||
+			 memcmp(bDisplayRight, shadow->bDisplayRight, sizeof(bDisplayRight)) != 0)
+		field = "display";
+	else
+		return;
+
+	std::ostringstream message;
+	message << "JIT diverged from the interpreter in the block at 0x" << std::hex << blockStart << ": " << field;
+	throw std::runtime_error(message.str());
+}
+
+void Machine::SetEngine(Engine engineArg)
+{
+	if ((engineArg == Engine::Jit || engineArg == Engine::JitChecked) && !jit)
+		jit.reset(new JitCompiler(*this));
+	if (engineArg == Engine::JitChecked && !shadow)
+	{
+		shadow.reset(new Machine());
+		shadow->SetQuirks(quirks);
+		shadow->keyWaitOnRelease = keyWaitOnRelease;
+	}
+	if (engineArg != Engine::JitChecked)
+		shadow.reset();
+
+	if (engineArg == Engine::Aot && !aot)
+		aot.reset(new AotEngine(*this));
+
+	engine = engineArg;
+	if (engine == Engine::Cached && !blockCache)
+		blockCache.reset(new BlockCache(decodeTable, Memory));
+}
+
+void Machine::SetQuirks(QuirkProfile profile)
+{
+	if (profile == QuirkProfile::XoChip && !xo)
+	{
+		xo.reset(new XoChipState());
+		memcpy(xo->Memory, Memory, MEMORY_SIZE);
+		xo->Planes = 1;
+		xo->Pitch = XO_DEFAULT_PITCH;
+	}
+	else if (profile != QuirkProfile::XoChip && xo)
+	{
+		memcpy(Memory, xo->Memory, MEMORY_SIZE);
+		xo.reset();
+	}
+	quirks = profile;
+	decodeTable = GetDecodeTable(profile);
+	if (blockCache)
+		blockCache.reset(new BlockCache(decodeTable, Memory));
+	if (jit)
+		jit->Flush();
+	if (aot)
+		aot->Flush();
+	if (shadow)
+		shadow->SetQuirks(profile);
+}
+
+void Machine::SetKeyWaitOnRelease(bool enabled)
+{
+	keyWaitOnRelease = enabled;
+	if (shadow)
+		shadow->keyWaitOnRelease = enabled;
+}
+
+const JitStats *Machine::GetJitStats() const
+{
+	return jit ? &jit->GetStats() : nullptr;
+}
+
+const AotStats *Machine::GetAotStats() const
+{
+	return aot ? &aot->GetStats() : nullptr;
+}
+
+uint8_t Machine::NextRandom()
+{
+	// xorshift32, per machine so runs and lockstep checks do not share global rand() state.
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState >> 24;
+}
+
+const BlockCacheStats *Machine::GetBlockCacheStats() const
+{
+	return blockCache ? &blockCache->GetStats() : nullptr;
+}
+
+void Machine::OnMemoryWrite(uint address, uint length)
+{
+	if (length > 0)
+	{
+		for (uint page = address / MEMORY_PAGE_SIZE; page <= (address + length - 1) / MEMORY_PAGE_SIZE && page < MEMORY_PAGES; page++)
+			dirtyPages |= 1 << page;
+	}
+	if (blockCache)
+		blockCache->Invalidate(address, length);
+	if (jit)
+		jit->Invalidate(address, length);
+	if (aot)
+		aot->Invalidate(address, length);
+}
+
+uint8_t *Machine::GetMemory()
+{
+	dirtyPages = ALL_PAGES_DIRTY;
+	if (blockCache)
+		blockCache->Flush();
+	if (jit)
+		jit->Flush();
+	if (aot)
+		aot->Flush();
+	return AddressSpace();
+}
+
+uint64_t Machine::RunFrames(uint64_t frames, uint instructionsPerFrame)
+{
+	const auto start = profiler ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+	uint64_t instructions = 0;
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		instructions += Step(instructionsPerFrame);
+		TickTimers();
+	}
+	if (profiler)
+		profiler->AddCpuTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	return instructions;
+}
+
+void Machine::TickTimers()
+{
+	if (DelayTimer > 0)
+		DelayTimer--;
+	if (SoundTimer > 0)
+		SoundTimer--;
+}
+
+uint64_t Machine::ConsumeDirtyRows()
+{
+	const uint64_t rows = dirtyRows;
+	dirtyRows = 0;
+	return rows;
+}
+
+uint16_t Machine::ConsumeDirtyPages()
+{
+	const uint16_t pages = dirtyPages;
+	dirtyPages = 0;
+	return pages;
+}
+
+void Machine::SetKey(uint key, bool pressed)
+{
+	if (key >= KEYBOARD_SIZE)
+		return;
+
+	const bool wasPressed = (Keys >> key) & 1;
+	Keys = pressed ? Keys | 1 << key : Keys & ~(1 << key);
+	if (!IsWaitingForKey() || pressed == wasPressed)
+		return;
+
+	if (!keyWaitOnRelease)
+	{
+		if (pressed)
+			FinishKeyWait(key);
+	}
+	else if (pressed && keyWaitKey == KEY_WAIT_NONE)
+		keyWaitKey = key;
+	else if (!pressed && keyWaitKey == key)
+		FinishKeyWait(key);
+}
+
+void Machine::SetKeys(uint16_t keyMask)
+{
+	if (!IsWaitingForKey())
+	{
+		Keys = keyMask;
+		return;
+	}
+
+	for (uint16_t changed = Keys ^ keyMask; changed != 0; changed &= changed - 1)
+	{
+		const uint key = __builtin_ctz(changed);
+		SetKey(key, (keyMask >> key) & 1);
+	}
+}
+
+void Machine::FinishKeyWait(uint key)
+{
+	Registers[keyWaitRegister] = key;
+	ProgramCounter += 2;
+	keyWaitRegister = KEY_WAIT_NONE;
+	keyWaitKey = KEY_WAIT_NONE;
 }
 
 void Machine::NoSuchOpcode(uint16_t opcode)
@@ -95,9 +574,17 @@ void Machine::NoSuchOpcode(uint16_t opcode)
 	throw std::invalid_argument("No such opcode exists!: " + std::to_string(opcode));
 }
 
+template <bool Traced, bool XoChip>
 void Machine::EmulateIns()
 {
-	currentOpcode = MergeBytes(Memory[ProgramCounter], Memory[ProgramCounter + 1]);
+	const uint8_t *memory = MemoryOf<XoChip>();
+	currentOpcode = MergeBytes(memory[ProgramCounter], memory[ProgramCounter + 1]);
+#ifdef CHIP8_PROFILE
+	if (profiler)
+		profiler->OnInstruction(ProgramCounter, currentOpcode, StackPointer);
+#endif
+	if (Traced)
+		tracer->Record(*this, currentOpcode);
 	HandleOpcode(currentOpcode);
 }
 
@@ -109,16 +596,28 @@ void Machine::LoadRom(std::string filePath)
 	{
 		uintmax_t fileSize = getFileSize(filePath);
 		const int startAddress = 0x200;
-		const int memoryLeft = MEMORY_SIZE - 0x200;
+		const uint memoryLeft = AddressSpaceSize() - 0x200;
 		if (memoryLeft < fileSize)
 			throw std::runtime_error("The file is too big.");
 
-		file.read(reinterpret_cast<char *>(Memory + startAddress), fileSize);
+		file.read(reinterpret_cast<char *>(AddressSpace() + startAddress), fileSize);
+		OnMemoryWrite(startAddress, fileSize);
 	}
 	else
 		throw std::runtime_error("File error!");
 }
 
+void Machine::LoadProgram(const uint8_t *program, uint size)
+{
+	const int startAddress = 0x200;
+	const uint memoryLeft = AddressSpaceSize() - 0x200;
+	if (memoryLeft < size)
+		throw std::runtime_error("The program is too big.");
+
+	memcpy(AddressSpace() + startAddress, program, size);
+	OnMemoryWrite(startAddress, size);
+}
+
 uintmax_t Machine::getFileSize(const std::string &filePath)
 {
 	const std::filesystem::path fsPath(filePath);
@@ -133,79 +632,55 @@ uint16_t Machine::GetValueFromBits(uint16_t shortType, unsigned int startPositio
 	return isolated & mask;
 }
 
-void Machine::InitializeDispaly()
+uint16_t Machine::MergeBytes(uint8_t FirstByte, uint8_t SecondByte)
 {
-	if (displayInitFlag)
-		EndDisplay();
-
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
-		throw std::runtime_error("SDL could not initialize! SDL_Error: " + std::string(SDL_GetError()));
-	else if (SDL_CreateWindowAndRenderer(DisplayWidth, DisplayHeight, 0, &AppWindow, &Renderer) != 0)
-		throw std::runtime_error("SDL could not initialize a window and a renderer! SDL_Error: " + std::string(SDL_GetError()));
-	displayInitFlag = true;
+	const uint16_t opcode = FirstByte << 8 | SecondByte;
+	return opcode;
 }
 
-void Machine::UpdateDisplay()
+// Rows past the current mode's stay clear, so only its own are cleared.
+void Machine::ClearDisplayMatrix(uint64_t *left, uint64_t *right)
 {
-	ClearDisplay();
-	SDL_SetRenderDrawColor(Renderer, 255, 255, 255, 0); // White
-
-	for (int i = 0; i < DISPLAY_ARRAY_HEIGHT; i++)
+	const uint height = GetDisplayHeight();
+	for (uint i = 0; i < height; i++)
+		left[i] = 0;
+	if (hiRes)
 	{
-		for (int j = 0; j < DISPLAY_ARRAY_WIDTH; j++)
-		{
-			if (bDisplay[i][j] == true)
-			{
-				SDL_Rect rect;
-				rect.y = i * scale;
-				rect.x = j * scale;
-				rect.h = scale;
-				rect.w = scale;
-				SDL_RenderFillRect(Renderer, &rect);
-			}
-		}
+		for (uint i = 0; i < height; i++)
+			right[i] = 0;
 	}
-
-	SDL_RenderPresent(Renderer);
 }
 
-void Machine::ClearDisplay()
+// Either switch clears the whole display, every plane of it, which then takes the new mode's size.
+void Machine::SetHiRes(bool enabled)
 {
-	SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 0); // Black
-	SDL_RenderClear(Renderer);
-}
-
-void Machine::EndDisplay()
-{
-	if (displayInitFlag)
+	memset(bDisplay, 0, sizeof(bDisplay));
+	memset(bDisplayRight, 0, sizeof(bDisplayRight));
+	if (xo)
 	{
-		SDL_DestroyRenderer(Renderer);
-		Renderer = nullptr;
-		SDL_DestroyWindow(AppWindow);
-		AppWindow = nullptr;
-		SDL_Quit();
+		memset(xo->bPlane, 0, sizeof(xo->bPlane));
+		memset(xo->bPlaneRight, 0, sizeof(xo->bPlaneRight));
 	}
+	hiRes = enabled;
+	dirtyRows = AllDisplayRows();
 }
 
-uint8_t Machine::fromHex(char symbol)
-{
-	if (symbol >= 'A')
-		return (10 + (symbol - 'A'));
-	else
-		return (symbol - '0');
-}
-
-uint16_t Machine::MergeBytes(uint8_t FirstByte, uint8_t SecondByte)
+void Machine::SetRplFlagsFile(const std::string &path)
 {
-	const uint16_t opcode = FirstByte << 8 | SecondByte;
-	return opcode;
+	rplFlagsPath = path;
+	std::ifstream file(path, std::ios::binary);
+	if (file.good())
+		file.read(reinterpret_cast<char *>(rplFlags), sizeof(rplFlags));
 }
 
-void Machine::ClearDisplayMatrix()
+void Machine::SaveRplFlags() const
 {
-	for (uint i = 0; i < DISPLAY_ARRAY_HEIGHT; i++)
-		for (uint j = 0; j < DISPLAY_ARRAY_WIDTH; j++)
-			bDisplay[i][j] = false;
+	if (rplFlagsPath.empty())
+		return;
+	std::ofstream file(rplFlagsPath, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(rplFlags), sizeof(rplFlags));
+	if (!file.good())
+		throw std::runtime_error("Cannot write the RPL flags to " + rplFlagsPath);
 }
 
 void Machine::ResetMachine()
@@ -213,8 +688,8 @@ void Machine::ResetMachine()
 	ProgramCounter = 0x200;
 	IndexRegister = 0;
 	StackPointer = 0;
-	ClearDisplayMatrix();
-	EndDisplay();
+	SetHiRes(false);
+	exited = false;
 
 	for (uint i = 0; i < STACK_SIZE; i++)
 		Stack[i] = 0;
@@ -222,20 +697,29 @@ void Machine::ResetMachine()
 	for (uint i = 0; i < REGISTERS_COUNT; i++)
 		Registers[i] = 0;
 
-	for (uint i = FONTS_ARRAY_SIZE; i < MEMORY_SIZE; i++)
-		Memory[i] = 0;
+	uint8_t *memory = AddressSpace();
+	for (uint i = FONTS_ARRAY_SIZE; i < AddressSpaceSize(); i++)
+		memory[i] = 0;
+	if (xo)
+	{
+		xo->Planes = 1;
+		memset(xo->AudioPattern, 0, sizeof(xo->AudioPattern));
+		xo->Pitch = XO_DEFAULT_PITCH;
+	}
 
-	for (uint i = 0; i < 16; i++)
-		Keys[i] = false;
+	Keys = 0;
 
 	LoadFonts();
 	DelayTimer = 0;
-	quitFlag = false;
-	displayInitFlag = false;
+	SoundTimer = 0;
+	keyWaitRegister = KEY_WAIT_NONE;
+	keyWaitKey = KEY_WAIT_NONE;
+	dirtyPages = ALL_PAGES_DIRTY;
+
+	if (blockCache)
+		blockCache->Flush();
+	if (jit)
+		jit->Flush();
+	if (aot)
+		aot->Flush();
 }
-
-void Machine::BeepFor(uint16_t val)
-{
-	const double beepingTimeMicroSec = val * timersDeltaMicroS;
-	// not implemented.
-}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "machinePool.h"
+
+#include <stdexcept>
+
+MachinePool::~MachinePool()
+{
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+	{
+		for (size_t slot = 0; slot < MACHINE_POOL_CHUNK; slot++)
+		{
+			if (used[chunk * MACHINE_POOL_CHUNK + slot])
+				reinterpret_cast<Machine *>(chunks[chunk][slot].Bytes)->~Machine();
+		}
+	}
+}
+
+void MachinePool::AddChunk()
+{
+	chunks.emplace_back(new Slot[MACHINE_POOL_CHUNK]);
+	used.resize(chunks.size() * MACHINE_POOL_CHUNK, 0);
+
+	// Reversed, so slots are handed out in address order.
+	Slot *slots = chunks.back().get();
+	for (size_t slot = MACHINE_POOL_CHUNK; slot > 0; slot--)
+		freeSlots.push_back(&slots[slot - 1]);
+}
+
+size_t MachinePool::SlotIndex(const Machine *machine) const
+{
+	const Slot *slot = reinterpret_cast<const Slot *>(machine);
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+	{
+		const Slot *first = chunks[chunk].get();
+		if (slot >= first && slot < first + MACHINE_POOL_CHUNK)
+			return chunk * MACHINE_POOL_CHUNK + (slot - first);
+	}
+	throw std::invalid_argument("The machine does not belong to this pool.");
+}
+
+void MachinePool::Reserve(size_t count)
+{
+	while (GetCapacity() < count)
+		AddChunk();
+}
+
+Machine *MachinePool::Create()
+{
+	if (freeSlots.empty())
+		AddChunk();
+
+	Slot *slot = freeSlots.back();
+	Machine *machine = new (slot->Bytes) Machine();
+	freeSlots.pop_back();
+	used[SlotIndex(machine)] = 1;
+	live++;
+	return machine;
+}
+
+void MachinePool::Release(Machine *machine)
+{
+	const size_t index = SlotIndex(machine);
+	if (!used[index])
+		throw std::invalid_argument("The machine was already released.");
+
+	machine->~Machine();
+	used[index] = 0;
+	freeSlots.push_back(reinterpret_cast<Slot *>(machine));
+	live--;
+}
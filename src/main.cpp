@@ -2,22 +2,41 @@
 
 #include <iostream>
 #include <filesystem>
+#include <fstream>
 #include <map>
 #include <thread>
 
 #include "machine.h"
+#include "aotEngine.h"
+#include "audioStream.h"
+#include "blockCache.h"
+#include "frameScheduler.h"
+#include "jit.h"
+#include "movie.h"
+#include "profiler.h"
+#include "sdlFrontend.h"
+#include "traceWriter.h"
 
 using namespace std;
 
 void printInterface(const std::string &pathToDir, map<string, string> &numberToPath);
+int runFromArguments(int argc, char *argv[]);
+void printUsage();
+void printIdleStats(const Machine &machine);
+void saveMovie(Movie &movie, const string &filePath);
+void saveProfile(const Profiler &profiler, const string &filePath);
 
 int main(int argc, char *argv[])
 {
+	if (argc > 1)
+		return runFromArguments(argc, argv);
+
 	string selection = "";
 	const string pathToDir = "../roms/";
 	map<string, string> numberToPath;
 	const uint displayScale = 10;
-	unique_ptr<Machine> Chip8(new Machine(displayScale));
+	unique_ptr<Machine> Chip8(new Machine());
+	unique_ptr<SdlFrontend> Frontend(new SdlFrontend(*Chip8, displayScale));
 
 	while (true)
 	{
@@ -27,7 +46,7 @@ int main(int argc, char *argv[])
 		if (selection == "q")
 			break;
 		else if (numberToPath.count(selection))
-			Chip8->LaunchRom(numberToPath[selection]);
+			Frontend->LaunchRom(numberToPath[selection]);
 		else
 			cout << "Invalid choice" << endl;
 
@@ -53,3 +72,318 @@ void printInterface(const std::string &pathToDir, map<string, string> &numberToP
 	}
 	cout << endl;
 }
+
+// CHIP8 [--headless [--realtime]] [--frames N] [--ipf N] [--turbo] [--skip-idle] [--key-release] [--quirks default|vip|chip48|schip|xochip] [--rpl file] [--keymap file] [--seed N] [--record movie | --play movie] [--profile file] [--trace file [--trace-ring N]] [--wav file] [--engine interpreter|cached|jit|jit-checked|aot] <rom>
+int runFromArguments(int argc, char *argv[])
+{
+	bool headless = false;
+	bool realtime = false;
+	bool turbo = false;
+	bool skipIdle = false;
+	bool keyRelease = false;
+	QuirkProfile quirks = QuirkProfile::Default;
+	uint64_t frames = 600;
+	uint instructionsPerFrame = Machine::insPerTimer;
+	Engine engine = Engine::Interpreter;
+	string romPath = "";
+	string keyMapPath = "";
+	bool seeded = false;
+	uint32_t seed = 0;
+	string recordPath = "";
+	string playPath = "";
+	string profilePath = "";
+	string tracePath = "";
+	uint64_t traceRing = 0;
+	string rplPath = "";
+	string wavPath = "";
+
+	for (int i = 1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--headless")
+			headless = true;
+		else if (arg == "--realtime")
+			realtime = true;
+		else if (arg == "--turbo")
+			turbo = true;
+		else if (arg == "--skip-idle")
+			skipIdle = true;
+		else if (arg == "--key-release")
+			keyRelease = true;
+		else if (arg == "--rpl" && i + 1 < argc)
+			rplPath = argv[++i];
+		else if (arg == "--quirks" && i + 1 < argc)
+		{
+			if (!QuirkProfileFromName(argv[++i], quirks))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--keymap" && i + 1 < argc)
+			keyMapPath = argv[++i];
+		else if (arg == "--seed" && i + 1 < argc)
+		{
+			seed = stoul(argv[++i], nullptr, 0);
+			seeded = true;
+		}
+		else if (arg == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (arg == "--play" && i + 1 < argc)
+		{
+			playPath = argv[++i];
+			headless = true; // playback only reproduces runs exactly without a window.
+		}
+		else if (arg == "--profile" && i + 1 < argc)
+			profilePath = argv[++i];
+		else if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "--trace-ring" && i + 1 < argc)
+			traceRing = stoull(argv[++i]);
+		else if (arg == "--wav" && i + 1 < argc)
+		{
+			wavPath = argv[++i];
+			headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+			frames = stoull(argv[++i]);
+		else if (arg == "--ipf" && i + 1 < argc)
+		{
+			instructionsPerFrame = stoul(argv[++i]);
+			if (instructionsPerFrame == 0)
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--engine" && i + 1 < argc)
+		{
+			if (!EngineFromName(argv[++i], engine))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--help")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (romPath.empty() && arg[0] != '-')
+			romPath = arg;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (romPath.empty() || (!recordPath.empty() && !playPath.empty()) || (!wavPath.empty() && !playPath.empty()))
+	{
+		printUsage();
+		return 1;
+	}
+
+	Profiler profiler;
+	if (!profilePath.empty())
+	{
+		if (!Profiler::Enabled)
+		{
+			cout << "--profile needs a build configured with -DCHIP8_PROFILE=ON" << endl;
+			return 1;
+		}
+		engine = Engine::Interpreter; // the other engines bypass the per-instruction hook.
+	}
+
+	unique_ptr<Machine> Chip8(new Machine());
+	Chip8->SetEngine(engine);
+	if (!profilePath.empty())
+		Chip8->SetProfiler(&profiler);
+	unique_ptr<TraceWriter> tracer;
+	if (!tracePath.empty())
+	{
+		tracer.reset(new TraceWriter(tracePath, traceRing));
+		Chip8->SetTracer(tracer.get());
+	}
+	Chip8->SetIdleSkip(skipIdle);
+	Chip8->SetKeyWaitOnRelease(keyRelease);
+	Chip8->SetQuirks(quirks);
+	// Flags carried over from an earlier run would make a recording depend on more than the movie.
+	if (rplPath.empty() && !headless && recordPath.empty())
+		rplPath = romPath + ".rpl";
+	if (!rplPath.empty())
+		Chip8->SetRplFlagsFile(rplPath);
+	if (seeded)
+		Chip8->SeedRandom(seed);
+	Movie movie(seeded ? seed : Machine::NextSeed());
+
+	if (!headless)
+	{
+		const uint displayScale = 10;
+		SdlFrontend frontend(*Chip8, displayScale);
+		frontend.SetSpeed(instructionsPerFrame, turbo);
+		if (!keyMapPath.empty())
+			frontend.LoadKeyMap(keyMapPath);
+		if (!recordPath.empty())
+			frontend.SetMovie(&movie);
+		frontend.LaunchRom(romPath);
+		if (!recordPath.empty())
+			saveMovie(movie, recordPath);
+		if (!profilePath.empty())
+			saveProfile(profiler, profilePath);
+		return 0;
+	}
+
+	if (realtime || !recordPath.empty() || !wavPath.empty())
+	{
+		Chip8->ResetMachine();
+		Chip8->LoadRom(romPath);
+		if (!recordPath.empty())
+			movie.Start(*Chip8, romPath, instructionsPerFrame);
+
+		// The tone is rendered frame by frame as the callback would play it, without the queue.
+		unique_ptr<WavWriter> wav(wavPath.empty() ? nullptr : new WavWriter(wavPath));
+		ToneGenerator tone;
+		int16_t samples[AUDIO_SAMPLES_PER_FRAME];
+
+		FrameScheduler scheduler(instructionsPerFrame, !realtime);
+		for (uint64_t frame = 0; frame < frames; frame++)
+		{
+			if (!recordPath.empty())
+				movie.RecordFrame(Chip8->GetKeys());
+			scheduler.RunFrame(*Chip8);
+			if (wav)
+			{
+				tone.Render(MakeSoundFrame(*Chip8), samples, AUDIO_SAMPLES_PER_FRAME);
+				wav->Write(samples, AUDIO_SAMPLES_PER_FRAME);
+			}
+			scheduler.EndFrame();
+		}
+		scheduler.PrintStats();
+		printIdleStats(*Chip8);
+		if (wav)
+		{
+			wav->Close();
+			cout << "audio written:    " << wav->GetSampleCount() << " samples at " << AUDIO_SAMPLE_RATE << " Hz to " << wavPath << endl;
+		}
+
+		if (!recordPath.empty())
+		{
+			movie.Finish(*Chip8);
+			saveMovie(movie, recordPath);
+		}
+		if (!profilePath.empty())
+			saveProfile(profiler, profilePath);
+		return 0;
+	}
+
+	RunStats stats;
+	bool matches = true;
+	if (!playPath.empty())
+	{
+		movie = Movie::Load(playPath);
+		const uint64_t before = Chip8->GetInstructionCount();
+		const auto start = chrono::steady_clock::now();
+		matches = movie.Play(*Chip8, romPath);
+		stats.WallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		stats.Instructions = Chip8->GetInstructionCount() - before;
+		cout << "frames:       " << movie.GetHeader().Frames << " in " << movie.GetRunCount() << " key runs\n";
+	}
+	else
+		stats = Chip8->RunHeadless(romPath, frames, instructionsPerFrame);
+
+	cout << "instructions: " << stats.Instructions << "\n";
+	cout << "wall time:    " << stats.WallSeconds << " s\n";
+	cout << "ins/sec:      " << (stats.WallSeconds > 0 ? (uint64_t)(stats.Instructions / stats.WallSeconds) : 0) << endl;
+	if (Chip8->IsWaitingForKey())
+		cout << "blocked on a key wait (FX0A) at 0x" << hex << Chip8->GetProgramCounter() << dec << endl;
+
+	if (const BlockCacheStats *cache = Chip8->GetBlockCacheStats())
+	{
+		const uint64_t lookups = cache->Hits + cache->Misses;
+		cout << "block hits:   " << cache->Hits << " (" << (lookups ? 100.0 * cache->Hits / lookups : 0) << "%)\n";
+		cout << "block builds: " << cache->Misses << "\n";
+		cout << "invalidated:  " << cache->Invalidations << endl;
+	}
+
+	if (const JitStats *jit = Chip8->GetJitStats())
+	{
+		cout << "jit blocks:   " << jit->BlocksCompiled << "\n";
+		cout << "native ins:   " << jit->NativeInstructions << "\n";
+		cout << "interpreted:  " << jit->InterpretedInstructions << "\n";
+		cout << "invalidated:  " << jit->Invalidations << endl;
+	}
+
+	if (const AotStats *aot = Chip8->GetAotStats())
+	{
+		cout << "aot program:  " << (aot->Program ? aot->Program->Name : "none matched the rom") << "\n";
+		cout << "native ins:   " << aot->NativeInstructions << "\n";
+		cout << "interpreted:  " << aot->InterpretedInstructions << "\n";
+		cout << "invalidated:  " << aot->Invalidations << " (" << aot->StaleBlocks << " found overwritten)" << endl;
+	}
+
+	printIdleStats(*Chip8);
+	if (!profilePath.empty())
+		saveProfile(profiler, profilePath);
+
+	if (!playPath.empty())
+	{
+		cout << "final state:  " << (matches ? "matches the recording" : "DIFFERS from the recording") << endl;
+		return matches ? 0 : 3;
+	}
+	return 0;
+}
+
+void saveMovie(Movie &movie, const string &filePath)
+{
+	movie.Save(filePath);
+	cout << "recorded " << movie.GetHeader().Frames << " frames in " << movie.GetRunCount() << " key runs, seed 0x" << hex << movie.GetHeader().Seed << dec << ", to " << filePath << endl;
+}
+
+void printIdleStats(const Machine &machine)
+{
+	if (!machine.GetIdleSkip())
+		return;
+
+	const IdleStats &idle = machine.GetIdleStats();
+	cout << "idle loops:   " << idle.Loops << "\n";
+	cout << "skipped ins:  " << idle.SkippedInstructions << endl;
+}
+
+// The text report to filePath and the collapsed stacks for flamegraph.pl to filePath.folded.
+void saveProfile(const Profiler &profiler, const string &filePath)
+{
+	ofstream report(filePath);
+	profiler.WriteReport(report);
+	ofstream stacks(filePath + ".folded");
+	profiler.WriteCollapsedStacks(stacks);
+	if (!report || !stacks)
+		throw runtime_error("Cannot write the profile to " + filePath);
+	cout << "profile of " << profiler.GetInstructions() << " instructions written to " << filePath << " and " << filePath << ".folded" << endl;
+}
+
+void printUsage()
+{
+	cout << "Usage: CHIP8                                  interactive menu of ../roms/\n";
+	cout << "       CHIP8 <rom>                            run a rom in a window\n";
+	cout << "       CHIP8 --headless [--frames N] <rom>    run N 60 Hz frames without a window (default 600)\n";
+	cout << "       --realtime                             headless, but paced to 60 frames a second\n";
+	cout << "       --ipf N                                instructions per 60 Hz frame (default " << Machine::insPerTimer << ")\n";
+	cout << "       --turbo                                in a window, run frames as fast as possible (or hold Tab)\n";
+	cout << "       --skip-idle                            fast-forward key and delay timer polling loops\n";
+	cout << "       --keymap file                          rebind keys: \"<hex keypad key> <SDL scancode name>\" per line\n";
+	cout << "       --seed N                               seed the CXNN random generator\n";
+	cout << "       --record movie                         record the seed, quirks and keys of every frame (headless: for --frames N)\n";
+	cout << "       --play movie                           replay a recording headless at full speed and check the final state\n";
+	cout << "       --profile file                         opcode, address and call graph counts to file, stacks to file.folded (CHIP8_PROFILE builds)\n";
+	cout << "       --trace file                           log PC, opcode, I, timer and registers before every instruction, see chip8_trace\n";
+	cout << "       --trace-ring N                         keep only the last N trace records, in a memory-mapped ring\n";
+	cout << "       --wav file                             headless, write the sound of the --frames N to a 48 kHz WAV file\n";
+	cout << "       --key-release                          FX0A takes a key when it is released, as on the COSMAC VIP\n";
+	cout << "       --rpl file                             SUPER-CHIP FX75/FX85 flags file (default in a window: <rom>.rpl)\n";
+	cout << "       --quirks default|vip|chip48|schip      shift, load/store, FX1E, BNNN and sprite clipping behaviour of an interpreter\n";
+	cout << "       --quirks xochip                        XO-CHIP: 64 KB of memory, two bitplanes and the audio pattern (interpreter only)\n";
+	cout << "       --engine interpreter|cached            decode every instruction, or run cached basic blocks\n";
+	cout << "       --engine jit|jit-checked               compile hot blocks to x86-64, optionally checked against the interpreter\n";
+	cout << "       --engine aot                           run the blocks chip8_aot compiled from the rom into this build (CHIP8_AOT_ROMS)" << endl;
+}
@@ -0,0 +1,224 @@
+#include "movie.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#define FNV_OFFSET 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+namespace
+{
+	uint64_t Fnv(uint64_t hash, const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	void Put(std::ostream &out, uint64_t value, uint bytes)
+	{
+		for (uint i = 0; i < bytes; i++)
+			out.put((char)(value >> (i * 8)));
+	}
+
+	uint64_t Get(std::istream &in, uint bytes)
+	{
+		uint64_t value = 0;
+		for (uint i = 0; i < bytes; i++)
+		{
+			const int byte = in.get();
+			if (byte == EOF)
+				throw std::runtime_error("The movie file is truncated.");
+			value |= (uint64_t)byte << (i * 8);
+		}
+		return value;
+	}
+
+	void PutVarint(std::ostream &out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.put((char)(value | 0x80));
+			value >>= 7;
+		}
+		out.put((char)value);
+	}
+
+	uint64_t GetVarint(std::istream &in)
+	{
+		uint64_t value = 0;
+		for (uint shift = 0; shift < 64; shift += 7)
+		{
+			const uint64_t byte = Get(in, 1);
+			value |= (byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+		throw std::runtime_error("The movie file has a malformed frame count.");
+	}
+}
+
+Movie::Movie(uint32_t seed)
+{
+	header.Seed = seed;
+}
+
+uint64_t Movie::HashFile(const std::string &filePath, uint32_t &size)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (!file.good())
+		throw std::runtime_error("File error!");
+	const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	size = bytes.size();
+	return Fnv(FNV_OFFSET, bytes.data(), bytes.size());
+}
+
+uint64_t Movie::HashState(const Machine &machine)
+{
+	const MachineState &state = machine.GetState();
+	uint64_t hash = FNV_OFFSET;
+	hash = Fnv(hash, state.Memory, sizeof(state.Memory));
+	hash = Fnv(hash, state.Registers, sizeof(state.Registers));
+	hash = Fnv(hash, &state.DelayTimer, sizeof(state.DelayTimer));
+	hash = Fnv(hash, &state.SoundTimer, sizeof(state.SoundTimer));
+	hash = Fnv(hash, &state.keyWaitRegister, sizeof(state.keyWaitRegister));
+	hash = Fnv(hash, &state.keyWaitKey, sizeof(state.keyWaitKey));
+	hash = Fnv(hash, &state.IndexRegister, sizeof(state.IndexRegister));
+	hash = Fnv(hash, &state.ProgramCounter, sizeof(state.ProgramCounter));
+	hash = Fnv(hash, &state.StackPointer, sizeof(state.StackPointer));
+	hash = Fnv(hash, state.Stack, sizeof(state.Stack));
+	hash = Fnv(hash, &state.randomState, sizeof(state.randomState));
+	hash = Fnv(hash, state.bDisplay, sizeof(state.bDisplay));
+	hash = Fnv(hash, state.bDisplayRight, sizeof(state.bDisplayRight));
+	hash = Fnv(hash, &state.hiRes, sizeof(state.hiRes));
+	hash = Fnv(hash, &state.exited, sizeof(state.exited));
+	hash = Fnv(hash, state.rplFlags, sizeof(state.rplFlags));
+	hash = Fnv(hash, &state.Keys, sizeof(state.Keys));
+	if (const XoChipState *xo = machine.GetXoChipState())
+	{
+		hash = Fnv(hash, xo->Memory, sizeof(xo->Memory));
+		hash = Fnv(hash, xo->bPlane, sizeof(xo->bPlane));
+		hash = Fnv(hash, xo->bPlaneRight, sizeof(xo->bPlaneRight));
+		hash = Fnv(hash, &xo->Planes, sizeof(xo->Planes));
+		hash = Fnv(hash, xo->AudioPattern, sizeof(xo->AudioPattern));
+		hash = Fnv(hash, &xo->Pitch, sizeof(xo->Pitch));
+	}
+	return hash;
+}
+
+void Movie::Start(Machine &machine, const std::string &romPath, uint instructionsPerFrame)
+{
+	header.RomHash = HashFile(romPath, header.RomSize);
+	header.InstructionsPerFrame = instructionsPerFrame;
+	header.Quirks = machine.GetKeyWaitOnRelease() ? MOVIE_QUIRK_KEY_RELEASE : 0;
+	header.Quirks |= (uint32_t)machine.GetQuirks() << MOVIE_QUIRK_PROFILE_SHIFT;
+	header.Frames = 0;
+	header.FinalStateHash = 0;
+	runs.clear();
+	machine.SeedRandom(header.Seed);
+}
+
+void Movie::RecordFrame(uint16_t keys)
+{
+	if (runs.empty() || runs.back().Keys != keys)
+		runs.push_back({keys, 0});
+	runs.back().Frames++;
+	header.Frames++;
+}
+
+void Movie::Finish(const Machine &machine)
+{
+	header.FinalStateHash = HashState(machine);
+}
+
+bool Movie::Play(Machine &machine, const std::string &romPath) const
+{
+	uint32_t romSize;
+	if (HashFile(romPath, romSize) != header.RomHash || romSize != header.RomSize)
+		throw std::runtime_error("The movie was recorded with a different rom than " + romPath);
+
+	// The profile first: it decides how much rom fits.
+	machine.SetQuirks((QuirkProfile)((header.Quirks >> MOVIE_QUIRK_PROFILE_SHIFT) & 0xFF));
+	machine.ResetMachine();
+	machine.LoadRom(romPath);
+	machine.SeedRandom(header.Seed);
+	machine.SetKeyWaitOnRelease(header.Quirks & MOVIE_QUIRK_KEY_RELEASE);
+
+	// Keys only change between runs, so each run is one RunFrames call.
+	for (const Run &run : runs)
+	{
+		machine.SetKeys(run.Keys);
+		machine.RunFrames(run.Frames, header.InstructionsPerFrame);
+	}
+	return HashState(machine) == header.FinalStateHash;
+}
+
+void Movie::Save(const std::string &filePath) const
+{
+	std::ofstream file(filePath, std::ios::binary);
+	if (!file.good())
+		throw std::runtime_error("Could not write movie " + filePath);
+
+	file.write(MOVIE_MAGIC, 4);
+	Put(file, MOVIE_VERSION, 2);
+	Put(file, header.RomHash, 8);
+	Put(file, header.RomSize, 4);
+	Put(file, header.Seed, 4);
+	Put(file, header.InstructionsPerFrame, 4);
+	Put(file, header.Quirks, 4);
+	Put(file, header.Frames, 8);
+	Put(file, header.FinalStateHash, 8);
+	Put(file, runs.size(), 4);
+	for (const Run &run : runs)
+	{
+		Put(file, run.Keys, 2);
+		PutVarint(file, run.Frames);
+	}
+	if (!file.good())
+		throw std::runtime_error("Could not write movie " + filePath);
+}
+
+Movie Movie::Load(const std::string &filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (!file.good())
+		throw std::runtime_error("Could not open movie " + filePath);
+
+	char magic[4];
+	if (!file.read(magic, 4) || std::string(magic, 4) != MOVIE_MAGIC)
+		throw std::runtime_error(filePath + " is not a movie file.");
+	if (Get(file, 2) != MOVIE_VERSION)
+		throw std::runtime_error(filePath + " has an unsupported movie version.");
+
+	Movie movie;
+	movie.header.RomHash = Get(file, 8);
+	movie.header.RomSize = Get(file, 4);
+	movie.header.Seed = Get(file, 4);
+	movie.header.InstructionsPerFrame = Get(file, 4);
+	movie.header.Quirks = Get(file, 4);
+	movie.header.Frames = Get(file, 8);
+	movie.header.FinalStateHash = Get(file, 8);
+	if (movie.header.InstructionsPerFrame == 0)
+		throw std::runtime_error(filePath + " has no instructions per frame.");
+	if (((movie.header.Quirks >> MOVIE_QUIRK_PROFILE_SHIFT) & 0xFF) > (uint)QuirkProfile::XoChip)
+		throw std::runtime_error(filePath + " has an unknown quirk profile.");
+
+	const uint64_t runCount = Get(file, 4);
+	uint64_t frames = 0;
+	for (uint64_t i = 0; i < runCount; i++)
+	{
+		Run run;
+		run.Keys = Get(file, 2);
+		run.Frames = GetVarint(file);
+		frames += run.Frames;
+		movie.runs.push_back(run);
+	}
+	if (frames != movie.header.Frames)
+		throw std::runtime_error(filePath + " has runs that do not add up to its frame count.");
+	return movie;
+}
@@ -2,15 +2,173 @@
 
 #include "machine.h"
 
+#include <cstring>
+#include <stdexcept>
+
+// A faulty rom fails with an error instead of reading or writing past the address space.
+template <class Quirks>
+static void CheckIndexRange(uint index, uint length)
+{
+	if (index + length > (Quirks::XoChip ? XO_MEMORY_SIZE : MEMORY_SIZE))
+		throw std::runtime_error("IndexRegister out of bounds.");
+}
+
+// I after FX55 or FX65 stored or loaded V0 to VX.
+template <class Quirks>
+static void AdvanceIndex(uint16_t &index, uint X)
+{
+	if constexpr (Quirks::LoadStoreIncrement == IndexIncrement::XPlusOne)
+		index += X + 1;
+	else if constexpr (Quirks::LoadStoreIncrement == IndexIncrement::X)
+		index += X;
+}
+
+// A sprite row of Width bits, top-aligned in a word so column 0 is the most significant bit.
+template <uint Width>
+static uint64_t SpriteRow(const uint8_t *bytes)
+{
+	if constexpr (Width == 16)
+		return (uint64_t)(bytes[0] << 8 | bytes[1]) << (DISPLAY_ARRAY_WIDTH - 16);
+	else
+		return (uint64_t)bytes[0] << (DISPLAY_ARRAY_WIDTH - 8);
+}
+
+// Calls apply with the left and right row words of each plane the opcode acts on: the one
+// display of a classic machine, or the planes FN01 selected on XO-CHIP.
+template <class Quirks, class Apply>
+void Machine::ForEachPlane(Apply apply)
+{
+	if constexpr (Quirks::XoChip)
+	{
+		if (xo->Planes & 1)
+			apply(bDisplay, bDisplayRight);
+		if (xo->Planes & 2)
+			apply(xo->bPlane, xo->bPlaneRight);
+	}
+	else
+		apply(bDisplay, bDisplayRight);
+}
+
+// A taken skip passes the next instruction, which on XO-CHIP may be the four-byte F000 NNNN.
+template <class Quirks>
+uint Machine::SkipLength() const
+{
+	if constexpr (Quirks::XoChip)
+		return xo->Memory[(ProgramCounter + 2) & 0xFFFF] == 0xF0 && xo->Memory[(ProgramCounter + 3) & 0xFFFF] == 0x00 ? 6 : 4;
+	else
+		return 4;
+}
+
+template <class Quirks>
 void Machine::CLS() // 00E0
 {
-	ClearDisplayMatrix(); // fix that.
-	UpdateDisplay();
+	ForEachPlane<Quirks>([this](uint64_t *left, uint64_t *right)
+						 { ClearDisplayMatrix(left, right); });
+	dirtyRows = AllDisplayRows();
+	ProgramCounter += 2;
+}
+
+// Scrolls move whole row words: memmove down or up, a shift of each word, carried between the
+// two words of a hi-res row, sideways. Distances are in pixels of the current mode.
+template <class Quirks>
+void Machine::SCD_N(uint N) // 00CN
+{
+	const uint height = GetDisplayHeight();
+	ForEachPlane<Quirks>([&](uint64_t *left, uint64_t *right)
+						 {
+		memmove(left + N, left, (height - N) * sizeof(uint64_t));
+		memset(left, 0, N * sizeof(uint64_t));
+		if (hiRes)
+		{
+			memmove(right + N, right, (height - N) * sizeof(uint64_t));
+			memset(right, 0, N * sizeof(uint64_t));
+		} });
+	dirtyRows = AllDisplayRows();
+	ProgramCounter += 2;
+}
+
+void Machine::SCU_N(uint N) // 00DN, XO-CHIP.
+{
+	const uint height = GetDisplayHeight();
+	ForEachPlane<XoChipQuirks>([&](uint64_t *left, uint64_t *right)
+							   {
+		memmove(left, left + N, (height - N) * sizeof(uint64_t));
+		memset(left + height - N, 0, N * sizeof(uint64_t));
+		if (hiRes)
+		{
+			memmove(right, right + N, (height - N) * sizeof(uint64_t));
+			memset(right + height - N, 0, N * sizeof(uint64_t));
+		} });
+	dirtyRows = AllDisplayRows();
+	ProgramCounter += 2;
+}
+
+template <class Quirks>
+void Machine::SCR() // 00FB
+{
+	ForEachPlane<Quirks>([this](uint64_t *left, uint64_t *right)
+						 {
+		if (hiRes)
+		{
+			for (uint row = 0; row < DISPLAY_HIRES_HEIGHT; row++)
+			{
+				right[row] = right[row] >> 4 | left[row] << (DISPLAY_ARRAY_WIDTH - 4);
+				left[row] >>= 4;
+			}
+		}
+		else
+		{
+			for (uint row = 0; row < DISPLAY_ARRAY_HEIGHT; row++)
+				left[row] >>= 4;
+		} });
+	dirtyRows = AllDisplayRows();
+	ProgramCounter += 2;
+}
+
+template <class Quirks>
+void Machine::SCL() // 00FC
+{
+	ForEachPlane<Quirks>([this](uint64_t *left, uint64_t *right)
+						 {
+		if (hiRes)
+		{
+			for (uint row = 0; row < DISPLAY_HIRES_HEIGHT; row++)
+			{
+				left[row] = left[row] << 4 | right[row] >> (DISPLAY_ARRAY_WIDTH - 4);
+				right[row] <<= 4;
+			}
+		}
+		else
+		{
+			for (uint row = 0; row < DISPLAY_ARRAY_HEIGHT; row++)
+				left[row] <<= 4;
+		} });
+	dirtyRows = AllDisplayRows();
+	ProgramCounter += 2;
+}
+
+void Machine::EXIT() // 00FD
+{
+	// PC stays here, so Step returns as it does for FX0A.
+	exited = true;
+}
+
+void Machine::LOW() // 00FE
+{
+	SetHiRes(false);
+	ProgramCounter += 2;
+}
+
+void Machine::HIGH() // 00FF
+{
+	SetHiRes(true);
 	ProgramCounter += 2;
 }
 
 void Machine::RET() // 00EE
 {
+	if (StackPointer == 0)
+		throw std::runtime_error("Stack underflow.");
 	ProgramCounter = Stack[StackPointer];
 	StackPointer--;
 	ProgramCounter += 2;
@@ -23,32 +181,57 @@ void Machine::JMP(uint address) // 1NNN
 
 void Machine::CALL_NNN(uint address) // 2NNN
 {
+	if (StackPointer + 1 >= STACK_SIZE)
+		throw std::runtime_error("Stack overflow.");
 	StackPointer++;
 	Stack[StackPointer] = ProgramCounter;
 	ProgramCounter = address;
 }
 
+template <class Quirks>
 void Machine::SE_XNN(uint X, uint value) // 3XNN
 {
 	if (Registers[X] == value)
-		ProgramCounter += 4;
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SNE_XNN(uint X, uint value) // 4XNN
 {
 	if (Registers[X] != value)
-		ProgramCounter += 4;
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SE_XY(uint X, uint Y) // 5XY0
 {
 	if (Registers[X] == Registers[Y])
-		ProgramCounter += 4;
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
+// XO-CHIP stores and loads VX to VY at I, in either direction, leaving I alone.
+void Machine::LD_IXY(uint X, uint Y) // 5XY2
+{
+	const uint count = (X > Y ? X - Y : Y - X) + 1;
+	CheckIndexRange<XoChipQuirks>(IndexRegister, count);
+	for (uint i = 0; i < count; i++)
+		xo->Memory[IndexRegister + i] = Registers[X > Y ? X - i : X + i];
+	OnMemoryWrite(IndexRegister, count);
+	ProgramCounter += 2;
+}
+
+void Machine::LD_XYI(uint X, uint Y) // 5XY3
+{
+	const uint count = (X > Y ? X - Y : Y - X) + 1;
+	CheckIndexRange<XoChipQuirks>(IndexRegister, count);
+	for (uint i = 0; i < count; i++)
+		Registers[X > Y ? X - i : X + i] = xo->Memory[IndexRegister + i];
+	ProgramCounter += 2;
+}
+
 void Machine::LD_XNN(uint X, uint value) // 6XNN
 {
 	Registers[X] = value;
@@ -67,21 +250,30 @@ void Machine::LD_XY(uint X, uint Y) // 8XY0
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::OR_XY(uint X, uint Y) // 8XY1
 {
 	Registers[X] |= Registers[Y];
+	if constexpr (Quirks::LogicResetsVF)
+		Registers[VF] = 0;
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::AND_XY(uint X, uint Y) // 8XY2
 {
 	Registers[X] &= Registers[Y];
+	if constexpr (Quirks::LogicResetsVF)
+		Registers[VF] = 0;
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::XOR_XY(uint X, uint Y) // 8XY3
 {
 	Registers[X] ^= Registers[Y];
+	if constexpr (Quirks::LogicResetsVF)
+		Registers[VF] = 0;
 	ProgramCounter += 2;
 }
 
@@ -103,10 +295,20 @@ void Machine::SUB_XY(uint X, uint Y) // 8XY5
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SHR_XY(uint X, uint Y) // 8XY6
 {
-	Registers[VF] = Registers[X] & 0x01;
-	Registers[X] /= 2;
+	if constexpr (Quirks::ShiftReadsVY)
+	{
+		const uint8_t value = Registers[Y];
+		Registers[X] = value >> 1;
+		Registers[VF] = value & 0x01;
+	}
+	else
+	{
+		Registers[VF] = Registers[X] & 0x01;
+		Registers[X] /= 2;
+	}
 	ProgramCounter += 2;
 }
 
@@ -119,17 +321,28 @@ void Machine::SUBN_XY(uint X, uint Y) // 8XY7
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SHL_XY(uint X, uint Y) // 8XYE
 {
-	Registers[VF] = (Registers[X] & 0x80) >> 7;
-	Registers[X] *= 2;
+	if constexpr (Quirks::ShiftReadsVY)
+	{
+		const uint8_t value = Registers[Y];
+		Registers[X] = value << 1;
+		Registers[VF] = (value & 0x80) >> 7;
+	}
+	else
+	{
+		Registers[VF] = (Registers[X] & 0x80) >> 7;
+		Registers[X] *= 2;
+	}
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SNE_XY(uint X, uint Y) // 9XY0
 {
 	if (Registers[X] != Registers[Y])
-		ProgramCounter += 4;
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
@@ -139,62 +352,143 @@ void Machine::LD_INNN(uint address) // ANNN
 	ProgramCounter += 2;
 }
 
-void Machine::JMP_0NNN(uint address) // BNNN
+void Machine::LD_INNNN() // F000 NNNN, XO-CHIP.
 {
-	ProgramCounter = Registers[0] + address;
+	IndexRegister = MergeBytes(xo->Memory[(ProgramCounter + 2) & 0xFFFF], xo->Memory[(ProgramCounter + 3) & 0xFFFF]);
+	ProgramCounter += 4;
+}
+
+template <class Quirks>
+void Machine::JMP_0NNN(uint address) // BNNN, or BXNN
+{
+	ProgramCounter = Registers[Quirks::JumpAddsVX ? address >> 8 : 0] + address;
 }
 
 void Machine::RND_XNN(uint X, uint value) // CXNN
 {
-	Registers[X] = (rand() % 256) & value;
+	Registers[X] = NextRandom() & value;
 	ProgramCounter += 2;
 }
 
-void Machine::DRW_XYN(uint X, uint Y, uint value) // DXYN
+// XO-CHIP takes one sprite after another from I, for each plane drawn.
+template <class Quirks>
+uint Machine::SpriteBytes(uint bytes) const
 {
-	uint ycoord = Registers[Y] % DISPLAY_ARRAY_HEIGHT;
-	bool pixelFlipped = false;
-	for (uint row = 0; row < value; row++)
+	if constexpr (Quirks::XoChip)
+		return bytes * __builtin_popcount(xo->Planes);
+	else
+		return bytes;
+}
+
+template <class Quirks, uint Width>
+void Machine::DrawLoRes(uint X, uint Y, uint rows)
+{
+	// The start always wraps. A sprite row is rotated into place, so it wraps around the screen
+	// edge like before, or shifted, so what passes the edge is dropped; rows below the bottom too.
+	const uint xcoord = Registers[X] % DISPLAY_ARRAY_WIDTH;
+	const uint ystart = Registers[Y] % DISPLAY_ARRAY_HEIGHT;
+	const uint spriteBytes = rows * Width / 8;
+	const uint8_t *sprite = MemoryOf<Quirks::XoChip>() + IndexRegister;
+	uint64_t flipped = 0;
+	CheckIndexRange<Quirks>(IndexRegister, SpriteBytes<Quirks>(spriteBytes));
+	if constexpr (Quirks::ClipSprites)
 	{
-		uint8_t byte = Memory[IndexRegister + row];
-		for (uint col = 0; col < 8; col++)
+		if (rows > DISPLAY_ARRAY_HEIGHT - ystart)
+			rows = DISPLAY_ARRAY_HEIGHT - ystart;
+	}
+	ForEachPlane<Quirks>([&](uint64_t *display, uint64_t *)
+						 {
+		uint ycoord = ystart;
+		for (uint row = 0; row < rows; row++)
 		{
-			uint xcoord = (Registers[X] + col) % DISPLAY_ARRAY_WIDTH;
-			bool currentPosition = bDisplay[ycoord][xcoord];
-			uint oneBit = byte & (0x01 << (7 - col));
-			if (oneBit > 0)
-			{
-				if (currentPosition == 1)
-				{
-					bDisplay[ycoord][xcoord] = 0;
-					pixelFlipped = true;
-				}
-				else
-				{
-					bDisplay[ycoord][xcoord] = 1;
-				}		
-			}
+			const uint64_t bits = SpriteRow<Width>(sprite + row * Width / 8);
+			uint64_t placed = bits >> xcoord;
+			if constexpr (!Quirks::ClipSprites)
+				placed |= bits << ((DISPLAY_ARRAY_WIDTH - xcoord) % DISPLAY_ARRAY_WIDTH);
+			flipped |= display[ycoord] & placed;
+			display[ycoord] ^= placed;
+			dirtyRows |= 1ull << ycoord;
+			ycoord++;
+			ycoord %= DISPLAY_ARRAY_HEIGHT;
 		}
-		ycoord++;
-		ycoord %= DISPLAY_ARRAY_HEIGHT;
+		sprite += spriteBytes; });
+	Registers[VF] = (flipped != 0 ? 1 : 0);
+
+	ProgramCounter += 2;
+}
+
+// As DrawLoRes over the two words of each 128-column row. VF is 1 on any collision, as on
+// later interpreters, rather than SUPER-CHIP 1.1's count of colliding rows.
+template <class Quirks, uint Width>
+void Machine::DrawHiRes(uint X, uint Y, uint rows)
+{
+	const uint xcoord = Registers[X] % DISPLAY_HIRES_WIDTH;
+	const uint ystart = Registers[Y] % DISPLAY_HIRES_HEIGHT;
+	const uint word = xcoord / DISPLAY_ARRAY_WIDTH;
+	const uint shift = xcoord % DISPLAY_ARRAY_WIDTH;
+	const uint spriteBytes = rows * Width / 8;
+	const uint8_t *sprite = MemoryOf<Quirks::XoChip>() + IndexRegister;
+	uint64_t flipped = 0;
+	CheckIndexRange<Quirks>(IndexRegister, SpriteBytes<Quirks>(spriteBytes));
+	if constexpr (Quirks::ClipSprites)
+	{
+		if (rows > DISPLAY_HIRES_HEIGHT - ystart)
+			rows = DISPLAY_HIRES_HEIGHT - ystart;
 	}
-	Registers[VF] = (pixelFlipped ? 1 : 0);
-	UpdateDisplay();
+	ForEachPlane<Quirks>([&](uint64_t *left, uint64_t *right)
+						 {
+		uint ycoord = ystart;
+		for (uint row = 0; row < rows; row++)
+		{
+			const uint64_t bits = SpriteRow<Width>(sprite + row * Width / 8);
+			uint64_t placed[3] = {0, 0, 0}; // columns 0-63, 64-127 and what passed the right edge.
+			placed[word] = bits >> shift;
+			if (shift != 0)
+				placed[word + 1] = bits << (DISPLAY_ARRAY_WIDTH - shift);
+			if constexpr (!Quirks::ClipSprites)
+				placed[0] |= placed[2];
+			flipped |= (left[ycoord] & placed[0]) | (right[ycoord] & placed[1]);
+			left[ycoord] ^= placed[0];
+			right[ycoord] ^= placed[1];
+			dirtyRows |= 1ull << ycoord;
+			ycoord++;
+			ycoord %= DISPLAY_HIRES_HEIGHT;
+		}
+		sprite += spriteBytes; });
+	Registers[VF] = (flipped != 0 ? 1 : 0);
 
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
+void Machine::DRW_XYN(uint X, uint Y, uint value) // DXYN
+{
+	if (hiRes)
+		DrawHiRes<Quirks, 8>(X, Y, value);
+	else DrawLoRes<Quirks, 8>(X, Y, value);
+}
+
+template <class Quirks>
+void Machine::DRW_XY0(uint X, uint Y) // DXY0, 16x16 in either mode.
+{
+	if (hiRes)
+		DrawHiRes<Quirks, 16>(X, Y, 16);
+	else DrawLoRes<Quirks, 16>(X, Y, 16);
+}
+
+template <class Quirks>
 void Machine::SKP_X(uint X) // EX9E
 {
-	if (Keys[Registers[X]] == true) // changed.
-		ProgramCounter += 4;
+	if ((Keys >> (Registers[X] & 0xF)) & 1)
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::SKNP_X(uint X) // EXA1
 {
-	if (Keys[Registers[X]] != true)
-		ProgramCounter += 4;
+	if (((Keys >> (Registers[X] & 0xF)) & 1) == 0)
+		ProgramCounter += SkipLength<Quirks>();
 	else ProgramCounter += 2;
 }
 
@@ -206,34 +500,19 @@ void Machine::LD_XDT(uint X) // FX07
 
 void Machine::LD_XK(uint X) // FX0A
 {
-	// to mozna zmienic.
-	bool keyPressed = false;
-	do
+	// A held key is taken at once; otherwise the machine blocks with PC left on this instruction
+	// and SetKey finishes it. On release only a key pressed after the wait began counts.
+	if (!keyWaitOnRelease && Keys != 0)
 	{
-		while (SDL_PollEvent(&Event) != 0)
-		{
-			if (Event.type == SDL_WINDOWEVENT)
-			{
-				if (Event.window.event == SDL_WINDOWEVENT_CLOSE)
-				{
-					quitFlag = true;
-					keyPressed = true;
-					break;
-				}
-			}
-			else if (Event.type == SDL_KEYDOWN)
-			{
-				std::string pressedCharacter = SDL_GetKeyName(Event.key.keysym.sym);
-				if (pressedCharacter.length() == 1 && Keyboard.count(pressedCharacter[0]) == 1)
-				{
-					Registers[X] = fromHex(Keyboard[pressedCharacter[0]]);
-					keyPressed = true;
-					break;
-				}
-			}
-		}
-	} while (!keyPressed);
-	ProgramCounter += 2;
+		Registers[X] = __builtin_ctz(Keys);
+		ProgramCounter += 2;
+		return;
+	}
+	if (!IsWaitingForKey())
+	{
+		keyWaitRegister = X;
+		keyWaitKey = KEY_WAIT_NONE;
+	}
 }
 
 void Machine::LD_DTX(uint X) // FX15
@@ -244,16 +523,19 @@ void Machine::LD_DTX(uint X) // FX15
 
 void Machine::LD_STX(uint X) // FX18
 {
-	BeepFor(Registers[X]);
+	SoundTimer = Registers[X];
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::ADD_IX(uint X) // FX1E
 {
-	// changed.
-	if (IndexRegister + Registers[X] > 0xFFF)
-		Registers[VF] = 1;
-	else Registers[VF] = 0;
+	if constexpr (Quirks::AddIndexSetsVF)
+	{
+		if (IndexRegister + Registers[X] > 0xFFF)
+			Registers[VF] = 1;
+		else Registers[VF] = 0;
+	}
 	IndexRegister += Registers[X];
 	ProgramCounter += 2;
 }
@@ -264,30 +546,107 @@ void Machine::LD_FX(uint X) // FX29
 	ProgramCounter += 2;
 }
 
+void Machine::LD_HFX(uint X) // FX30
+{
+	IndexRegister = BIG_FONTS_ADDRESS + (Registers[X] & 0xF) * 10;
+	ProgramCounter += 2;
+}
+
+template <class Quirks>
 void Machine::LD_BX(uint X) // FX33
 {
-	Memory[IndexRegister] = Registers[X] / 100;
-	Memory[IndexRegister + 1] = (Registers[X] / 10) % 10;
-	Memory[IndexRegister + 2] = Registers[X] % 10;
+	uint8_t *memory = MemoryOf<Quirks::XoChip>();
+	CheckIndexRange<Quirks>(IndexRegister, 3);
+	memory[IndexRegister] = Registers[X] / 100;
+	memory[IndexRegister + 1] = (Registers[X] / 10) % 10;
+	memory[IndexRegister + 2] = Registers[X] % 10;
+	OnMemoryWrite(IndexRegister, 3);
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::LD_IX(uint X) // FX55
 {
+	uint8_t *memory = MemoryOf<Quirks::XoChip>();
+	CheckIndexRange<Quirks>(IndexRegister, X + 1);
 	for (uint i = 0; i <= X; i++)
-		Memory[IndexRegister + i] = Registers[i];
+		memory[IndexRegister + i] = Registers[i];
+	OnMemoryWrite(IndexRegister, X + 1);
 
-	// On the original interpreter?
-	IndexRegister += X + 1;
+	AdvanceIndex<Quirks>(IndexRegister, X);
 	ProgramCounter += 2;
 }
 
+template <class Quirks>
 void Machine::LD_XI(uint X) // FX65
 {
+	const uint8_t *memory = MemoryOf<Quirks::XoChip>();
+	CheckIndexRange<Quirks>(IndexRegister, X + 1);
 	for (uint i = 0; i <= X; i++)
-		Registers[i] = Memory[IndexRegister + i];
+		Registers[i] = memory[IndexRegister + i];
+
+	AdvanceIndex<Quirks>(IndexRegister, X);
+	ProgramCounter += 2;
+}
+
+void Machine::LD_RX(uint X) // FX75
+{
+	memcpy(rplFlags, Registers, X + 1);
+	SaveRplFlags();
+	ProgramCounter += 2;
+}
 
-	// On the original interpreter?
-	IndexRegister += X + 1;
+void Machine::LD_XR(uint X) // FX85
+{
+	memcpy(Registers, rplFlags, X + 1);
 	ProgramCounter += 2;
-}
\ No newline at end of file
+}
+
+void Machine::PLANE_N(uint N) // FN01, XO-CHIP.
+{
+	xo->Planes = N & 3;
+	ProgramCounter += 2;
+}
+
+void Machine::AUDIO() // F002, XO-CHIP.
+{
+	CheckIndexRange<XoChipQuirks>(IndexRegister, XO_AUDIO_PATTERN_SIZE);
+	memcpy(xo->AudioPattern, xo->Memory + IndexRegister, XO_AUDIO_PATTERN_SIZE);
+	ProgramCounter += 2;
+}
+
+void Machine::PITCH_X(uint X) // FX3A, XO-CHIP.
+{
+	xo->Pitch = Registers[X];
+	ProgramCounter += 2;
+}
+
+#define INSTANTIATE_QUIRK_OPCODES(Quirks)                           \
+	template void Machine::CLS<Quirks>();                           \
+	template void Machine::SCD_N<Quirks>(uint);                     \
+	template void Machine::SCR<Quirks>();                           \
+	template void Machine::SCL<Quirks>();                           \
+	template void Machine::SE_XNN<Quirks>(uint, uint);              \
+	template void Machine::SNE_XNN<Quirks>(uint, uint);             \
+	template void Machine::SE_XY<Quirks>(uint, uint);               \
+	template void Machine::OR_XY<Quirks>(uint, uint);               \
+	template void Machine::AND_XY<Quirks>(uint, uint);              \
+	template void Machine::XOR_XY<Quirks>(uint, uint);              \
+	template void Machine::SHR_XY<Quirks>(uint, uint);              \
+	template void Machine::SHL_XY<Quirks>(uint, uint);              \
+	template void Machine::SNE_XY<Quirks>(uint, uint);              \
+	template void Machine::JMP_0NNN<Quirks>(uint);                  \
+	template void Machine::DRW_XYN<Quirks>(uint, uint, uint);       \
+	template void Machine::DRW_XY0<Quirks>(uint, uint);             \
+	template void Machine::SKP_X<Quirks>(uint);                     \
+	template void Machine::SKNP_X<Quirks>(uint);                    \
+	template void Machine::ADD_IX<Quirks>(uint);                    \
+	template void Machine::LD_BX<Quirks>(uint);                     \
+	template void Machine::LD_IX<Quirks>(uint);                     \
+	template void Machine::LD_XI<Quirks>(uint);
+
+INSTANTIATE_QUIRK_OPCODES(DefaultQuirks)
+INSTANTIATE_QUIRK_OPCODES(VipQuirks)
+INSTANTIATE_QUIRK_OPCODES(Chip48Quirks)
+INSTANTIATE_QUIRK_OPCODES(SchipQuirks)
+INSTANTIATE_QUIRK_OPCODES(XoChipQuirks)
\ No newline at end of file
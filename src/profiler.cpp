@@ -0,0 +1,175 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <ostream>
+
+#include "disassembler.h"
+
+Profiler::Profiler()
+{
+	Clear();
+}
+
+void Profiler::Clear()
+{
+	opcodeCounts.assign(OPCODES_COUNT, 0);
+	pcCounts.assign(XO_MEMORY_SIZE, 0);
+	pcOpcodes.assign(XO_MEMORY_SIZE, 0);
+	nodes.clear();
+	nodes.push_back(CallNode{PROFILE_ROOT_NODE, 0x200, 0, 0, 0, {}});
+	current = PROFILE_ROOT_NODE;
+	instructions = 0;
+	cpuSeconds = 0;
+	displaySeconds = 0;
+	displayUpdates = 0;
+}
+
+void Profiler::EnterCall(uint16_t function)
+{
+	for (uint32_t child : nodes[current].Children)
+	{
+		if (nodes[child].Function == function)
+		{
+			current = child;
+			nodes[current].Calls++;
+			return;
+		}
+	}
+
+	// Past the limit new paths are charged to the caller rather than growing without bound.
+	if (nodes.size() >= PROFILE_MAX_CALL_NODES)
+		return;
+
+	const uint32_t child = nodes.size();
+	nodes.push_back(CallNode{current, function, (uint8_t)(nodes[current].Depth + 1), 0, 0, {}});
+	nodes[current].Children.push_back(child);
+	current = child;
+	nodes[current].Calls++;
+}
+
+static std::string Hex(uint value, int digits)
+{
+	char text[16];
+	snprintf(text, sizeof(text), "0x%0*X", digits, value);
+	return text;
+}
+
+std::string Profiler::PathOf(uint32_t node) const
+{
+	std::string path = Hex(nodes[node].Function, 3);
+	for (uint32_t parent = node; parent != PROFILE_ROOT_NODE;)
+	{
+		parent = nodes[parent].Parent;
+		path = Hex(nodes[parent].Function, 3) + ";" + path;
+	}
+	return path;
+}
+
+void Profiler::WriteReport(std::ostream &out) const
+{
+	const double total = instructions ? (double)instructions : 1;
+	char line[160];
+
+	out << "instructions:  " << instructions << "\n";
+	if (cpuSeconds + displaySeconds > 0)
+	{
+		const double both = cpuSeconds + displaySeconds;
+		snprintf(line, sizeof(line), "cpu time:      %.3f ms (%.1f%%)\n", cpuSeconds * 1e3, 100 * cpuSeconds / both);
+		out << line;
+		snprintf(line, sizeof(line), "display time:  %.3f ms (%.1f%%) over %llu updates\n", displaySeconds * 1e3, 100 * displaySeconds / both,
+				 (unsigned long long)displayUpdates);
+		out << line;
+	}
+
+	std::map<std::string, uint64_t> patterns;
+	for (uint opcode = 0; opcode < OPCODES_COUNT; opcode++)
+		if (opcodeCounts[opcode])
+			patterns[OpcodePattern(opcode)] += opcodeCounts[opcode];
+	std::vector<std::pair<uint64_t, std::string>> byCount;
+	for (const auto &pattern : patterns)
+		byCount.push_back({pattern.second, pattern.first});
+	std::sort(byCount.rbegin(), byCount.rend());
+
+	out << "\nopcodes:\n";
+	for (const auto &entry : byCount)
+	{
+		snprintf(line, sizeof(line), "  %-22s %14llu %6.2f%%\n", entry.second.c_str(), (unsigned long long)entry.first, 100 * entry.first / total);
+		out << line;
+	}
+
+	std::vector<uint16_t> hot;
+	for (uint pc = 0; pc < XO_MEMORY_SIZE; pc++)
+		if (pcCounts[pc])
+			hot.push_back(pc);
+	std::stable_sort(hot.begin(), hot.end(), [this](uint16_t a, uint16_t b)
+					 { return pcCounts[a] > pcCounts[b]; });
+	if (hot.size() > PROFILE_REPORT_ROWS)
+		hot.resize(PROFILE_REPORT_ROWS);
+
+	out << "\nhot addresses:\n";
+	for (uint16_t pc : hot)
+	{
+		snprintf(line, sizeof(line), "  %s %-18s %14llu %6.2f%%\n", Hex(pc, 3).c_str(), Disassemble(pcOpcodes[pc]).c_str(),
+				 (unsigned long long)pcCounts[pc], 100 * pcCounts[pc] / total);
+		out << line;
+	}
+
+	// Inclusive counts: a node's own instructions plus those of everything it called.
+	std::vector<uint64_t> inclusive(nodes.size());
+	for (size_t node = nodes.size(); node-- > 0;)
+	{
+		inclusive[node] += nodes[node].Instructions;
+		if (node != PROFILE_ROOT_NODE)
+			inclusive[nodes[node].Parent] += inclusive[node];
+	}
+
+	std::map<uint16_t, uint64_t> calls, self, functionInclusive;
+	std::map<std::pair<uint16_t, uint16_t>, uint64_t> edges;
+	for (size_t node = 0; node < nodes.size(); node++)
+	{
+		const CallNode &call = nodes[node];
+		self[call.Function] += call.Instructions;
+		// Recursion would count a function's inclusive time once per level on the stack.
+		bool outermost = true;
+		for (uint32_t parent = node; parent != PROFILE_ROOT_NODE && outermost;)
+		{
+			parent = nodes[parent].Parent;
+			outermost = nodes[parent].Function != call.Function;
+		}
+		if (outermost)
+			functionInclusive[call.Function] += inclusive[node];
+		if (node != PROFILE_ROOT_NODE)
+		{
+			calls[call.Function] += call.Calls;
+			edges[{nodes[call.Parent].Function, call.Function}] += call.Calls;
+		}
+	}
+
+	out << "\nfunctions:       calls           self      inclusive\n";
+	for (const auto &function : self)
+	{
+		snprintf(line, sizeof(line), "  %s %14llu %14llu %14llu\n", Hex(function.first, 3).c_str(), (unsigned long long)calls[function.first],
+				 (unsigned long long)function.second, (unsigned long long)functionInclusive[function.first]);
+		out << line;
+	}
+
+	out << "\ncalls:\n";
+	for (const auto &edge : edges)
+	{
+		snprintf(line, sizeof(line), "  %s -> %s %14llu\n", Hex(edge.first.first, 3).c_str(), Hex(edge.first.second, 3).c_str(), (unsigned long long)edge.second);
+		out << line;
+	}
+	if (nodes.size() >= PROFILE_MAX_CALL_NODES)
+		out << "(call paths past " << PROFILE_MAX_CALL_NODES << " were charged to their callers)\n";
+	out.flush();
+}
+
+void Profiler::WriteCollapsedStacks(std::ostream &out) const
+{
+	for (size_t node = 0; node < nodes.size(); node++)
+		if (nodes[node].Instructions)
+			out << PathOf(node) << " " << nodes[node].Instructions << "\n";
+	out.flush();
+}
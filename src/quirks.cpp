@@ -0,0 +1,34 @@
+#include "quirks.h"
+
+static const QuirkSettings settings[] = {
+	MakeQuirkSettings<DefaultQuirks>(),
+	MakeQuirkSettings<VipQuirks>(),
+	MakeQuirkSettings<Chip48Quirks>(),
+	MakeQuirkSettings<SchipQuirks>(),
+	MakeQuirkSettings<XoChipQuirks>(),
+};
+
+static const char *const names[] = {"default", "vip", "chip48", "schip", "xochip"};
+
+const QuirkSettings &GetQuirkSettings(QuirkProfile profile)
+{
+	return settings[(int)profile];
+}
+
+bool QuirkProfileFromName(const std::string &name, QuirkProfile &profile)
+{
+	for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+	{
+		if (name == names[i])
+		{
+			profile = (QuirkProfile)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *QuirkProfileName(QuirkProfile profile)
+{
+	return names[(int)profile];
+}
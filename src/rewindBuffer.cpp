@@ -0,0 +1,161 @@
+#include "rewindBuffer.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+// A delta stores the state after Memory, Memory being the first field.
+static_assert(offsetof(MachineState, Memory) == 0, "Memory leads MachineState.");
+static const size_t CoreOffset = sizeof(MachineState::Memory);
+static const size_t CoreSize = sizeof(MachineState) - CoreOffset;
+
+RewindBuffer::RewindBuffer(size_t bytes, uint keyframeIntervalArg)
+	: buffer(bytes), keyframeInterval(keyframeIntervalArg), sinceKeyframe(keyframeIntervalArg)
+{
+	if (bytes < sizeof(MachineState))
+		throw std::invalid_argument("The rewind buffer cannot hold a single snapshot.");
+	if (keyframeInterval == 0)
+		throw std::invalid_argument("The keyframe interval must be at least 1.");
+}
+
+void RewindBuffer::Clear()
+{
+	entries.clear();
+	firstSequence = 0;
+	sinceKeyframe = keyframeInterval;
+	pagesSinceKeyframe = 0;
+}
+
+size_t RewindBuffer::GetBytesUsed() const
+{
+	size_t used = 0;
+	for (const Entry &entry : entries)
+		used += entry.Size;
+	return used;
+}
+
+// Drops the oldest keyframe and the deltas that depend on it.
+void RewindBuffer::EvictOldest()
+{
+	do
+	{
+		entries.pop_front();
+		firstSequence++;
+		stats.Evicted++;
+	} while (!entries.empty() && !entries.front().IsKeyframe);
+}
+
+// Records never wrap: one that does not fit before the end of the buffer starts over at 0.
+size_t RewindBuffer::Allocate(size_t size)
+{
+	while (!entries.empty())
+	{
+		const Entry &oldest = entries.front();
+		const Entry &newest = entries.back();
+		const size_t end = newest.Offset + newest.Size;
+		if (newest.Offset >= oldest.Offset)
+		{
+			if (end + size <= buffer.size())
+				return end;
+			if (size <= oldest.Offset)
+				return 0;
+		}
+		else if (end + size <= oldest.Offset)
+			return end;
+		EvictOldest();
+	}
+	return 0;
+}
+
+void RewindBuffer::Push(Machine &machine)
+{
+	if (machine.GetXoChipState())
+		throw std::runtime_error("Rewind does not cover XO-CHIP machines, whose memory is outside MachineState.");
+	const MachineState &state = machine.GetState();
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&state);
+	pagesSinceKeyframe |= machine.ConsumeDirtyPages();
+
+	Entry entry;
+	entry.IsKeyframe = sinceKeyframe >= keyframeInterval || entries.empty();
+	entry.Pages = entry.IsKeyframe ? 0 : pagesSinceKeyframe;
+	entry.Size = entry.IsKeyframe ? sizeof(MachineState) : CoreSize + __builtin_popcount(entry.Pages) * MEMORY_PAGE_SIZE;
+	entry.Offset = Allocate(entry.Size);
+	if (!entry.IsKeyframe && entries.empty()) // its keyframe was just evicted.
+	{
+		entry.IsKeyframe = true;
+		entry.Pages = 0;
+		entry.Size = sizeof(MachineState);
+		entry.Offset = Allocate(entry.Size);
+	}
+
+	const uint64_t sequence = firstSequence + entries.size();
+	uint8_t *record = buffer.data() + entry.Offset;
+	if (entry.IsKeyframe)
+	{
+		memcpy(record, bytes, sizeof(MachineState));
+		entry.Keyframe = sequence;
+		sinceKeyframe = 0;
+		pagesSinceKeyframe = 0;
+		stats.Keyframes++;
+	}
+	else
+	{
+		entry.Keyframe = entries.back().Keyframe;
+		memcpy(record, bytes + CoreOffset, CoreSize);
+		record += CoreSize;
+		for (uint page = 0; page < MEMORY_PAGES; page++)
+		{
+			if (entry.Pages & (1 << page))
+			{
+				memcpy(record, state.Memory + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+				record += MEMORY_PAGE_SIZE;
+				stats.PagesStored++;
+			}
+		}
+		stats.Deltas++;
+	}
+	sinceKeyframe++;
+	entries.push_back(entry);
+}
+
+bool RewindBuffer::Rewind(Machine &machine, uint count)
+{
+	if (count == 0 || count > entries.size())
+		return false;
+
+	const Entry entry = entries[entries.size() - count];
+	const Entry &keyframe = entries[entry.Keyframe - firstSequence];
+
+	MachineState state;
+	uint8_t *bytes = reinterpret_cast<uint8_t *>(&state);
+	memcpy(bytes, buffer.data() + keyframe.Offset, sizeof(MachineState));
+	if (!entry.IsKeyframe)
+	{
+		const uint8_t *record = buffer.data() + entry.Offset;
+		memcpy(bytes + CoreOffset, record, CoreSize);
+		record += CoreSize;
+		for (uint page = 0; page < MEMORY_PAGES; page++)
+		{
+			if (entry.Pages & (1 << page))
+			{
+				memcpy(state.Memory + page * MEMORY_PAGE_SIZE, record, MEMORY_PAGE_SIZE);
+				record += MEMORY_PAGE_SIZE;
+			}
+		}
+	}
+	machine.SetState(state);
+	machine.ConsumeDirtyPages();
+
+	entries.erase(entries.end() - count, entries.end());
+	if (entry.IsKeyframe)
+	{
+		sinceKeyframe = keyframeInterval; // the next push starts a new keyframe.
+		pagesSinceKeyframe = 0;
+	}
+	else
+	{
+		sinceKeyframe = firstSequence + entries.size() - entry.Keyframe;
+		pagesSinceKeyframe = entry.Pages;
+	}
+	return true;
+}
@@ -0,0 +1,480 @@
+#include "sdlFrontend.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#define PIXEL_ON 0xFFFFFFFF
+#define PIXEL_OFF 0xFF000000
+#define PIXEL_PLANE2 0xFFFF6600 // XO-CHIP, set in the second plane only.
+#define PIXEL_BOTH 0xFF662200	// XO-CHIP, set in both planes.
+
+// By the pixel's bit in the first plane plus twice its bit in the second.
+static const uint32_t Palette[4] = {PIXEL_OFF, PIXEL_ON, PIXEL_PLANE2, PIXEL_BOTH};
+
+// Positions, not symbols: the same physical block on any keyboard layout.
+static const SDL_Scancode DefaultKeyMap[KEYBOARD_SIZE] = {
+	SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, // 0 1 2 3
+	SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A, // 4 5 6 7
+	SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C, // 8 9 A B
+	SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V, // C D E F
+};
+
+SdlFrontend::SdlFrontend(Machine &machine, uint32_t displayScaleArg) : Chip8(machine)
+{
+	scale = displayScaleArg;
+	DisplayHeight = displayScaleArg * DISPLAY_ARRAY_HEIGHT;
+	DisplayWidth = displayScaleArg * DISPLAY_ARRAY_WIDTH;
+	SetDefaultKeyMap();
+}
+
+SdlFrontend::~SdlFrontend()
+{
+	EndDisplay();
+}
+
+void SdlFrontend::SetSpeed(uint instructionsPerFrameArg, bool turboArg)
+{
+	instructionsPerFrame = instructionsPerFrameArg;
+	turbo = turboArg;
+}
+
+void SdlFrontend::SetDefaultKeyMap()
+{
+	memset(keyMap, KEY_UNBOUND, sizeof(keyMap));
+	for (uint key = 0; key < KEYBOARD_SIZE; key++)
+		keyMap[DefaultKeyMap[key]] = key;
+}
+
+void SdlFrontend::LoadKeyMap(const std::string &filePath)
+{
+	std::ifstream file(filePath);
+	if (!file.good())
+		throw std::runtime_error("Could not open key map " + filePath);
+
+	uint8_t loaded[SDL_NUM_SCANCODES];
+	memset(loaded, KEY_UNBOUND, sizeof(loaded));
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		std::string key;
+		if (!(fields >> key))
+			continue;
+
+		std::string name; // scancode names may contain spaces, e.g. "Keypad 4".
+		std::getline(fields >> std::ws, name);
+		name = name.substr(0, name.find_last_not_of(" \t\r") + 1);
+		const SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+		if (key.length() != 1 || !isxdigit(key[0]) || scancode == SDL_SCANCODE_UNKNOWN)
+			throw std::runtime_error("Invalid key map line: " + line);
+		loaded[scancode] = std::stoul(key, nullptr, 16);
+	}
+	memcpy(keyMap, loaded, sizeof(keyMap));
+}
+
+// The SDL thread sleeps in SDL_WaitEventTimeout until an input event or a new frame, so a slow
+// present delays only the next present, never emulation or input.
+void SdlFrontend::LaunchRom(std::string filePath)
+{
+	Chip8.ResetMachine();
+	Chip8.LoadRom(filePath);
+	if (movie)
+		movie->Start(Chip8, filePath, instructionsPerFrame);
+	InitializeDisplay();
+	InitializeAudio();
+	quitFlag = false;
+	keys = 0;
+	inputSequence = 0;
+	inputState = 0;
+	pressedKeys = 0;
+	fastForward = false;
+	inputPending = false;
+	emulationError = nullptr;
+
+	FrameScheduler scheduler(instructionsPerFrame, turbo);
+	std::thread emulation(&SdlFrontend::RunEmulation, this, std::ref(scheduler));
+	while (!quitFlag)
+	{
+		if (SDL_WaitEventTimeout(&Event, EVENT_WAIT_TIMEOUT_MS))
+		{
+			do
+				HandleEvent(Event);
+			while (SDL_PollEvent(&Event));
+		}
+		PresentLatestFrame();
+	}
+	emulation.join();
+	if (movie)
+		movie->Finish(Chip8);
+
+	EndDisplay();
+	PrintFrameStats();
+	if (audio)
+		audio->PrintStats(audioDeviceSamples);
+	scheduler.PrintStats();
+	if (emulationError)
+		std::rethrow_exception(emulationError);
+}
+
+// A frame is the keys as they are now, a burst of instructions and one timer tick; frames that
+// changed the display are published, and every frame's sound is pushed. While FX0A blocks, each
+// frame returns at once and the thread sleeps out the rest of it, in turbo too.
+void SdlFrontend::RunEmulation(FrameScheduler &scheduler)
+{
+	try
+	{
+		scheduler.Restart();
+		Clock::rep alignedPresent = 0;
+		while (!quitFlag.load(std::memory_order_relaxed))
+		{
+			// A vsynced present returns at a vblank: keep frames finishing just ahead of them, or
+			// each one would wait up to a whole refresh for its present.
+			const Clock::rep present = lastPresent.load(std::memory_order_relaxed);
+			if (present != alignedPresent)
+			{
+				scheduler.AlignTo(Clock::time_point(Clock::duration(present)), std::chrono::microseconds(VSYNC_LEAD_MICROS));
+				alignedPresent = present;
+			}
+
+			const uint16_t pressed = pressedKeys.exchange(0, std::memory_order_relaxed);
+			const uint32_t input = inputState.load(std::memory_order_relaxed);
+			Chip8.SetKeys((input & 0xFFFF) | pressed);
+			if (movie)
+				movie->RecordFrame(Chip8.GetKeys());
+			const bool unthrottled = turbo || fastForward.load(std::memory_order_relaxed);
+			if (unthrottled != scheduler.IsTurbo())
+				scheduler.SetTurbo(unthrottled);
+			scheduler.RunFrame(Chip8);
+			if (audioDevice)
+				audio->Push(Chip8);
+
+			if (Chip8.ConsumeDirtyRows() != 0)
+			{
+				HandoffFrame &frame = handoff.GetBackFrame();
+				memcpy(frame.Rows, Chip8.GetDisplay(), sizeof(frame.Rows));
+				frame.HiRes = Chip8.IsHiRes();
+				if (frame.HiRes)
+					memcpy(frame.RightRows, Chip8.GetDisplayRight(), sizeof(frame.RightRows));
+				const XoChipState *xo = Chip8.GetXoChipState();
+				frame.TwoPlanes = xo != nullptr;
+				if (xo)
+				{
+					memcpy(frame.PlaneRows, xo->bPlane, sizeof(frame.PlaneRows));
+					memcpy(frame.PlaneRightRows, xo->bPlaneRight, sizeof(frame.PlaneRightRows));
+				}
+				frame.Frame = ++frameStats.FramesPublished;
+				frame.InputSequence = input >> 16;
+				handoff.Publish();
+				WakeEventLoop();
+			}
+			if (Chip8.HasExited())
+			{
+				// 00FD ends the program, and with it the window.
+				quitFlag = true;
+				WakeEventLoop();
+				break;
+			}
+			if (Chip8.IsWaitingForKey())
+				WaitForKey(scheduler, input);
+			scheduler.EndFrame();
+		}
+	}
+	catch (...)
+	{
+		emulationError = std::current_exception();
+		quitFlag = true;
+		WakeEventLoop();
+	}
+}
+
+// Sleeps until the frame's end or until the keys differ from input, the state the frame ran with;
+// in turbo EndFrame would not wait, and the blocked machine would spin a core and flood the
+// audio ring with frames. Polled, as the SDL thread shares no lock with this one.
+void SdlFrontend::WaitForKey(const FrameScheduler &scheduler, uint32_t input)
+{
+	const Clock::time_point end = scheduler.GetFrameEnd();
+	while (!quitFlag.load(std::memory_order_relaxed) && inputState.load(std::memory_order_relaxed) == input &&
+		   pressedKeys.load(std::memory_order_relaxed) == 0)
+	{
+		const Clock::time_point now = Clock::now();
+		if (now >= end)
+			return;
+		std::this_thread::sleep_for(std::min<Clock::duration>(end - now, std::chrono::microseconds(KEY_WAIT_POLL_MICROS)));
+	}
+}
+
+// Ends the SDL thread's SDL_WaitEventTimeout, to present a frame or see quitFlag. At most one
+// such event is queued, however fast frames come.
+void SdlFrontend::WakeEventLoop()
+{
+	if (frameEventPending.exchange(true))
+		return;
+	SDL_Event wake = {};
+	wake.type = frameEventType;
+	SDL_PushEvent(&wake);
+}
+
+void SdlFrontend::HandleEvent(const SDL_Event &event)
+{
+	if (event.type == frameEventType)
+		frameEventPending = false;
+	else if (event.type == SDL_WINDOWEVENT)
+	{
+		if (event.window.event == SDL_WINDOWEVENT_CLOSE)
+			quitFlag = true;
+	}
+	else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+	{
+		const uint scancode = event.key.keysym.scancode;
+		if (scancode == FAST_FORWARD_KEY && keyMap[scancode] == KEY_UNBOUND)
+		{
+			fastForward.store(event.type == SDL_KEYDOWN, std::memory_order_relaxed);
+			return;
+		}
+		if (scancode >= SDL_NUM_SCANCODES || keyMap[scancode] == KEY_UNBOUND)
+			return;
+
+		const uint16_t bit = 1 << keyMap[scancode];
+		const uint16_t changed = event.type == SDL_KEYDOWN ? keys | bit : keys & ~bit;
+		if (changed == keys)
+			return; // key repeat.
+
+		keys = changed;
+		inputSequence++;
+		if (event.type == SDL_KEYDOWN)
+			pressedKeys.fetch_or(bit, std::memory_order_relaxed);
+		inputState.store((uint32_t)inputSequence << 16 | keys, std::memory_order_relaxed);
+		inputTime = Clock::now();
+		inputPending = true;
+	}
+}
+
+// Takes the newest published frame, if any, and presents the rows it changed.
+void SdlFrontend::PresentLatestFrame()
+{
+	if (!handoff.Acquire())
+		return;
+
+	const HandoffFrame &frame = handoff.GetFrontFrame();
+	if (frame.HiRes != shownHiRes)
+	{
+		CreateTexture(frame.HiRes);
+		ClearShownRows();
+		pendingRows = frame.HiRes ? ALL_HIRES_ROWS_DIRTY : ALL_ROWS_DIRTY;
+	}
+	const uint height = shownHiRes ? DISPLAY_HIRES_HEIGHT : DISPLAY_ARRAY_HEIGHT;
+	for (uint row = 0; row < height; row++)
+	{
+		const uint64_t right = shownHiRes ? frame.RightRows[row] : 0;
+		const uint64_t plane = frame.TwoPlanes ? frame.PlaneRows[row] : 0;
+		const uint64_t planeRight = frame.TwoPlanes && shownHiRes ? frame.PlaneRightRows[row] : 0;
+		if (frame.Rows[row] != shownRows[row] || right != shownRightRows[row] || plane != shownPlaneRows[row] || planeRight != shownPlaneRightRows[row])
+		{
+			shownRows[row] = frame.Rows[row];
+			shownRightRows[row] = right;
+			shownPlaneRows[row] = plane;
+			shownPlaneRightRows[row] = planeRight;
+			pendingRows |= 1ull << row;
+		}
+	}
+	if (pendingRows == 0)
+		return;
+	UpdateDisplay();
+
+	if (inputPending && frame.InputSequence == inputSequence)
+	{
+		const double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - inputTime).count();
+		frameStats.InputSamples++;
+		frameStats.InputLatencySumMs += latencyMs;
+		if (latencyMs > frameStats.InputLatencyMaxMs)
+			frameStats.InputLatencyMaxMs = latencyMs;
+		inputPending = false;
+	}
+}
+
+void SdlFrontend::InitializeDisplay()
+{
+	if (displayInitFlag)
+		EndDisplay();
+
+	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+		throw std::runtime_error("SDL could not initialize! SDL_Error: " + std::string(SDL_GetError()));
+
+	AppWindow = SDL_CreateWindow("CHIP8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, DisplayWidth, DisplayHeight, SDL_WINDOW_SHOWN);
+	if (AppWindow == nullptr)
+		throw std::runtime_error("SDL could not create a window! SDL_Error: " + std::string(SDL_GetError()));
+	// Presents wait for vsync; only the SDL thread waits with them.
+	Renderer = SDL_CreateRenderer(AppWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (Renderer == nullptr)
+		throw std::runtime_error("SDL could not create a renderer! SDL_Error: " + std::string(SDL_GetError()));
+
+	CreateTexture(false);
+
+	SDL_DisplayMode mode;
+	alignToVsync = SDL_GetWindowDisplayMode(AppWindow, &mode) == 0 && abs(mode.refresh_rate - FRAME_RATE) <= 1;
+	lastPresent = 0;
+
+	frameEventType = SDL_RegisterEvents(1);
+	if (frameEventType == (Uint32)-1)
+		throw std::runtime_error("SDL could not register an event! SDL_Error: " + std::string(SDL_GetError()));
+
+	displayInitFlag = true;
+	ClearShownRows();
+	pendingRows = ALL_ROWS_DIRTY;
+	frameStats = FrameStats();
+}
+
+// Without an audio device the machine runs silent rather than not at all.
+void SdlFrontend::InitializeAudio()
+{
+	audio.reset(new AudioStream());
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+	{
+		std::cerr << "No audio: " << SDL_GetError() << std::endl;
+		return;
+	}
+
+	SDL_AudioSpec wanted = {}, obtained;
+	wanted.freq = AUDIO_SAMPLE_RATE;
+	wanted.format = AUDIO_S16SYS;
+	wanted.channels = 1;
+	wanted.samples = AUDIO_DEVICE_SAMPLES;
+	wanted.callback = AudioCallback;
+	wanted.userdata = this;
+	// No allowed changes: SDL converts to whatever the device plays.
+	audioDevice = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+	if (audioDevice == 0)
+	{
+		std::cerr << "No audio: " << SDL_GetError() << std::endl;
+		return;
+	}
+	audioDeviceSamples = obtained.samples;
+	SDL_PauseAudioDevice(audioDevice, 0);
+}
+
+void SdlFrontend::AudioCallback(void *frontend, Uint8 *stream, int bytes)
+{
+	static_cast<SdlFrontend *>(frontend)->audio->Render(reinterpret_cast<int16_t *>(stream), bytes / sizeof(int16_t));
+}
+
+// Waits for a running callback to return, so the stream's stats are safe to read after.
+void SdlFrontend::EndAudio()
+{
+	if (audioDevice)
+	{
+		SDL_CloseAudioDevice(audioDevice);
+		audioDevice = 0;
+	}
+}
+
+void SdlFrontend::ClearShownRows()
+{
+	memset(shownRows, 0, sizeof(shownRows));
+	memset(shownRightRows, 0, sizeof(shownRightRows));
+	memset(shownPlaneRows, 0, sizeof(shownPlaneRows));
+	memset(shownPlaneRightRows, 0, sizeof(shownPlaneRightRows));
+}
+
+// One texture at the native resolution of the mode, SDL scales it to the window on copy.
+void SdlFrontend::CreateTexture(bool hiRes)
+{
+	if (Texture)
+		SDL_DestroyTexture(Texture);
+	const int width = hiRes ? DISPLAY_HIRES_WIDTH : DISPLAY_ARRAY_WIDTH;
+	const int height = hiRes ? DISPLAY_HIRES_HEIGHT : DISPLAY_ARRAY_HEIGHT;
+	Texture = SDL_CreateTexture(Renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+	if (Texture == nullptr)
+		throw std::runtime_error("SDL could not create a texture! SDL_Error: " + std::string(SDL_GetError()));
+	shownHiRes = hiRes;
+}
+
+// Uploads only the span of rows changed since the last present, then presents once.
+void SdlFrontend::UpdateDisplay()
+{
+	if (pendingRows == 0)
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	const uint64_t *halves[] = {shownRows, shownRightRows};
+	const uint64_t *planeHalves[] = {shownPlaneRows, shownPlaneRightRows};
+	const int width = shownHiRes ? DISPLAY_HIRES_WIDTH : DISPLAY_ARRAY_WIDTH;
+	const int firstRow = __builtin_ctzll(pendingRows);
+	const int lastRow = 63 - __builtin_clzll(pendingRows);
+	for (int i = firstRow; i <= lastRow; i++)
+	{
+		if ((pendingRows >> i & 1) == 0)
+			continue;
+		for (int half = 0; half < width / DISPLAY_ARRAY_WIDTH; half++)
+		{
+			uint32_t *line = Pixels + i * width + half * DISPLAY_ARRAY_WIDTH;
+			const uint64_t first = halves[half][i], second = planeHalves[half][i];
+			for (int j = 0; j < DISPLAY_ARRAY_WIDTH; j++)
+			{
+				const int bit = DISPLAY_ARRAY_WIDTH - 1 - j;
+				line[j] = Palette[(first >> bit & 1) | (second >> bit & 1) << 1];
+			}
+		}
+		frameStats.RowsUploaded++;
+	}
+
+	SDL_Rect rect;
+	rect.x = 0;
+	rect.y = firstRow;
+	rect.w = width;
+	rect.h = lastRow - firstRow + 1;
+	SDL_UpdateTexture(Texture, &rect, &Pixels[firstRow * width], width * sizeof(uint32_t));
+	SDL_RenderCopy(Renderer, Texture, nullptr, nullptr);
+	SDL_RenderPresent(Renderer);
+	pendingRows = 0;
+	if (alignToVsync)
+		lastPresent.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+
+	const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	frameStats.Presents++;
+	frameStats.TotalMs += elapsedMs;
+	if (Profiler *profiler = Chip8.GetProfiler())
+		profiler->AddDisplayTime(elapsedMs / 1000);
+	if (elapsedMs > frameStats.MaxMs)
+		frameStats.MaxMs = elapsedMs;
+}
+
+void SdlFrontend::PrintFrameStats() const
+{
+	if (frameStats.Presents == 0)
+		return;
+
+	std::cout << "frames presented: " << frameStats.Presents << "\n";
+	std::cout << "rows uploaded:    " << frameStats.RowsUploaded << "\n";
+	std::cout << "frames published: " << frameStats.FramesPublished << "\n";
+	std::cout << "render avg/max:   " << frameStats.TotalMs / frameStats.Presents << " / " << frameStats.MaxMs << " ms\n";
+	if (frameStats.InputSamples > 0)
+		std::cout << "input to present: " << frameStats.InputLatencySumMs / frameStats.InputSamples << " / " << frameStats.InputLatencyMaxMs << " ms avg/max over " << frameStats.InputSamples << " inputs\n";
+	std::cout.flush();
+}
+
+void SdlFrontend::EndDisplay()
+{
+	EndAudio();
+	if (displayInitFlag)
+	{
+		SDL_DestroyTexture(Texture);
+		Texture = nullptr;
+		SDL_DestroyRenderer(Renderer);
+		Renderer = nullptr;
+		SDL_DestroyWindow(AppWindow);
+		AppWindow = nullptr;
+		SDL_Quit();
+		displayInitFlag = false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+
+#include "disassembler.h"
+#include "traceWriter.h"
+
+using namespace std;
+
+#define DIFF_CONTEXT_RECORDS 5
+
+void printUsage();
+int dump(const string &path, int argc, char *argv[]);
+int diff(const string &first, const string &second, int argc, char *argv[]);
+
+// chip8_trace dump <trace> [--pc A[-B]] [--op PATTERN] [--from N] [--count N]
+// chip8_trace diff <trace> <trace> [--context N]
+int main(int argc, char *argv[])
+{
+	try
+	{
+		const string command = argc > 1 ? argv[1] : "";
+		if (command == "dump" && argc > 2)
+			return dump(argv[2], argc - 3, argv + 3);
+		if (command == "diff" && argc > 3)
+			return diff(argv[2], argv[3], argc - 4, argv + 4);
+	}
+	catch (const exception &exception)
+	{
+		cerr << exception.what() << endl;
+		return 2;
+	}
+
+	printUsage();
+	return 2;
+}
+
+static string Hex(uint value, int digits)
+{
+	char text[16];
+	snprintf(text, sizeof(text), "%0*X", digits, value);
+	return text;
+}
+
+static string Describe(const TraceRecord &record)
+{
+	char text[80];
+	snprintf(text, sizeof(text), "%10llu  %03X  %04X  %-18s", (unsigned long long)record.Index, record.ProgramCounter, record.Opcode,
+			 Disassemble(record.Opcode).c_str());
+	string description = text;
+	description += " I=" + Hex(record.IndexRegister, 3) + " DT=" + Hex(record.DelayTimer, 2) + " SP=" + to_string(record.StackPointer) + " V=";
+	for (uint i = 0; i < sizeof(record.Registers); i++)
+		description += Hex(record.Registers[i], 2);
+	return description;
+}
+
+// What the instruction of `before` changed, read from the record that follows it.
+static string Changes(const TraceRecord &before, const TraceRecord &after)
+{
+	if (after.Index != before.Index + 1)
+		return "";
+
+	string changes;
+	for (uint i = 0; i < sizeof(before.Registers); i++)
+		if (before.Registers[i] != after.Registers[i])
+			changes += " V" + Hex(i, 1) + "=" + Hex(after.Registers[i], 2);
+	if (before.IndexRegister != after.IndexRegister)
+		changes += " I=" + Hex(after.IndexRegister, 3);
+	if (before.DelayTimer != after.DelayTimer)
+		changes += " DT=" + Hex(after.DelayTimer, 2);
+	if (before.StackPointer != after.StackPointer)
+		changes += " SP=" + to_string(after.StackPointer);
+	return changes.empty() ? "" : "  ->" + changes;
+}
+
+int dump(const string &path, int argc, char *argv[])
+{
+	uint pcLow = 0, pcHigh = XO_MEMORY_SIZE - 1;
+	string pattern = "";
+	uint64_t from = 0, count = UINT64_MAX;
+	for (int i = 0; i < argc; i++)
+	{
+		const string arg = argv[i];
+		if (arg == "--pc" && i + 1 < argc)
+		{
+			const string range = argv[++i];
+			const size_t dash = range.find('-');
+			pcLow = stoul(range.substr(0, dash), nullptr, 16);
+			pcHigh = dash == string::npos ? pcLow : stoul(range.substr(dash + 1), nullptr, 16);
+		}
+		else if (arg == "--op" && i + 1 < argc)
+			pattern = argv[++i];
+		else if (arg == "--from" && i + 1 < argc)
+			from = stoull(argv[++i]);
+		else if (arg == "--count" && i + 1 < argc)
+			count = stoull(argv[++i]);
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	TraceReader reader(path);
+	TraceRecord current, next;
+	bool more = reader.Next(current);
+	while (more && count > 0)
+	{
+		more = reader.Next(next);
+		const bool selected = current.Index >= from && current.ProgramCounter >= pcLow && current.ProgramCounter <= pcHigh &&
+							  (pattern.empty() || string(OpcodePattern(current.Opcode)).compare(0, pattern.size(), pattern) == 0);
+		if (selected)
+		{
+			cout << Describe(current) << (more ? Changes(current, next) : "") << "\n";
+			count--;
+		}
+		current = next;
+	}
+	cout.flush();
+	return 0;
+}
+
+static void PrintDifferences(const TraceRecord &a, const TraceRecord &b)
+{
+	if (a.ProgramCounter != b.ProgramCounter)
+		cout << "  PC " << Hex(a.ProgramCounter, 3) << " vs " << Hex(b.ProgramCounter, 3) << "\n";
+	if (a.Opcode != b.Opcode)
+		cout << "  opcode " << Hex(a.Opcode, 4) << " vs " << Hex(b.Opcode, 4) << "\n";
+	if (a.IndexRegister != b.IndexRegister)
+		cout << "  I " << Hex(a.IndexRegister, 3) << " vs " << Hex(b.IndexRegister, 3) << "\n";
+	if (a.DelayTimer != b.DelayTimer)
+		cout << "  DT " << Hex(a.DelayTimer, 2) << " vs " << Hex(b.DelayTimer, 2) << "\n";
+	if (a.StackPointer != b.StackPointer)
+		cout << "  SP " << (uint)a.StackPointer << " vs " << (uint)b.StackPointer << "\n";
+	for (uint i = 0; i < sizeof(a.Registers); i++)
+		if (a.Registers[i] != b.Registers[i])
+			cout << "  V" << Hex(i, 1) << " " << Hex(a.Registers[i], 2) << " vs " << Hex(b.Registers[i], 2) << "\n";
+}
+
+// Walks both traces by instruction index; indices only one of them recorded (a JIT trace's
+// native blocks, skipped idle loops) are passed over.
+int diff(const string &first, const string &second, int argc, char *argv[])
+{
+	size_t context = DIFF_CONTEXT_RECORDS;
+	for (int i = 0; i < argc; i++)
+	{
+		if (string(argv[i]) == "--context" && i + 1 < argc)
+			context = stoul(argv[++i]);
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	TraceReader readerA(first), readerB(second);
+	TraceRecord a, b;
+	bool moreA = readerA.Next(a), moreB = readerB.Next(b);
+	deque<TraceRecord> previous;
+	uint64_t compared = 0;
+	while (moreA && moreB)
+	{
+		if (a.Index < b.Index)
+		{
+			moreA = readerA.Next(a);
+			continue;
+		}
+		if (b.Index < a.Index)
+		{
+			moreB = readerB.Next(b);
+			continue;
+		}
+
+		if (memcmp(&a, &b, sizeof(a)) != 0)
+		{
+			cout << "first divergence at instruction " << a.Index << " after " << compared << " matching records\n";
+			for (const TraceRecord &record : previous)
+				cout << "   " << Describe(record) << "\n";
+			cout << "a: " << Describe(a) << "\n";
+			cout << "b: " << Describe(b) << "\n";
+			PrintDifferences(a, b);
+			cout.flush();
+			return 1;
+		}
+
+		compared++;
+		previous.push_back(a);
+		if (previous.size() > context)
+			previous.pop_front();
+		moreA = readerA.Next(a);
+		moreB = readerB.Next(b);
+	}
+
+	cout << "no divergence in " << compared << " common records";
+	if (moreA != moreB)
+		cout << "; " << (moreA ? first : second) << " goes on past the end of the other";
+	cout << endl;
+	return 0;
+}
+
+void printUsage()
+{
+	cout << "Usage: chip8_trace dump <trace> [--pc A[-B]] [--op PATTERN] [--from N] [--count N]\n";
+	cout << "       chip8_trace diff <trace> <trace> [--context N]\n";
+	cout << "dump decodes records with what each instruction changed; --pc takes hex addresses, --op an opcode\n";
+	cout << "family prefix such as DXYN or 8XY, --from an instruction index.\n";
+	cout << "diff reports the first instruction whose state differs between two traces." << endl;
+}
@@ -0,0 +1,207 @@
+#include "traceWriter.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define TRACE_RING_AVAILABLE 1
+#else
+#define TRACE_RING_AVAILABLE 0
+#endif
+
+static TraceHeader MakeHeader(uint64_t capacity)
+{
+	TraceHeader header = {};
+	memcpy(header.Magic, TRACE_MAGIC, sizeof(header.Magic));
+	header.Version = TRACE_VERSION;
+	header.RecordSize = sizeof(TraceRecord);
+	header.Capacity = capacity;
+	return header;
+}
+
+TraceWriter::TraceWriter(const std::string &path, uint64_t ringRecords) : capacity(ringRecords)
+{
+	if (capacity == 0)
+	{
+		file = fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			throw std::runtime_error("Cannot write the trace " + path);
+		chunk.resize(TRACE_CHUNK_RECORDS);
+		records = chunk.data();
+		end = TRACE_CHUNK_RECORDS;
+		WriteHeader();
+		return;
+	}
+
+#if TRACE_RING_AVAILABLE
+	mappingSize = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+	descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0 || ftruncate(descriptor, mappingSize) != 0)
+		throw std::runtime_error("Cannot create the trace ring " + path);
+	void *memory = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	if (memory == MAP_FAILED)
+	{
+		close(descriptor);
+		throw std::runtime_error("Cannot map the trace ring " + path);
+	}
+	mapping = static_cast<TraceHeader *>(memory);
+	records = reinterpret_cast<TraceRecord *>(mapping + 1);
+	end = capacity < TRACE_CHUNK_RECORDS ? capacity : TRACE_CHUNK_RECORDS;
+	WriteHeader();
+#else
+	throw std::runtime_error("Trace rings need mmap, write a plain trace file instead.");
+#endif
+}
+
+TraceWriter::~TraceWriter()
+{
+	try
+	{
+		Flush();
+	}
+	catch (...)
+	{
+	}
+
+	if (file)
+		fclose(file);
+#if TRACE_RING_AVAILABLE
+	if (mapping)
+		munmap(mapping, mappingSize);
+	if (descriptor >= 0)
+		close(descriptor);
+#endif
+}
+
+// A file writes the chunk out and reuses it; a ring moves on to its next chunk of slots.
+void TraceWriter::Advance()
+{
+	written += next - chunkStart;
+	if (file)
+	{
+		if (fwrite(records, sizeof(TraceRecord), next, file) != next)
+			throw std::runtime_error("Could not write the trace.");
+		next = 0;
+	}
+	else
+	{
+		if (next == capacity)
+			next = 0;
+		WriteHeader();
+	}
+	chunkStart = next;
+	end = file ? TRACE_CHUNK_RECORDS : std::min<uint64_t>(next + TRACE_CHUNK_RECORDS, capacity);
+}
+
+void TraceWriter::WriteHeader()
+{
+	TraceHeader header = MakeHeader(capacity);
+	header.Written = written;
+	if (mapping)
+	{
+		*mapping = header;
+		return;
+	}
+
+	const long position = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, file);
+	if (position > 0)
+		fseek(file, position, SEEK_SET);
+}
+
+void TraceWriter::Flush()
+{
+	if (file)
+	{
+		written += next;
+		if (fwrite(records, sizeof(TraceRecord), next, file) != next)
+			throw std::runtime_error("Could not write the trace.");
+		next = 0;
+		chunkStart = 0;
+		WriteHeader();
+		fflush(file);
+		return;
+	}
+
+	written += next - chunkStart;
+	chunkStart = next;
+	WriteHeader();
+}
+
+static bool ReadSlot(FILE *file, uint64_t slot, TraceRecord &record)
+{
+	fseek(file, sizeof(TraceHeader) + slot * sizeof(TraceRecord), SEEK_SET);
+	return fread(&record, sizeof(record), 1, file) == 1;
+}
+
+TraceReader::TraceReader(const std::string &path)
+{
+	file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		throw std::runtime_error("Cannot read the trace " + path);
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.Magic, TRACE_MAGIC, sizeof(header.Magic)) != 0)
+	{
+		fclose(file);
+		throw std::runtime_error(path + " is not a trace.");
+	}
+	if (header.Version != TRACE_VERSION || header.RecordSize != sizeof(TraceRecord))
+	{
+		fclose(file);
+		throw std::runtime_error(path + " is a trace of an unsupported version.");
+	}
+
+	if (header.Capacity == 0)
+	{
+		// The file, not the header, says how much a writer that died got out.
+		remaining = (std::filesystem::file_size(path) - sizeof(TraceHeader)) / sizeof(TraceRecord);
+		position = 0;
+		return;
+	}
+
+	remaining = header.Written < header.Capacity ? header.Written : header.Capacity;
+	position = 0;
+	if (header.Written >= header.Capacity)
+	{
+		// The oldest record is at Written % Capacity, unless a writer that died had begun its next
+		// chunk there: those slots then hold records newer than the last one the header counts,
+		// the slot before them, and are left out.
+		position = header.Written % header.Capacity;
+		const uint64_t chunkEnd = std::min<uint64_t>(position - position % TRACE_CHUNK_RECORDS + TRACE_CHUNK_RECORDS, header.Capacity);
+		TraceRecord last, record;
+		if (ReadSlot(file, (position + header.Capacity - 1) % header.Capacity, last))
+		{
+			while (position < chunkEnd && ReadSlot(file, position, record) && record.Index > last.Index)
+			{
+				position++;
+				remaining--;
+			}
+		}
+	}
+	fseek(file, sizeof(TraceHeader) + position * sizeof(TraceRecord), SEEK_SET);
+}
+
+TraceReader::~TraceReader()
+{
+	fclose(file);
+}
+
+bool TraceReader::Next(TraceRecord &record)
+{
+	if (remaining == 0)
+		return false;
+	if (header.Capacity != 0 && position == header.Capacity)
+	{
+		position = 0;
+		fseek(file, sizeof(TraceHeader), SEEK_SET);
+	}
+	if (fread(&record, sizeof(record), 1, file) != 1)
+		return false;
+	remaining--;
+	position++;
+	return true;
+}
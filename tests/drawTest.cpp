@@ -0,0 +1,207 @@
+// DXYN on the 64-bit display rows against rows recorded from the original bool[32][64]
+// implementation: fixed sprites at fixed positions, wrapping at the right and bottom edges,
+// starts past the screen and collisions. Each case runs on every engine with the default quirks.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "jit.h"
+#include "machine.h"
+
+using namespace std;
+
+#define SPRITE_ADDRESS 0x300
+
+const uint8_t Sprites[] = {
+	0xF0, 0x90, 0x90, 0x90, 0xF0,
+	0xFF, 0x81, 0xA5, 0x81, 0xFF,
+	0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+	0xFF, 0xFF, 0xFF, 0xFF,
+	0xAA, 0x55, 0xAA, 0x55,
+};
+
+// Offsets into Sprites.
+enum SpriteOffset : uint8_t
+{
+	Glyph = 0,
+	Box = 5,
+	Diagonal = 10,
+	Solid = 25,
+	Checker = 29,
+};
+
+struct Draw
+{
+	uint8_t X, Y, Rows;
+	SpriteOffset Sprite;
+};
+
+struct Case
+{
+	const char *Name;
+	vector<Draw> Draws;
+	vector<uint8_t> Flags; // VF after each draw.
+	uint64_t Rows[DISPLAY_ARRAY_HEIGHT];
+};
+
+const Case Cases[] = {
+	{"origin",
+	 {{0, 0, 5, Glyph}},
+	 {0},
+	 {0xF000000000000000, 0x9000000000000000, 0x9000000000000000, 0x9000000000000000,
+	  0xF000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000}},
+	{"right edge",
+	 {{60, 10, 5, Box}, {57, 2, 4, Checker}},
+	 {0, 0},
+	 {0x0000000000000000, 0x0000000000000000, 0x0000000000000055, 0x800000000000002A,
+	  0x0000000000000055, 0x800000000000002A, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0xF00000000000000F, 0x1000000000000008,
+	  0x500000000000000A, 0x1000000000000008, 0xF00000000000000F, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000}},
+	{"bottom edge",
+	 {{20, 29, 5, Box}},
+	 {0},
+	 {0x0000081000000000, 0x00000FF000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x00000FF000000000, 0x0000081000000000, 0x00000A5000000000}},
+	{"corner",
+	 {{62, 30, 4, Solid}},
+	 {0},
+	 {0xFC00000000000003, 0xFC00000000000003, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0xFC00000000000003, 0xFC00000000000003}},
+	{"start past the screen",
+	 {{70, 40, 5, Glyph}, {255, 255, 15, Diagonal}},
+	 {0, 0},
+	 {0x8000000000000000, 0x4000000000000000, 0x2000000000000000, 0x1000000000000000,
+	  0x0800000000000000, 0x0400000000000000, 0x0200000000000000, 0x0400000000000000,
+	  0x0BC0000000000000, 0x1240000000000000, 0x2240000000000000, 0x4240000000000000,
+	  0x83C0000000000000, 0x0000000000000001, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000001}},
+	{"tall",
+	 {{28, 8, 15, Diagonal}},
+	 {0},
+	 {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000800000000, 0x0000000400000000, 0x0000000200000000, 0x0000000100000000,
+	  0x0000000080000000, 0x0000000040000000, 0x0000000020000000, 0x0000000010000000,
+	  0x0000000020000000, 0x0000000040000000, 0x0000000080000000, 0x0000000100000000,
+	  0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000}},
+	{"collision",
+	 {{10, 10, 5, Glyph}, {10, 10, 5, Glyph}, {10, 10, 4, Solid}, {14, 12, 4, Checker}, {40, 10, 5, Box}, {48, 10, 5, Box}},
+	 {0, 1, 0, 1, 0, 0},
+	 {0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x003FC00000FFFF00, 0x003FC00000818100,
+	  0x003D680000A5A500, 0x003E940000818100, 0x0002A80000FFFF00, 0x0001540000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000}},
+	{"wrapped collision",
+	 {{60, 30, 4, Solid}, {0, 0, 4, Checker}},
+	 {0, 1},
+	 {0x5A0000000000000F, 0xA50000000000000F, 0xAA00000000000000, 0x5500000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0x0000000000000000, 0x0000000000000000,
+	  0x0000000000000000, 0x0000000000000000, 0xF00000000000000F, 0xF00000000000000F}},
+};
+
+// V0 and V1 hold the position and V2 to VE collect VF, so a case is at most 13 draws.
+static vector<uint8_t> Program(const Case &test)
+{
+	vector<uint8_t> program;
+	const auto emit = [&](uint opcode)
+	{
+		program.push_back(opcode >> 8);
+		program.push_back(opcode & 0xFF);
+	};
+	for (size_t i = 0; i < test.Draws.size(); i++)
+	{
+		const Draw &draw = test.Draws[i];
+		emit(0xA000 | (SPRITE_ADDRESS + draw.Sprite)); // ANNN
+		emit(0x6000 | draw.X);						   // 60NN
+		emit(0x6100 | draw.Y);						   // 61NN
+		emit(0xD010 | draw.Rows);					   // D01N
+		emit(0x80F0 | (2 + i) << 8);				   // 8XF0
+	}
+	emit(0x1000 | (0x200 + program.size())); // 1NNN to itself.
+	program.resize(SPRITE_ADDRESS - 0x200);
+	program.insert(program.end(), Sprites, Sprites + sizeof(Sprites));
+	return program;
+}
+
+static bool Check(const Case &test, Engine engine, const char *engineName)
+{
+	const vector<uint8_t> program = Program(test);
+	Machine machine;
+	machine.SetEngine(engine);
+	machine.LoadProgram(program.data(), program.size());
+	machine.Step(5 * test.Draws.size());
+
+	bool passed = true;
+	for (size_t i = 0; i < test.Flags.size(); i++)
+	{
+		if (machine.GetState().Registers[2 + i] != test.Flags[i])
+		{
+			cerr << test.Name << " (" << engineName << "): VF after draw " << i << " is " << (int)machine.GetState().Registers[2 + i]
+				 << ", expected " << (int)test.Flags[i] << endl;
+			passed = false;
+		}
+	}
+	for (uint y = 0; y < DISPLAY_ARRAY_HEIGHT; y++)
+	{
+		if (machine.GetDisplay()[y] != test.Rows[y])
+		{
+			char line[96];
+			snprintf(line, sizeof(line), "row %u is %016llX, expected %016llX", y, (unsigned long long)machine.GetDisplay()[y],
+					 (unsigned long long)test.Rows[y]);
+			cerr << test.Name << " (" << engineName << "): " << line << endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+int main()
+{
+	bool passed = true;
+	for (const Case &test : Cases)
+	{
+		passed &= Check(test, Engine::Interpreter, "interpreter");
+		passed &= Check(test, Engine::Cached, "cached");
+		if (JitCompiler::IsSupported())
+			passed &= Check(test, Engine::Jit, "jit");
+	}
+	cout << (passed ? "draw: all cases match" : "draw: FAILED") << endl;
+	return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,245 @@
+// Random programs, weighted towards the polling loops --skip-idle fast-forwards, run frame by
+// frame on every engine with and without idle skipping, half of them with --key-release. After
+// each frame the state and the count of executed instructions must equal those of the plain
+// interpreter, which also has to throw on the same frame. A few fixed scenarios go first, for
+// input the random programs hardly ever produce.
+//   chip8_engine_test [seed] [programs]
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "jit.h"
+#include "machine.h"
+
+using namespace std;
+
+#define PROGRAM_SIZE 64
+#define FRAMES 200
+
+struct Run
+{
+	Engine Kind;
+	bool IdleSkip;
+	const char *Name;
+};
+
+static vector<uint8_t> RandomProgram(mt19937 &random)
+{
+	vector<uint8_t> program(PROGRAM_SIZE);
+	for (uint i = 0; i < PROGRAM_SIZE; i += 2)
+	{
+		const uint pick = random() % 100, X = random() % 4, Y = random() % 4;
+		const uint address = 0x200 + i;
+		uint16_t opcode;
+		if (pick < 15)
+			opcode = 0xF007 | X << 8; // FX07, the usual delay poll.
+		else if (pick < 25)
+			opcode = 0x3000 | X << 8 | random() % 3;
+		else if (pick < 35)
+			opcode = 0x1000 | (address - 2 * (random() % 4)); // a short backward jump.
+		else if (pick < 40)
+			opcode = 0x1000 | (0x200 + 2 * (random() % (PROGRAM_SIZE / 2)));
+		else if (pick < 45)
+			opcode = 0xF015 | X << 8;
+		else if (pick < 50)
+			opcode = 0x6000 | X << 8 | random() % 4;
+		else if (pick < 55)
+			opcode = 0x7000 | X << 8 | random() % 2;
+		else if (pick < 60)
+			opcode = (random() % 2 ? 0xE09E : 0xE0A1) | X << 8;
+		else if (pick < 63)
+			opcode = 0xF00A | X << 8;
+		else if (pick < 68)
+			opcode = 0x4000 | X << 8 | random() % 3;
+		else if (pick < 72)
+			opcode = 0xD000 | X << 8 | Y << 4 | random() % 4;
+		else if (pick < 75)
+			opcode = 0xA200 | random() % PROGRAM_SIZE; // I over the program, so FX55 rewrites code.
+		else if (pick < 78)
+			opcode = 0xF065 | X << 8;
+		else if (pick < 80)
+			opcode = 0xF055 | X << 8;
+		else if (pick < 83)
+			opcode = 0x8000 | X << 8 | Y << 4 | random() % 8;
+		else if (pick < 85)
+			opcode = 0xC000 | X << 8 | random() % 256;
+		else if (pick < 88)
+			opcode = 0xF01E | X << 8;
+		else if (pick < 90)
+			opcode = 0x5000 | X << 8 | Y << 4;
+		else
+			opcode = 0x1000 | address; // jump to itself.
+		program[i] = opcode >> 8;
+		program[i + 1] = opcode & 0xFF;
+	}
+	return program;
+}
+
+// False and the exception message when the frame throws.
+static bool RunFrame(Machine &machine, uint instructionsPerFrame, string &error)
+{
+	try
+	{
+		machine.RunFrames(1, instructionsPerFrame);
+		return true;
+	}
+	catch (const exception &exception)
+	{
+		error = exception.what();
+		return false;
+	}
+}
+
+// A program and its input, run on the reference interpreter and on every Run.
+struct Scenario
+{
+	string Name;
+	vector<uint8_t> Program;
+	QuirkProfile Profile = QuirkProfile::Default;
+	bool KeyRelease = false;   // on every machine, the reference included.
+	bool ReleaseFirst = false; // set before SetEngine creates JitChecked's interpreter, or after.
+	uint InstructionsPerFrame = 10;
+	uint32_t Seed = 1;
+	vector<uint32_t> KeyEvents; // per frame: 0, or the key plus 1 in the low byte and pressed in bit 8.
+};
+
+// False, with the first difference on cerr, when a run leaves the reference's state, count or
+// exceptions; adds the instructions the runs idle-skipped to skipped.
+static bool Agree(const Scenario &scenario, const vector<Run> &runs, uint64_t &skipped)
+{
+	vector<Machine> machines(runs.size() + 1); // the reference interpreter first.
+	for (size_t i = 0; i < machines.size(); i++)
+	{
+		machines[i].SetQuirks(scenario.Profile);
+		if (scenario.ReleaseFirst)
+			machines[i].SetKeyWaitOnRelease(scenario.KeyRelease);
+		machines[i].SetEngine(i == 0 ? Engine::Interpreter : runs[i - 1].Kind);
+		if (!scenario.ReleaseFirst)
+			machines[i].SetKeyWaitOnRelease(scenario.KeyRelease);
+		machines[i].SetIdleSkip(i != 0 && runs[i - 1].IdleSkip);
+		machines[i].SeedRandom(scenario.Seed);
+		machines[i].LoadProgram(scenario.Program.data(), scenario.Program.size());
+	}
+
+	for (uint frame = 0; frame < scenario.KeyEvents.size(); frame++)
+	{
+		const uint32_t event = scenario.KeyEvents[frame];
+		for (Machine &machine : machines)
+		{
+			if (event != 0)
+				machine.SetKey((event & 0xFF) - 1, event >> 8);
+		}
+
+		string referenceError;
+		const bool referenceRan = RunFrame(machines[0], scenario.InstructionsPerFrame, referenceError);
+		for (size_t i = 1; i < machines.size(); i++)
+		{
+			string error;
+			const bool ran = RunFrame(machines[i], scenario.InstructionsPerFrame, error);
+			const char *problem = nullptr;
+			if (ran != referenceRan)
+				problem = ran ? "did not throw" : "threw";
+			else if (ran && memcmp(&machines[i].GetState(), &machines[0].GetState(), sizeof(MachineState)) != 0)
+				problem = "diverged";
+			else if (ran && machines[i].GetInstructionCount() != machines[0].GetInstructionCount())
+				problem = "counted other instructions";
+			if (problem != nullptr)
+			{
+				cerr << scenario.Name << ", " << QuirkProfileName(scenario.Profile) << " quirks" << (scenario.KeyRelease ? ", --key-release" : "")
+					 << ", frame " << frame << ": " << runs[i - 1].Name << " " << problem << " from the interpreter";
+				if (!error.empty() || !referenceError.empty())
+					cerr << " (" << (error.empty() ? referenceError : error) << ")";
+				cerr << endl;
+				return false;
+			}
+		}
+		if (!referenceRan)
+			break;
+	}
+	for (Machine &machine : machines)
+		skipped += machine.GetIdleStats().SkippedInstructions;
+	return true;
+}
+
+// Key events held across a --key-release wait, which random input hardly ever produces: 5 ends
+// the wait on its release while 6, pressed before the loop comes back to FX0A, is still held.
+static vector<Scenario> FixedScenarios()
+{
+	vector<uint32_t> overlappingKeys;
+	for (uint i = 0; i < FRAMES / 4; i++)
+		overlappingKeys.insert(overlappingKeys.end(), {1 << 8 | 6, 1 << 8 | 7, 6, 7});
+
+	Scenario wait;
+	wait.Name = "key wait loop";
+	wait.Program = {0x60, 0x00, 0xF0, 0x0A, 0x12, 0x00}; // 6000 F00A 1200
+	wait.KeyEvents = overlappingKeys;
+
+	vector<Scenario> scenarios;
+	for (uint keyRelease = 0; keyRelease < 2; keyRelease++)
+	{
+		for (uint releaseFirst = 0; releaseFirst < 2; releaseFirst++)
+		{
+			wait.KeyRelease = keyRelease;
+			wait.ReleaseFirst = releaseFirst;
+			scenarios.push_back(wait);
+		}
+	}
+	return scenarios;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint seed = argc > 1 ? stoul(argv[1]) : 1;
+	const uint programs = argc > 2 ? stoul(argv[2]) : 400;
+	const QuirkProfile profiles[] = {QuirkProfile::Default, QuirkProfile::Vip, QuirkProfile::Chip48, QuirkProfile::Schip};
+
+	vector<Run> runs = {
+		{Engine::Interpreter, true, "interpreter --skip-idle"},
+		{Engine::Cached, false, "cached"},
+		{Engine::Cached, true, "cached --skip-idle"},
+	};
+	if (JitCompiler::IsSupported())
+	{
+		runs.push_back({Engine::Jit, false, "jit"});
+		runs.push_back({Engine::Jit, true, "jit --skip-idle"});
+		runs.push_back({Engine::JitChecked, false, "jit-checked"});
+		runs.push_back({Engine::JitChecked, true, "jit-checked --skip-idle"});
+	}
+
+	uint64_t skipped = 0;
+	for (const Scenario &scenario : FixedScenarios())
+	{
+		if (!Agree(scenario, runs, skipped))
+			return 1;
+	}
+
+	mt19937 random(seed);
+	for (uint p = 0; p < programs; p++)
+	{
+		Scenario scenario;
+		scenario.Name = "program " + to_string(p) + " (seed " + to_string(seed) + ")";
+		scenario.Program = RandomProgram(random);
+		scenario.Profile = profiles[p % 4];
+		scenario.KeyRelease = p / 4 % 2;
+		scenario.ReleaseFirst = p / 8 % 2;
+		scenario.InstructionsPerFrame = 1 + random() % 40;
+		scenario.Seed = seed + p;
+		scenario.KeyEvents.resize(FRAMES);
+		for (uint32_t &event : scenario.KeyEvents)
+			event = random() % 20 == 0 ? (random() % 2) << 8 | (1 + random() % 16) : 0;
+		if (!Agree(scenario, runs, skipped))
+			return 1;
+	}
+
+	// A generator that stopped producing idle loops would leave the skipping untested.
+	if (skipped == 0)
+	{
+		cerr << "no idle loop was skipped" << endl;
+		return 1;
+	}
+	cout << "engines: " << programs << " programs agree, " << skipped << " instructions idle-skipped" << endl;
+	return 0;
+}
\ No newline at end of file
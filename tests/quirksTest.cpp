@@ -0,0 +1,169 @@
+// The opcodes whose behaviour differs between quirk profiles, against results worked out by hand
+// from each profile's constants: 8XY6/8XYE, the I increment of FX55/FX65, VF from FX1E,
+// BNNN/BXNN, sprites at the screen edges and VF after 8XY1-8XY3. Each case is a loop run enough
+// times for the JIT to compile it, on every engine and every profile.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "jit.h"
+#include "machine.h"
+
+using namespace std;
+
+#define PROFILES 5
+#define PASSES (JIT_HOT_THRESHOLD + 2)
+
+// Opcodes placed from Address on.
+struct Code
+{
+	uint16_t Address;
+	vector<uint16_t> Opcodes;
+};
+
+// The machine after the last pass.
+struct Outcome
+{
+	uint8_t V0, V1, V2, V3, Flag; // Flag is VF.
+	uint16_t I;
+	uint64_t Top, Bottom; // display rows 0 and 31.
+};
+
+struct Case
+{
+	const char *Name;
+	vector<Code> Program;		// one pass sets up everything it reads and ends back at 0x200.
+	uint Length;				// instructions in a pass.
+	Outcome Outcomes[PROFILES]; // by QuirkProfile.
+};
+
+const QuirkProfile Profiles[PROFILES] = {QuirkProfile::Default, QuirkProfile::Vip, QuirkProfile::Chip48, QuirkProfile::Schip, QuirkProfile::XoChip};
+
+const Case Cases[] = {
+	{"8XY6/8XYE shift",
+	 {{0x200, {0x6005, 0x6181, 0x8016, 0x83F0, 0x6243, 0x821E, 0x1200}}}, // VF of the 8XY6 to V3.
+	 7,
+	 {{0x02, 0x81, 0x86, 1, 0, 0, 0, 0},
+	  {0x40, 0x81, 0x02, 1, 1, 0, 0, 0},
+	  {0x02, 0x81, 0x86, 1, 0, 0, 0, 0},
+	  {0x02, 0x81, 0x86, 1, 0, 0, 0, 0},
+	  {0x40, 0x81, 0x02, 1, 1, 0, 0, 0}}},
+	{"FX55/FX65 I increment",
+	 {{0x200, {0xA300, 0x6011, 0x6122, 0x6233, 0xF255, 0xF065, 0x1200}}}, // F065 reads where F255 left I.
+	 7,
+	 {{0x00, 0x22, 0x33, 0, 0, 0x304, 0, 0},
+	  {0x00, 0x22, 0x33, 0, 0, 0x304, 0, 0},
+	  {0x33, 0x22, 0x33, 0, 0, 0x302, 0, 0},
+	  {0x11, 0x22, 0x33, 0, 0, 0x300, 0, 0},
+	  {0x00, 0x22, 0x33, 0, 0, 0x304, 0, 0}}},
+	{"FX1E VF",
+	 {{0x200, {0xAFFF, 0x6001, 0x6F05, 0xF01E, 0x83F0, 0xA100, 0x6F05, 0xF01E, 0x1200}}}, // past 0xFFF to V3, then within.
+	 9,
+	 {{0x01, 0x00, 0x00, 1, 0, 0x101, 0, 0},
+	  {0x01, 0x00, 0x00, 5, 5, 0x101, 0, 0},
+	  {0x01, 0x00, 0x00, 5, 5, 0x101, 0, 0},
+	  {0x01, 0x00, 0x00, 5, 5, 0x101, 0, 0},
+	  {0x01, 0x00, 0x00, 5, 5, 0x101, 0, 0}}},
+	{"BNNN/BXNN",
+	 {{0x200, {0x6004, 0x6210, 0xB220}}, {0x224, {0x6301, 0x1200}}, {0x230, {0x6302, 0x1200}}}, // 0x220 + V0 or + V2.
+	 5,
+	 {{0x04, 0x00, 0x10, 1, 0, 0, 0, 0},
+	  {0x04, 0x00, 0x10, 1, 0, 0, 0, 0},
+	  {0x04, 0x00, 0x10, 2, 0, 0, 0, 0},
+	  {0x04, 0x00, 0x10, 2, 0, 0, 0, 0},
+	  {0x04, 0x00, 0x10, 1, 0, 0, 0, 0}}},
+	{"sprite clipping",
+	 {{0x200, {0x00E0, 0x60FF, 0x61FF, 0xA300, 0xF155, 0xA300, 0x603C, 0x611F, 0xD012, 0x1200}}}, // 8x2 at (60, 31).
+	 10,
+	 {{0x3C, 0x1F, 0x00, 0, 0, 0x300, 0xF00000000000000F, 0xF00000000000000F},
+	  {0x3C, 0x1F, 0x00, 0, 0, 0x300, 0x0000000000000000, 0x000000000000000F},
+	  {0x3C, 0x1F, 0x00, 0, 0, 0x300, 0x0000000000000000, 0x000000000000000F},
+	  {0x3C, 0x1F, 0x00, 0, 0, 0x300, 0x0000000000000000, 0x000000000000000F},
+	  {0x3C, 0x1F, 0x00, 0, 0, 0x300, 0xF00000000000000F, 0xF00000000000000F}}},
+	{"8XY1-8XY3 VF reset",
+	 {{0x200, {0x600C, 0x610A, 0x6F07, 0x8011, 0x83F0, 0x6F07, 0x8012, 0x82F0, 0x6F07, 0x8013, 0x1200}}}, // VF after OR to V3, AND to V2.
+	 11,
+	 {{0x00, 0x0A, 0x07, 7, 7, 0, 0, 0},
+	  {0x00, 0x0A, 0x00, 0, 0, 0, 0, 0},
+	  {0x00, 0x0A, 0x07, 7, 7, 0, 0, 0},
+	  {0x00, 0x0A, 0x07, 7, 7, 0, 0, 0},
+	  {0x00, 0x0A, 0x07, 7, 7, 0, 0, 0}}},
+};
+
+static vector<uint8_t> Program(const Case &test)
+{
+	vector<uint8_t> program;
+	for (const Code &code : test.Program)
+	{
+		program.resize(code.Address - 0x200);
+		for (uint16_t opcode : code.Opcodes)
+		{
+			program.push_back(opcode >> 8);
+			program.push_back(opcode & 0xFF);
+		}
+	}
+	return program;
+}
+
+static bool Check(const Case &test, uint profile, Engine engine, const char *engineName)
+{
+	const vector<uint8_t> program = Program(test);
+	Machine machine;
+	machine.SetQuirks(Profiles[profile]);
+	machine.SetEngine(engine);
+	machine.LoadProgram(program.data(), program.size());
+	try
+	{
+		machine.Step(PASSES * test.Length);
+	}
+	catch (const exception &exception)
+	{
+		cerr << test.Name << ", " << QuirkProfileName(Profiles[profile]) << " quirks (" << engineName << "): " << exception.what() << endl;
+		return false;
+	}
+
+	const MachineState &state = machine.GetState();
+	const Outcome &expected = test.Outcomes[profile];
+	const char *names[] = {"V0", "V1", "V2", "V3", "VF", "I", "row 0", "row 31"};
+	const uint64_t values[][8] = {
+		{state.Registers[0], state.Registers[1], state.Registers[2], state.Registers[3], state.Registers[VF], state.IndexRegister,
+		 machine.GetDisplay()[0], machine.GetDisplay()[DISPLAY_ARRAY_HEIGHT - 1]},
+		{expected.V0, expected.V1, expected.V2, expected.V3, expected.Flag, expected.I, expected.Top, expected.Bottom},
+	};
+
+	bool passed = state.ProgramCounter == 0x200;
+	if (!passed)
+		cerr << test.Name << ", " << QuirkProfileName(Profiles[profile]) << " quirks (" << engineName << "): PC is " << hex << state.ProgramCounter
+			 << dec << " after the last pass" << endl;
+	for (uint i = 0; i < 8; i++)
+	{
+		if (values[0][i] != values[1][i])
+		{
+			cerr << test.Name << ", " << QuirkProfileName(Profiles[profile]) << " quirks (" << engineName << "): " << names[i] << " is " << hex
+				 << values[0][i] << ", expected " << values[1][i] << dec << endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+int main()
+{
+	bool passed = true;
+	for (const Case &test : Cases)
+	{
+		for (uint profile = 0; profile < PROFILES; profile++)
+		{
+			passed &= Check(test, profile, Engine::Interpreter, "interpreter");
+			passed &= Check(test, profile, Engine::Cached, "cached");
+			if (JitCompiler::IsSupported())
+			{
+				passed &= Check(test, profile, Engine::Jit, "jit");
+				passed &= Check(test, profile, Engine::JitChecked, "jit-checked");
+			}
+		}
+	}
+	cout << (passed ? "quirks: all cases match" : "quirks: FAILED") << endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// The XO-CHIP opcodes against results worked out by hand: F000 NNNN and the skips over it, FN01
+// plane selection for DXYN and 00E0, 5XY2/5XY3 in both directions above 0xFFF, 00DN on one plane
+// and the F002 pattern with its FX3A pitch. XO-CHIP only interprets, so each case also runs with
+// every other engine selected.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "jit.h"
+#include "machine.h"
+
+using namespace std;
+
+// Words placed from Address on, opcodes or data.
+struct Code
+{
+	uint16_t Address;
+	vector<uint16_t> Words;
+};
+
+// A display row that is not blank: plane 1 is the display, plane 2 XoChipState::bPlane.
+struct Row
+{
+	uint Plane, Y;
+	uint64_t Bits;
+};
+
+struct Bytes
+{
+	uint16_t Address;
+	vector<uint8_t> Values;
+};
+
+struct Case
+{
+	const char *Name;
+	vector<Code> Program;
+	uint Instructions;
+	uint8_t Registers[REGISTERS_COUNT];
+	uint16_t I, PC;
+	vector<Row> Rows;
+	vector<Bytes> Memory;
+	uint8_t Pattern[XO_AUDIO_PATTERN_SIZE];
+	uint8_t Pitch;
+};
+
+const Case Cases[] = {
+	{"F000 NNNN skips",
+	 {{0x200, {0x6001, 0x3001, 0xF000, 0x1234, 0x6105, 0x3000, 0xF000, 0xABCD, 0x9010, 0xF000, 0x5555, 0x6207, 0x1218}}},
+	 7,
+	 {0x01, 0x05, 0x07},
+	 0xABCD,
+	 0x218,
+	 {},
+	 {},
+	 {},
+	 XO_DEFAULT_PITCH},
+	{"FN01 plane draws",
+	 {{0x200, {0xF201, 0xA300, 0x6000, 0x6100, 0xD011, 0xF301, 0xA301, 0xD011, 0xF101, 0xA303, 0xD011, 0xF001, 0x00E0, 0x121A}},
+	  {0x300, {0xF03C, 0x0F18}}}, // plane 2 alone, both from consecutive bytes, plane 1 colliding, a clear of no plane.
+	 13,
+	 {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01},
+	 0x303,
+	 0x21A,
+	 {{1, 0, 0x2400000000000000}, {2, 0, 0xFF00000000000000}},
+	 {},
+	 {},
+	 XO_DEFAULT_PITCH},
+	{"5XY2/5XY3",
+	 {{0x200, {0xF000, 0x8000, 0x6011, 0x6122, 0x6233, 0x5022, 0xF000, 0x8003, 0x5202, 0x5353, 0xF000, 0x8000, 0x5863, 0x121A}}},
+	 10,
+	 {0x11, 0x22, 0x33, 0x33, 0x22, 0x11, 0x33, 0x22, 0x11},
+	 0x8000,
+	 0x21A,
+	 {},
+	 {{0x8000, {0x11, 0x22, 0x33, 0x33, 0x22, 0x11}}},
+	 {},
+	 XO_DEFAULT_PITCH},
+	{"00DN",
+	 {{0x200, {0xF301, 0xA300, 0x6000, 0x6105, 0xD011, 0xF101, 0x00D3, 0x120E}}, {0x300, {0xF03C}}}, // only plane 1 scrolls.
+	 7,
+	 {0x00, 0x05},
+	 0x300,
+	 0x20E,
+	 {{1, 2, 0xF000000000000000}, {2, 5, 0x3C00000000000000}},
+	 {},
+	 {},
+	 XO_DEFAULT_PITCH},
+	{"F002/FX3A",
+	 {{0x200, {0xA300, 0xF002, 0x6080, 0xF03A, 0x1208}}, {0x300, {0x0011, 0x2233, 0x4455, 0x6677, 0x8899, 0xAABB, 0xCCDD, 0xEEFF}}},
+	 4,
+	 {0x80},
+	 0x300,
+	 0x208,
+	 {},
+	 {},
+	 {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF},
+	 0x80},
+};
+
+static vector<uint8_t> Program(const Case &test)
+{
+	vector<uint8_t> program;
+	for (const Code &code : test.Program)
+	{
+		program.resize(code.Address - 0x200);
+		for (uint16_t word : code.Words)
+		{
+			program.push_back(word >> 8);
+			program.push_back(word & 0xFF);
+		}
+	}
+	return program;
+}
+
+static bool Check(const Case &test, Engine engine, const char *engineName)
+{
+	const vector<uint8_t> program = Program(test);
+	Machine machine;
+	machine.SetQuirks(QuirkProfile::XoChip);
+	machine.SetEngine(engine);
+	machine.LoadProgram(program.data(), program.size());
+	try
+	{
+		machine.Step(test.Instructions);
+	}
+	catch (const exception &exception)
+	{
+		cerr << test.Name << " (" << engineName << "): " << exception.what() << endl;
+		return false;
+	}
+
+	const MachineState &state = machine.GetState();
+	const XoChipState &xo = *machine.GetXoChipState();
+	bool passed = true;
+	const auto expect = [&](const string &what, uint64_t actual, uint64_t expected)
+	{
+		if (actual == expected)
+			return;
+		cerr << test.Name << " (" << engineName << "): " << what << " is " << hex << actual << ", expected " << expected << dec << endl;
+		passed = false;
+	};
+
+	for (uint i = 0; i < REGISTERS_COUNT; i++)
+		expect("V" + to_string(i), state.Registers[i], test.Registers[i]);
+	expect("I", state.IndexRegister, test.I);
+	expect("PC", state.ProgramCounter, test.PC);
+
+	uint64_t rows[2][DISPLAY_HIRES_HEIGHT] = {};
+	for (const Row &row : test.Rows)
+		rows[row.Plane - 1][row.Y] = row.Bits;
+	for (uint y = 0; y < DISPLAY_HIRES_HEIGHT; y++)
+	{
+		expect("plane 1 row " + to_string(y), machine.GetDisplay()[y], rows[0][y]);
+		expect("plane 2 row " + to_string(y), xo.bPlane[y], rows[1][y]);
+		expect("plane 1 right row " + to_string(y), machine.GetDisplayRight()[y], 0);
+		expect("plane 2 right row " + to_string(y), xo.bPlaneRight[y], 0);
+	}
+
+	for (const Bytes &bytes : test.Memory)
+	{
+		for (size_t i = 0; i < bytes.Values.size(); i++)
+			expect("memory at " + to_string(bytes.Address + i), xo.Memory[bytes.Address + i], bytes.Values[i]);
+	}
+	for (uint i = 0; i < XO_AUDIO_PATTERN_SIZE; i++)
+		expect("pattern byte " + to_string(i), xo.AudioPattern[i], test.Pattern[i]);
+	expect("pitch", xo.Pitch, test.Pitch);
+	return passed;
+}
+
+int main()
+{
+	bool passed = true;
+	for (const Case &test : Cases)
+	{
+		passed &= Check(test, Engine::Interpreter, "interpreter");
+		passed &= Check(test, Engine::Cached, "cached");
+		if (JitCompiler::IsSupported())
+		{
+			passed &= Check(test, Engine::Jit, "jit");
+			passed &= Check(test, Engine::JitChecked, "jit-checked");
+		}
+	}
+	cout << (passed ? "xochip: all cases match" : "xochip: FAILED") << endl;
+	return passed ? 0 : 1;
+}